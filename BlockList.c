@@ -0,0 +1,504 @@
+/**
+ * Per-block hash lists (Merkle manifests) for partial re-verification
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ *
+ * With the BlockListSize option set, HashSave also hashes each file larger
+ * than one block in blocks of that many MiB, with the same algorithm as the
+ * file, as it reads it, and follows the file's line in the checksum file with
+ * comment lines (which other tools skip) giving the block size, the file's
+ * size and the Merkle root of the block digests, and then each block's
+ * digest.  The Merkle root pairs up the digests, hashes each pair, and does
+ * so again with the results until one is left (an odd one out goes up a level
+ * as it is), which is then hashed once more with the whole file's digest, so
+ * it vouches for the list itself and ties it to the file's line: a list that
+ * has been damaged, or sits under a line whose digest has been changed, is
+ * ignored (and the file hashed whole) rather than blamed on the file.
+ *
+ * HashVerify then checks such a file block by block, on several threads,
+ * rather than hashing it whole, and shows which ranges are corrupt.  Those
+ * blocks are noted (.hcr, beside the resume checkpoints) under the file's ID,
+ * and once the file has been repaired in place, the next verification checks
+ * just them; the note goes once every block is good again.
+ **/
+
+#include "globals.h"
+#include "BlockList.h"
+#include "Checkpoint.h"
+#include <Strsafe.h>
+
+#define REPAIRS_MAGIC 0x52424348  // "HCBR"
+
+typedef struct {
+	DWORD dwMagic;
+	UINT uAlg;
+	DWORD cbBlock;
+	UINT cBad;
+	ULONGLONG cbFileSize;
+	BYTE abRoot[MAX_DIGEST_LENGTH];
+} REPAIRSHEADER;
+
+static UINT WINAPI DigestLength( UINT uAlg )
+{
+	switch (uAlg)
+	{
+#define BLOCKLIST_DIGEST_LENGTH_op(alg) \
+		case alg:  return(alg##_DIGEST_LENGTH);
+		FOR_EACH_HASH(BLOCKLIST_DIGEST_LENGTH_op)
+	}
+
+	return(0);
+}
+
+static __inline UINT CountBlocks( ULONGLONG cbFileSize, DWORD cbBlock )
+{
+	ULONGLONG cBlocks = (cbFileSize + cbBlock - 1) / cbBlock;
+	return(cBlocks <= BLOCKLIST_MAX_BLOCKS ? (UINT)cBlocks : 0);
+}
+
+// Finishes pwhctx (for a single algorithm) into pbDigest
+static VOID WINAPI FinishDigest( PWHCTXEX pwhctx, UINT cbDigest, PBYTE pbDigest )
+{
+	WHRESULTEX whres;
+
+	whres.dwFlags = 0;
+	whres.dwSlots = pwhctx->dwFlags;
+	WHFinishEx(pwhctx, &whres);
+	memcpy(pbDigest, whres.abDigests, cbDigest);
+}
+
+// Hashes pairs of digests, level by level, down to the top one, and then that with the
+// file's digest (pbFileDigest) into the root; the digests are left alone
+static BOOL WINAPI MerkleRoot( PCBLOCKLIST pbl, PCBYTE pbFileDigest, PWHCTXEX pwhctx, PBYTE pbRoot )
+{
+	UINT cbDigest = pbl->cbDigest, cNodes = pbl->cBlocks, i;
+	PBYTE pbLevel;
+
+	if (! (pbLevel = (PBYTE)malloc(((SIZE_T)cNodes + 1) * cbDigest)))
+		return(FALSE);
+
+	memcpy(pbLevel, pbl->pbDigests, (SIZE_T)cNodes * cbDigest);
+	pwhctx->dwFlags = BlockListFlags(pbl);
+
+	while (cNodes > 1)
+	{
+		for (i = 0; i + 1 < cNodes; i += 2)
+		{
+			WHInitEx(pwhctx);
+			WHUpdateEx(pwhctx, pbLevel + (SIZE_T)i * cbDigest, cbDigest * 2);
+			FinishDigest(pwhctx, cbDigest, pbLevel + (SIZE_T)(i / 2) * cbDigest);
+		}
+
+		if (cNodes & 1)
+			memmove(pbLevel + (SIZE_T)(cNodes / 2) * cbDigest, pbLevel + (SIZE_T)(cNodes - 1) * cbDigest, cbDigest);
+
+		cNodes = (cNodes + 1) / 2;
+	}
+
+	memcpy(pbLevel + cbDigest, pbFileDigest, cbDigest);
+	WHInitEx(pwhctx);
+	WHUpdateEx(pwhctx, pbLevel, cbDigest * 2);
+	FinishDigest(pwhctx, cbDigest, pbRoot);
+
+	free(pbLevel);
+	return(TRUE);
+}
+
+// Starts a list for the file about to be hashed with dwFlags, if it's to have one (there must
+// be just one algorithm, and more than one block); pwhctx is for the blocks, not the file
+BOOL WINAPI BlockListBegin( PBLOCKLIST pbl, DWORD dwFlags, ULONGLONG cbFileSize, PWHCTXEX pwhctx )
+{
+	UINT cBlocks;
+
+	pbl->cBlocks = 0;
+
+	if ( pbl->cbBlock == 0 || (dwFlags & (dwFlags - 1)) || cbFileSize <= pbl->cbBlock ||
+	     (cBlocks = CountBlocks(cbFileSize, pbl->cbBlock)) == 0 )
+		return(FALSE);
+
+#define BLOCKLIST_ALG_op(alg)           \
+	if (dwFlags == WHEX_CHECK##alg)     \
+		pbl->uAlg = alg;
+	FOR_EACH_HASH(BLOCKLIST_ALG_op)
+	pbl->cbDigest = DigestLength(pbl->uAlg);
+
+	// The digests' room (for the longest digests) is kept from one file to the next
+	if (cBlocks > pbl->cAlloc)
+	{
+		PBYTE pbDigests = (PBYTE)realloc(pbl->pbDigests, (SIZE_T)cBlocks * MAX_DIGEST_LENGTH);
+		if (pbDigests == NULL)
+			return(FALSE);
+		pbl->pbDigests = pbDigests;
+		pbl->cAlloc = cBlocks;
+	}
+
+	pbl->cbFileSize = cbFileSize;
+	pbl->cbInBlock = 0;
+	pbl->pwhctx = pwhctx;
+	pwhctx->dwFlags = dwFlags;
+	WHInitEx(pwhctx);
+	return(TRUE);
+}
+
+VOID WINAPI BlockListUpdate( PBLOCKLIST pbl, PCBYTE pbIn, UINT cbIn )
+{
+	while (cbIn)
+	{
+		UINT cbChunk = min(cbIn, pbl->cbBlock - pbl->cbInBlock);
+
+		WHUpdateEx(pbl->pwhctx, pbIn, cbChunk);
+		pbIn += cbChunk;
+		cbIn -= cbChunk;
+
+		if ((pbl->cbInBlock += cbChunk) == pbl->cbBlock && pbl->cBlocks < pbl->cAlloc)
+		{
+			FinishDigest(pbl->pwhctx, pbl->cbDigest, BlockListDigest(pbl, pbl->cBlocks++));
+			WHInitEx(pbl->pwhctx);
+			pbl->cbInBlock = 0;
+		}
+	}
+}
+
+// Finishes the last (short) block and the root, given the file's finished results; a
+// list for a file that couldn't be read to the end (!bComplete) is dropped
+VOID WINAPI BlockListEnd( PBLOCKLIST pbl, BOOL bComplete, PCWHRESULTEX pwhres )
+{
+	PCBYTE pbFileDigest = WHResultDigest(pwhres, pbl->uAlg);
+
+	if (pbl->cbInBlock && pbl->cBlocks < pbl->cAlloc)
+		FinishDigest(pbl->pwhctx, pbl->cbDigest, BlockListDigest(pbl, pbl->cBlocks++));
+
+	if (! ( bComplete && pbFileDigest && pbl->cBlocks == CountBlocks(pbl->cbFileSize, pbl->cbBlock) &&
+	        MerkleRoot(pbl, pbFileDigest, pbl->pwhctx, pbl->abRoot) ))
+		pbl->cBlocks = 0;
+}
+
+// Appends the ASCII psz to pvOut (if any), as WCHARs or CHARs; returns the bytes it takes
+static SIZE_T WINAPI EmitLine( PCTSTR psz, PBYTE pbOut, BOOL bWide )
+{
+	SIZE_T cch = SSLen(psz), i;
+
+	if (pbOut)
+	{
+		for (i = 0; i < cch; ++i)
+		{
+			if (bWide)
+				((PWCHAR)pbOut)[i] = (WCHAR)psz[i];
+			else
+				pbOut[i] = (CHAR)psz[i];
+		}
+	}
+
+	return(cch * (bWide ? sizeof(WCHAR) : sizeof(CHAR)));
+}
+
+// Writes the list's lines to pvOut, in UTF-16 if bWide and otherwise in ASCII (which is
+// also UTF-8 and ANSI), and returns their length in bytes; with a NULL pvOut, it only
+// returns the length
+SIZE_T WINAPI BlockListFormat( PCBLOCKLIST pbl, PVOID pvOut, BOOL bWide )
+{
+	TCHAR szLine[MAX_DIGEST_STRING_LENGTH + 0x40];
+	TCHAR szHex[MAX_DIGEST_STRING_LENGTH];
+	PCTSTR pszExt = NULL;
+	PBYTE pbOut = (PBYTE)pvOut;
+	SIZE_T cbOut = 0, cb;
+	UINT i;
+
+	if (pbl->cBlocks == 0)
+		return(0);
+
+	switch (pbl->uAlg)
+	{
+#define BLOCKLIST_EXT_op(alg) \
+		case alg:  pszExt = HASH_EXT_##alg + 1;  break;
+		FOR_EACH_HASH(BLOCKLIST_EXT_op)
+		default: return(0);
+	}
+
+	WHByteToHex((PBYTE)pbl->abRoot, szHex, pbl->cbDigest * 2, WHFMT_LOWERCASE);
+	StringCchPrintf(szLine, countof(szLine), BLOCKLIST_HEADER_PREFIX TEXT("%s %u %I64u %s\r\n"),
+	                pszExt, pbl->cbBlock, pbl->cbFileSize, szHex);
+	cbOut += cb = EmitLine(szLine, pbOut, bWide);
+	if (pbOut) pbOut += cb;
+
+	for (i = 0; i < pbl->cBlocks; ++i)
+	{
+		WHByteToHex(BlockListDigest(pbl, i), szHex, pbl->cbDigest * 2, WHFMT_LOWERCASE);
+		StringCchPrintf(szLine, countof(szLine), BLOCKLIST_ENTRY_PREFIX TEXT("%s\r\n"), szHex);
+		cbOut += cb = EmitLine(szLine, pbOut, bWide);
+		if (pbOut) pbOut += cb;
+	}
+
+	return(cbOut);
+}
+
+// Frees a list that was made with BlockListBegin (a parsed list is a single malloc)
+VOID WINAPI BlockListFree( PBLOCKLIST pbl )
+{
+	free(pbl->pbDigests);
+	pbl->pbDigests = NULL;
+	pbl->cAlloc = pbl->cBlocks = 0;
+}
+
+// Copies a finished list so that it can be written out later; like a parsed list, the
+// copy is a single malloc (without the per-block state); returns NULL if there's no list
+PBLOCKLIST WINAPI BlockListCopy( PCBLOCKLIST pbl )
+{
+	SIZE_T cbDigests = (SIZE_T)pbl->cBlocks * pbl->cbDigest;
+	PBLOCKLIST pblCopy;
+
+	if (pbl->cBlocks == 0 || ! (pblCopy = (PBLOCKLIST)malloc(sizeof(BLOCKLIST) + cbDigests)))
+		return(NULL);
+
+	*pblCopy = *pbl;
+	pblCopy->cAlloc = pbl->cBlocks;
+	pblCopy->pbDigests = (PBYTE)(pblCopy + 1);
+	pblCopy->pbState = NULL;
+	pblCopy->pwhctx = NULL;
+	memcpy(pblCopy->pbDigests, pbl->pbDigests, cbDigests);
+
+	return(pblCopy);
+}
+
+// Splits off the next space-delimited field of *ppsz
+static PTSTR WINAPI NextField( PTSTR *ppsz )
+{
+	PTSTR pszField = *ppsz, psz = pszField;
+
+	while (*psz && *psz != TEXT(' '))
+		++psz;
+	if (*psz)
+		*psz++ = 0;
+	while (*psz == TEXT(' '))
+		++psz;
+
+	*ppsz = psz;
+	return(*pszField ? pszField : NULL);
+}
+
+// Parses what follows BLOCKLIST_HEADER_PREFIX, and returns an empty list (to be freed with
+// free) with room for the digests, or NULL if the line makes no sense
+PBLOCKLIST WINAPI BlockListParseHeader( PTSTR pszFields )
+{
+	PTSTR pszExt = NextField(&pszFields), pszBlock = NextField(&pszFields),
+	      pszSize = NextField(&pszFields), pszRoot = NextField(&pszFields);
+	ULONGLONG cbFileSize, cbBlock;
+	UINT uAlg = 0, cbDigest, cBlocks;
+	PBLOCKLIST pbl;
+
+	if (! (pszExt && pszBlock && pszSize && pszRoot))
+		return(NULL);
+
+#define BLOCKLIST_PARSE_EXT_op(alg)                          \
+	if (StrCmpI(pszExt, HASH_EXT_##alg + 1) == 0)            \
+		uAlg = alg;
+	FOR_EACH_HASH(BLOCKLIST_PARSE_EXT_op)
+
+	cbBlock = _tcstoui64(pszBlock, NULL, 10);
+	cbFileSize = _tcstoui64(pszSize, NULL, 10);
+
+	if ( uAlg == 0 || cbBlock == 0 || cbBlock > BLOCKLIST_MAX_BLOCK_SIZE || cbBlock % BLOCKLIST_UNIT ||
+	     (cbDigest = DigestLength(uAlg)) * 2 != SSLen(pszRoot) ||
+	     (cBlocks = CountBlocks(cbFileSize, (DWORD)cbBlock)) < 2 )
+		return(NULL);
+
+	if (! (pbl = (PBLOCKLIST)malloc(sizeof(BLOCKLIST) + (SIZE_T)cBlocks * (cbDigest + 1))))
+		return(NULL);
+
+	ZeroMemory(pbl, sizeof(BLOCKLIST));
+	pbl->uAlg = uAlg;
+	pbl->cbDigest = cbDigest;
+	pbl->cbBlock = (DWORD)cbBlock;
+	pbl->cbFileSize = cbFileSize;
+	pbl->cAlloc = cBlocks;
+	pbl->pbDigests = (PBYTE)(pbl + 1);
+	pbl->pbState = pbl->pbDigests + (SIZE_T)cBlocks * cbDigest;
+
+	if (! WHHexToByte(pszRoot, pbl->abRoot, cbDigest * 2))
+	{
+		free(pbl);
+		return(NULL);
+	}
+
+	return(pbl);
+}
+
+// Parses what follows BLOCKLIST_ENTRY_PREFIX into the next block's digest
+BOOL WINAPI BlockListParseEntry( PBLOCKLIST pbl, PTSTR pszDigest )
+{
+	if (pbl->cBlocks == pbl->cAlloc || SSLen(pszDigest) != pbl->cbDigest * 2)
+		return(FALSE);
+
+	if (! WHHexToByte(pszDigest, BlockListDigest(pbl, pbl->cBlocks), pbl->cbDigest * 2))
+		return(FALSE);
+
+	++pbl->cBlocks;
+	return(TRUE);
+}
+
+// Whether a parsed list is whole and undamaged, for one of the algorithms in dwFlags, and
+// made along with the file digest pszExpected (in hex); pwhctx is scratch
+BOOL WINAPI BlockListCheckRoot( PCBLOCKLIST pbl, DWORD dwFlags, PTSTR pszExpected, PWHCTXEX pwhctx )
+{
+	BYTE abFileDigest[MAX_DIGEST_LENGTH];
+	BYTE abRoot[MAX_DIGEST_LENGTH];
+
+	return( (dwFlags & BlockListFlags(pbl)) && pbl->cBlocks == pbl->cAlloc &&
+	        SSLen(pszExpected) == pbl->cbDigest * 2 && WHHexToByte(pszExpected, abFileDigest, pbl->cbDigest * 2) &&
+	        MerkleRoot(pbl, abFileDigest, pwhctx, abRoot) && memcmp(abRoot, pbl->abRoot, pbl->cbDigest) == 0 );
+}
+
+// Finishes pwhctx, which has hashed block iBlock, and compares it with the list
+BOOL WINAPI BlockListMatch( PCBLOCKLIST pbl, UINT iBlock, PWHCTXEX pwhctx )
+{
+	BYTE abDigest[MAX_DIGEST_LENGTH];
+
+	FinishDigest(pwhctx, pbl->cbDigest, abDigest);
+	return(memcmp(abDigest, BlockListDigest(pbl, iBlock), pbl->cbDigest) == 0);
+}
+
+// Marks every block to be checked or, if the file's last check against this same list found
+// some bad blocks, just those; returns TRUE in the latter case
+BOOL WINAPI BlockListLoadRepairs( PBLOCKLIST pbl, HANDLE hFile )
+{
+	TCHAR szPath[MAX_PATH];
+	REPAIRSHEADER header;
+	HANDLE hRepairs;
+	PUINT32 piBad = NULL;
+	DWORD cbRead, cbBad;
+	BOOL bLoaded = FALSE;
+	UINT i;
+
+	ZeroMemory(pbl->pbState, pbl->cBlocks);
+
+	if (! CheckpointPath(hFile, TEXT(".hcr"), szPath))
+		return(FALSE);
+
+	hRepairs = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hRepairs == INVALID_HANDLE_VALUE)
+		return(FALSE);
+
+	if ( ReadFile(hRepairs, &header, sizeof(header), &cbRead, NULL) && cbRead == sizeof(header) &&
+	     header.dwMagic == REPAIRS_MAGIC && header.uAlg == pbl->uAlg && header.cbBlock == pbl->cbBlock &&
+	     header.cbFileSize == pbl->cbFileSize && memcmp(header.abRoot, pbl->abRoot, pbl->cbDigest) == 0 &&
+	     header.cBad && header.cBad <= pbl->cBlocks &&
+	     (piBad = (PUINT32)malloc(cbBad = header.cBad * sizeof(UINT32))) &&
+	     ReadFile(hRepairs, piBad, cbBad, &cbRead, NULL) && cbRead == cbBad )
+	{
+		bLoaded = TRUE;
+		for (i = 0; i < header.cBad; ++i)
+			bLoaded &= piBad[i] < pbl->cBlocks;
+	}
+
+	CloseHandle(hRepairs);
+
+	if (bLoaded)
+	{
+		memset(pbl->pbState, BLOCK_GOOD, pbl->cBlocks);
+		for (i = 0; i < header.cBad; ++i)
+			pbl->pbState[piBad[i]] = BLOCK_UNCHECKED;
+	}
+
+	free(piBad);
+	return(bLoaded);
+}
+
+// Notes the bad blocks for next time, or forgets them if there are none
+VOID WINAPI BlockListSaveRepairs( PCBLOCKLIST pbl, HANDLE hFile )
+{
+	TCHAR szPath[MAX_PATH];
+	REPAIRSHEADER header;
+	HANDLE hRepairs;
+	PUINT32 piBad;
+	DWORD cbWritten;
+	UINT i;
+
+	if (! CheckpointPath(hFile, TEXT(".hcr"), szPath))
+		return;
+
+	ZeroMemory(&header, sizeof(header));
+	for (i = 0; i < pbl->cBlocks; ++i)
+		header.cBad += pbl->pbState[i] == BLOCK_BAD;
+
+	if (header.cBad == 0 || ! (piBad = (PUINT32)malloc(header.cBad * sizeof(UINT32))))
+	{
+		DeleteFile(szPath);
+		return;
+	}
+
+	header.cBad = 0;
+	for (i = 0; i < pbl->cBlocks; ++i)
+	{
+		if (pbl->pbState[i] == BLOCK_BAD)
+			piBad[header.cBad++] = i;
+	}
+
+	header.dwMagic = REPAIRS_MAGIC;
+	header.uAlg = pbl->uAlg;
+	header.cbBlock = pbl->cbBlock;
+	header.cbFileSize = pbl->cbFileSize;
+	memcpy(header.abRoot, pbl->abRoot, pbl->cbDigest);
+
+	hRepairs = CreateFile(szPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hRepairs != INVALID_HANDLE_VALUE)
+	{
+		BOOL bWritten = WriteFile(hRepairs, &header, sizeof(header), &cbWritten, NULL) && cbWritten == sizeof(header) &&
+		                WriteFile(hRepairs, piBad, header.cBad * sizeof(UINT32), &cbWritten, NULL) &&
+		                cbWritten == header.cBad * sizeof(UINT32);
+		CloseHandle(hRepairs);
+
+		if (! bWritten)
+			DeleteFile(szPath);
+	}
+
+	free(piBad);
+}
+
+// Describes the bad ranges, in MiB, as in "16-24, 400-EOF MiB", cut short with "..." if
+// they don't all fit; returns the number of bad blocks
+UINT WINAPI BlockListFormatBad( PCBLOCKLIST pbl, PTSTR pszDest, UINT cchDest )
+{
+	static const TCHAR szUnit[] = TEXT(" MiB"), szMore[] = TEXT("...");
+	PTSTR psz = pszDest;
+	size_t cchLeft = cchDest - countof(szUnit) - countof(szMore) + 2;
+	UINT cBad = 0, iStart, i;
+	BOOL bCut = FALSE;
+
+	*psz = 0;
+
+	for (i = 0; i < pbl->cBlocks; )
+	{
+		ULONGLONG ibEnd;
+
+		if (pbl->pbState[i] != BLOCK_BAD)
+		{
+			++i;
+			continue;
+		}
+
+		for (iStart = i; i < pbl->cBlocks && pbl->pbState[i] == BLOCK_BAD; ++i)
+			++cBad;
+
+		if (! bCut)
+		{
+			PCTSTR pszSep = psz == pszDest ? TEXT("") : TEXT(", ");
+			PTSTR pszRange = psz;
+
+			ibEnd = (ULONGLONG)i * pbl->cbBlock;
+			bCut = FAILED( ibEnd < pbl->cbFileSize ?
+				StringCchPrintfEx(psz, cchLeft, &psz, &cchLeft, 0, TEXT("%s%I64u-%I64u"), pszSep,
+				                  ((ULONGLONG)iStart * pbl->cbBlock) >> 20, ibEnd >> 20) :
+				StringCchPrintfEx(psz, cchLeft, &psz, &cchLeft, 0, TEXT("%s%I64u-EOF"), pszSep,
+				                  ((ULONGLONG)iStart * pbl->cbBlock) >> 20) );
+
+			// Leave out a range that doesn't fit whole
+			if (bCut)
+				*pszRange = 0;
+		}
+	}
+
+	if (cBad)
+		StringCchCat(pszDest, cchDest, bCut ? szMore : szUnit);
+
+	return(cBad);
+}
@@ -0,0 +1,71 @@
+/**
+ * Per-block hash lists (Merkle manifests) for partial re-verification
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ **/
+
+#ifndef __BLOCKLIST_H__
+#define __BLOCKLIST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <windows.h>
+#include "libs/WinHash.h"
+
+// Block sizes are whole MiB (which keeps them a multiple of READ_BUFFER_SIZE)
+#define BLOCKLIST_UNIT            0x100000
+#define BLOCKLIST_MAX_BLOCK_SIZE  0xFFF00000
+#define BLOCKLIST_MAX_BLOCKS      0x1000000
+
+// The comment lines that follow a file's line in a checksum file
+#define BLOCKLIST_HEADER_PREFIX   TEXT(";#blocks ")  // <ext> <block size> <file size> <root>
+#define BLOCKLIST_ENTRY_PREFIX    TEXT(";#b ")       // <digest of the next block>
+
+// Verification state of each block
+#define BLOCK_UNCHECKED  0
+#define BLOCK_GOOD       1
+#define BLOCK_BAD        2
+
+typedef struct {
+	UINT uAlg;                       // the algorithm, as in enum hash_algorithm
+	UINT cbDigest;                   // its digest length
+	DWORD cbBlock;                   // block size (0: don't make block lists)
+	ULONGLONG cbFileSize;            // the file's size
+	UINT cBlocks;                    // digests in pbDigests (0: there's no list)
+	UINT cAlloc;                     // room in pbDigests, in digests
+	PBYTE pbDigests;                 // each block's digest, in file order
+	PBYTE pbState;                   // when verifying: each block's BLOCK_* state
+	BYTE abRoot[MAX_DIGEST_LENGTH];  // the Merkle root of the digests, hashed with the file's
+	PWHCTXEX pwhctx;                 // while making a list: the current block's context
+	DWORD cbInBlock;                 // while making a list: bytes of the current block so far
+} BLOCKLIST, *PBLOCKLIST;
+
+typedef CONST BLOCKLIST *PCBLOCKLIST;
+
+#define BlockListDigest(pbl, i)  ((pbl)->pbDigests + (SIZE_T)(i) * (pbl)->cbDigest)
+#define BlockListFlags(pbl)      (1UL << ((pbl)->uAlg - 1))
+
+// Making a list, alongside the hashing of the whole file
+BOOL WINAPI BlockListBegin( PBLOCKLIST pbl, DWORD dwFlags, ULONGLONG cbFileSize, PWHCTXEX pwhctx );
+VOID WINAPI BlockListUpdate( PBLOCKLIST pbl, PCBYTE pbIn, UINT cbIn );
+VOID WINAPI BlockListEnd( PBLOCKLIST pbl, BOOL bComplete, PCWHRESULTEX pwhres );
+SIZE_T WINAPI BlockListFormat( PCBLOCKLIST pbl, PVOID pvOut, BOOL bWide );
+VOID WINAPI BlockListFree( PBLOCKLIST pbl );
+PBLOCKLIST WINAPI BlockListCopy( PCBLOCKLIST pbl );
+
+// Reading a list from a checksum file, and checking a file against it
+PBLOCKLIST WINAPI BlockListParseHeader( PTSTR pszFields );
+BOOL WINAPI BlockListParseEntry( PBLOCKLIST pbl, PTSTR pszDigest );
+BOOL WINAPI BlockListCheckRoot( PCBLOCKLIST pbl, DWORD dwFlags, PTSTR pszExpected, PWHCTXEX pwhctx );
+BOOL WINAPI BlockListMatch( PCBLOCKLIST pbl, UINT iBlock, PWHCTXEX pwhctx );
+BOOL WINAPI BlockListLoadRepairs( PBLOCKLIST pbl, HANDLE hFile );
+VOID WINAPI BlockListSaveRepairs( PCBLOCKLIST pbl, HANDLE hFile );
+UINT WINAPI BlockListFormatBad( PCBLOCKLIST pbl, PTSTR pszDest, UINT cchDest );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * Checkpoints for resuming the hashing of long files
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ *
+ * While a long file is being hashed, its hash state (WHExportEx) is saved now
+ * and then, and whenever the user pauses or cancels, in a file of its own
+ * under %LOCALAPPDATA%\HashCheck\Checkpoints; the next time the same file is
+ * hashed, with the same algorithms, hashing picks up from there instead of
+ * from the start.  The checkpoint is named after the file's volume serial
+ * number and file ID, so a file keeps its checkpoint across renames, and the
+ * algorithms, so that hashing the same file with others (say, in its
+ * properties while a checksum file is being saved) keeps one of its own; it
+ * records the file's size and last-write time, so one that has changed since
+ * starts over.  The checkpoint is deleted once the file has been hashed.
+ *
+ * Incremental hashing, for append-only files such as logs, is off unless the
+ * IncrementalMinSize option is set: the state at the end of each file at
+ * least that long is kept (.hca), with fingerprints of the first and last
+ * CHECKPOINT_FINGERPRINT_SIZE bytes, and if the file has only grown since
+ * (same creation time, no shorter, the same fingerprints), hashing resumes
+ * from that state and reads just the new bytes.  This trusts that the rest
+ * of the old contents are unchanged, which is why it must be asked for:
+ * anything rewritten in the middle of the file goes unnoticed.
+ **/
+
+#include "globals.h"
+#include "Checkpoint.h"
+#include <Strsafe.h>
+
+#define CHECKPOINT_MAGIC 0x50434348  // "HCCP"
+#define APPEND_MAGIC     0x41434348  // "HCCA"
+
+typedef struct {
+	DWORD dwMagic;
+	DWORD cbState;
+	ULONGLONG cbFileSize;
+	FILETIME ftLastWrite;
+	// Only for APPEND_MAGIC:
+	FILETIME ftCreation;
+	UINT32 dwHeadPrint;
+	UINT32 dwTailPrint;
+} CHECKPOINTHEADER;
+
+typedef struct {
+	CHECKPOINTHEADER header;
+	BYTE abState[WHEX_MAX_STATE_LENGTH];
+} CHECKPOINTDATA;
+
+// Files at least this long are hashed incrementally; 0 if disabled
+static volatile ULONGLONG g_cbIncrementalMin;
+
+VOID WINAPI CheckpointSetIncremental( ULONGLONG cbMinFileSize )
+{
+	g_cbIncrementalMin = cbMinFileSize;
+}
+
+ULONGLONG WINAPI CheckpointMinFileSize( )
+{
+	ULONGLONG cbIncrementalMin = g_cbIncrementalMin;
+	return((cbIncrementalMin && cbIncrementalMin < CHECKPOINT_MIN_FILE_SIZE) ? cbIncrementalMin : CHECKPOINT_MIN_FILE_SIZE);
+}
+
+// CRC-32 of the cb bytes at ibStart; leaves the file pointer wherever it ends up
+static BOOL WINAPI Fingerprint( HANDLE hFile, ULONGLONG ibStart, DWORD cb, PUINT32 pdwPrint )
+{
+	BYTE abData[CHECKPOINT_FINGERPRINT_SIZE];
+	LARGE_INTEGER liStart;
+	DWORD cbRead;
+
+	liStart.QuadPart = (LONGLONG)ibStart;
+	if (! ( SetFilePointerEx(hFile, liStart, NULL, FILE_BEGIN) &&
+	        ReadFile(hFile, abData, cb, &cbRead, NULL) && cbRead == cb ))
+		return(FALSE);
+
+	*pdwPrint = crc32(0, abData, cb);
+	return(TRUE);
+}
+
+static BOOL WINAPI FingerprintEnds( HANDLE hFile, ULONGLONG cbFileSize, PUINT32 pdwHead, PUINT32 pdwTail )
+{
+	DWORD cb = cbFileSize < CHECKPOINT_FINGERPRINT_SIZE ? (DWORD)cbFileSize : CHECKPOINT_FINGERPRINT_SIZE;
+
+	return(Fingerprint(hFile, 0, cb, pdwHead) && Fingerprint(hFile, cbFileSize - cb, cb, pdwTail));
+}
+
+static BOOL WINAPI ReadCheckpoint( PCTSTR pszPath, CHECKPOINTDATA *pData, DWORD dwMagic )
+{
+	HANDLE hCheckpoint;
+	DWORD cbRead;
+	BOOL bRead;
+
+	hCheckpoint = CreateFile(pszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+	                         FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hCheckpoint == INVALID_HANDLE_VALUE)
+		return(FALSE);
+
+	bRead = ReadFile(hCheckpoint, pData, sizeof(CHECKPOINTDATA), &cbRead, NULL) &&
+	        cbRead >= sizeof(CHECKPOINTHEADER) &&
+	        pData->header.dwMagic == dwMagic &&
+	        pData->header.cbState == cbRead - sizeof(CHECKPOINTHEADER);
+
+	CloseHandle(hCheckpoint);
+	return(bRead);
+}
+
+static VOID WINAPI WriteCheckpoint( PCTSTR pszPath, CHECKPOINTDATA *pData )
+{
+	TCHAR szTemp[MAX_PATH + 4];
+	HANDLE hCheckpoint;
+	DWORD cbData = sizeof(CHECKPOINTHEADER) + pData->header.cbState, cbWritten;
+
+	// Write it alongside, then replace the last one, so that there's always a whole checkpoint
+	StringCchPrintf(szTemp, countof(szTemp), TEXT("%s.tmp"), pszPath);
+	hCheckpoint = CreateFile(szTemp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hCheckpoint != INVALID_HANDLE_VALUE)
+	{
+		BOOL bWritten = WriteFile(hCheckpoint, pData, cbData, &cbWritten, NULL) && cbWritten == cbData;
+		CloseHandle(hCheckpoint);
+
+		if (! (bWritten && MoveFileEx(szTemp, pszPath, MOVEFILE_REPLACE_EXISTING)))
+			DeleteFile(szTemp);
+	}
+}
+
+// %LOCALAPPDATA%\HashCheck\Checkpoints\<volume serial>-<file ID>[-<WHEX_CHECK* flags>]<pszExt>
+static BOOL WINAPI CheckpointPathFromInfo( const BY_HANDLE_FILE_INFORMATION *pbhfi, DWORD dwFlags,
+                                           PCTSTR pszExt, PTSTR pszPath )
+{
+	TCHAR szName[48];
+
+	if ( FAILED(SHGetFolderPath(NULL, CSIDL_LOCAL_APPDATA, NULL, SHGFP_TYPE_CURRENT, pszPath)) ||
+	     ! PathAppend(pszPath, TEXT("HashCheck\\Checkpoints")) )
+		return(FALSE);
+
+	SHCreateDirectoryEx(NULL, pszPath, NULL);  // fails harmlessly if it already exists
+
+	if (dwFlags)
+		StringCchPrintf(szName, countof(szName), TEXT("%08X-%08X%08X-%X%s"), pbhfi->dwVolumeSerialNumber,
+		                pbhfi->nFileIndexHigh, pbhfi->nFileIndexLow, dwFlags, pszExt);
+	else
+		StringCchPrintf(szName, countof(szName), TEXT("%08X-%08X%08X%s"), pbhfi->dwVolumeSerialNumber,
+		                pbhfi->nFileIndexHigh, pbhfi->nFileIndexLow, pszExt);
+	return(PathAppend(pszPath, szName));
+}
+
+BOOL WINAPI CheckpointPath( HANDLE hFile, PCTSTR pszExt, PTSTR pszPath )
+{
+	BY_HANDLE_FILE_INFORMATION bhfi;
+
+	return(GetFileInformationByHandle(hFile, &bhfi) && CheckpointPathFromInfo(&bhfi, 0, pszExt, pszPath));
+}
+
+// dwFlags are the algorithms the file is being hashed with
+BOOL WINAPI CheckpointOpen( PCHECKPOINT pckpt, HANDLE hFile, DWORD dwFlags )
+{
+	BY_HANDLE_FILE_INFORMATION bhfi;
+	ULONGLONG cbIncrementalMin = g_cbIncrementalMin;
+
+	if (! GetFileInformationByHandle(hFile, &bhfi))
+		return(FALSE);
+
+	pckpt->cbFileSize = (ULONGLONG)bhfi.nFileSizeHigh << 32 | bhfi.nFileSizeLow;
+	pckpt->ftCreation = bhfi.ftCreationTime;
+	pckpt->ftLastWrite = bhfi.ftLastWriteTime;
+	pckpt->ullLastSaved = GetTickCount64();
+	pckpt->bIncremental = cbIncrementalMin && pckpt->cbFileSize >= cbIncrementalMin;
+
+	if (pckpt->cbFileSize < CHECKPOINT_MIN_FILE_SIZE && ! pckpt->bIncremental)
+		return(FALSE);
+
+	// <volume serial>-<file ID>-<flags>.hcc (and .hca)
+	if (! CheckpointPathFromInfo(&bhfi, dwFlags, TEXT(".hca"), pckpt->szPath))
+		return(FALSE);
+
+	SSCpy(pckpt->szAppendPath, pckpt->szPath);
+	pckpt->szPath[SSLen(pckpt->szPath) - 1] = TEXT('c');
+	return(TRUE);
+}
+
+BOOL WINAPI CheckpointLoad( PCHECKPOINT pckpt, HANDLE hFile, PWHCTXEX pwhctx, PULONGLONG pcbOffset )
+{
+	CHECKPOINTDATA data;
+	UINT32 dwHeadPrint, dwTailPrint;
+	DWORD cbPrint;
+	LARGE_INTEGER liResumeAt;
+	BOOL bLoaded = FALSE;
+
+	// A resume checkpoint is only good for the file exactly as it was
+	if (ReadCheckpoint(pckpt->szPath, &data, CHECKPOINT_MAGIC))
+	{
+		bLoaded = data.header.cbFileSize == pckpt->cbFileSize &&
+		          CompareFileTime(&data.header.ftLastWrite, &pckpt->ftLastWrite) == 0 &&
+		          WHImportEx(pwhctx, data.abState, data.header.cbState, pcbOffset) &&
+		          *pcbOffset <= pckpt->cbFileSize;
+	}
+
+	// A stale or unusable checkpoint is no use to anyone
+	if (! bLoaded)
+		DeleteFile(pckpt->szPath);
+
+	// Otherwise, the state at the end of the file, if it has only grown since
+	if (! bLoaded && pckpt->bIncremental && ReadCheckpoint(pckpt->szAppendPath, &data, APPEND_MAGIC))
+	{
+		cbPrint = data.header.cbFileSize < CHECKPOINT_FINGERPRINT_SIZE ? (DWORD)data.header.cbFileSize : CHECKPOINT_FINGERPRINT_SIZE;
+		bLoaded = data.header.cbFileSize <= pckpt->cbFileSize &&
+		          CompareFileTime(&data.header.ftCreation, &pckpt->ftCreation) == 0 &&
+		          FingerprintEnds(hFile, data.header.cbFileSize, &dwHeadPrint, &dwTailPrint) &&
+		          dwHeadPrint == data.header.dwHeadPrint && dwTailPrint == data.header.dwTailPrint &&
+		          WHImportEx(pwhctx, data.abState, data.header.cbState, pcbOffset) &&
+		          *pcbOffset == data.header.cbFileSize;
+
+		if (! bLoaded)
+			DeleteFile(pckpt->szAppendPath);
+	}
+
+	// Pick up the reading where the state left off (the fingerprints moved the file pointer)
+	liResumeAt.QuadPart = bLoaded ? (LONGLONG)*pcbOffset : 0;
+	if (! SetFilePointerEx(hFile, liResumeAt, NULL, FILE_BEGIN))
+		bLoaded = FALSE;
+
+	return(bLoaded);
+}
+
+VOID WINAPI CheckpointSave( PCHECKPOINT pckpt, PWHCTXEX pwhctx, ULONGLONG cbOffset, BOOL bIfDue )
+{
+	CHECKPOINTDATA data;
+	UINT cbState;
+
+	if (bIfDue && GetTickCount64() - pckpt->ullLastSaved < CHECKPOINT_INTERVAL_MS)
+		return;
+	pckpt->ullLastSaved = GetTickCount64();
+
+	cbState = WHExportEx(pwhctx, cbOffset, data.abState, sizeof(data.abState));
+	if (cbState == 0 || cbState > sizeof(data.abState))
+		return;
+
+	ZeroMemory(&data.header, sizeof(data.header));
+	data.header.dwMagic = CHECKPOINT_MAGIC;
+	data.header.cbState = cbState;
+	data.header.cbFileSize = pckpt->cbFileSize;
+	data.header.ftLastWrite = pckpt->ftLastWrite;
+	WriteCheckpoint(pckpt->szPath, &data);
+}
+
+VOID WINAPI CheckpointFinish( PCHECKPOINT pckpt, HANDLE hFile, PWHCTXEX pwhctx, ULONGLONG cbOffset )
+{
+	CHECKPOINTDATA data;
+	UINT cbState;
+
+	DeleteFile(pckpt->szPath);
+
+	// Keep the state at the end (before it's finalized) for next time
+	if (! pckpt->bIncremental)
+		return;
+
+	cbState = WHExportEx(pwhctx, cbOffset, data.abState, sizeof(data.abState));
+	if ( cbState && cbState <= sizeof(data.abState) &&
+	     FingerprintEnds(hFile, cbOffset, &data.header.dwHeadPrint, &data.header.dwTailPrint) )
+	{
+		data.header.dwMagic = APPEND_MAGIC;
+		data.header.cbState = cbState;
+		data.header.cbFileSize = cbOffset;
+		data.header.ftLastWrite = pckpt->ftLastWrite;
+		data.header.ftCreation = pckpt->ftCreation;
+		WriteCheckpoint(pckpt->szAppendPath, &data);
+	}
+	else
+	{
+		DeleteFile(pckpt->szAppendPath);
+	}
+}
+
+VOID WINAPI CheckpointDelete( PCHECKPOINT pckpt )
+{
+	DeleteFile(pckpt->szPath);
+	DeleteFile(pckpt->szAppendPath);
+}
@@ -0,0 +1,47 @@
+/**
+ * Checkpoints for resuming the hashing of long files
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ **/
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <windows.h>
+#include "libs/WinHash.h"
+
+// Only files at least this long are checkpointed, at most this often
+#define CHECKPOINT_MIN_FILE_SIZE  0x40000000  // 1 GiB
+#define CHECKPOINT_INTERVAL_MS    30000
+
+// How much of each end of a file is fingerprinted for incremental hashing
+#define CHECKPOINT_FINGERPRINT_SIZE 0x1000
+
+typedef struct {
+	TCHAR szPath[MAX_PATH];        // the resume checkpoint (.hcc)
+	TCHAR szAppendPath[MAX_PATH];  // the state at the end of the file, for incremental hashing (.hca)
+	ULONGLONG cbFileSize;          // the hashed file as it was when opened
+	FILETIME ftCreation;
+	FILETIME ftLastWrite;
+	ULONGLONG ullLastSaved;        // GetTickCount64() when last saved (or opened)
+	BOOL bIncremental;             // also keep the state at the end of the file
+} CHECKPOINT, *PCHECKPOINT;
+
+VOID WINAPI CheckpointSetIncremental( ULONGLONG cbMinFileSize );
+ULONGLONG WINAPI CheckpointMinFileSize( );
+BOOL WINAPI CheckpointPath( HANDLE hFile, PCTSTR pszExt, PTSTR pszPath );
+BOOL WINAPI CheckpointOpen( PCHECKPOINT pckpt, HANDLE hFile, DWORD dwFlags );
+BOOL WINAPI CheckpointLoad( PCHECKPOINT pckpt, HANDLE hFile, PWHCTXEX pwhctx, PULONGLONG pcbOffset );
+VOID WINAPI CheckpointSave( PCHECKPOINT pckpt, PWHCTXEX pwhctx, ULONGLONG cbOffset, BOOL bIfDue );
+VOID WINAPI CheckpointFinish( PCHECKPOINT pckpt, HANDLE hFile, PWHCTXEX pwhctx, ULONGLONG cbOffset );
+VOID WINAPI CheckpointDelete( PCHECKPOINT pckpt );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
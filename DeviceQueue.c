@@ -0,0 +1,294 @@
+/**
+ * Queues of files to hash, one per device
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ *
+ * The files to be hashed can be on several devices at once (a checksum file
+ * listing files on a rotational disk, an NVMe drive and a network share, say),
+ * and what suits one of them doesn't suit the others: a rotational disk reads
+ * fastest one file at a time, while an SSD is best kept busy with as many as
+ * the CPU can hash, and a network share with more still, to hide its latency.
+ * So the files are grouped by device (physical drive, or share), keeping their
+ * order within each, into a queue apiece, which is given its own number of
+ * file-hashing threads, and all of those threads share the one scheduler.
+ * Each of them hashes what it reads, though, so together they're held to as
+ * many as the calibration allows to hash at once (as for an SSD on its own),
+ * every queue keeping at least one; the deepest queues give threads up first.
+ *
+ * A rotational disk's files are also put in the order of their data on it,
+ * so that its one thread sweeps across the platters rather than seeking back
+ * and forth in the order the files were listed in; it's up to the caller to
+ * report the results in the original order.  That takes an open per file
+ * before any of them is hashed, so the caller treats it as part of its prep,
+ * and it stops as soon as the user cancels.
+ **/
+
+#include "globals.h"
+#include "HashCheckCommon.h"
+#include "DeviceQueue.h"
+#include "IsSSD.h"
+
+// How many files on a device of class uClass to hash at once, with the algorithms in dwFlags
+UINT WINAPI DeviceDepth( DWORD dwFlags, UINT uClass )
+{
+	switch (uClass)
+	{
+		case DEVICE_CLASS_SSD:     return(WHTuningFileWorkers(dwFlags, TRUE));
+		case DEVICE_CLASS_REMOTE:  return(max(WHTuningFileWorkers(dwFlags, TRUE), DEVICE_REMOTE_DEPTH));
+		default:                   return(WHTuningFileWorkers(dwFlags, FALSE));
+	}
+}
+
+// How many of a queue's cItems files on a device of class uClass to hash as a batch (0: one at
+// a time); a batch fills the multi-buffer kernels' SIMD lanes, if the algorithms have them, and
+// also has its files' reads in flight together, which only pays on a hard disk or share
+static UINT DeviceLanes( DWORD dwFlags, UINT uClass, SIZE_T cItems )
+{
+	UINT cLanes = WHMultiLanes(dwFlags);
+
+	if (cItems < 2)
+		return(0);
+
+	if (uClass != DEVICE_CLASS_SSD && cLanes < BATCH_IO_LANES)
+		cLanes = BATCH_IO_LANES;
+
+	return(cLanes > 1 ? cLanes : 0);
+}
+
+// A file's place on its volume, for putting a rotational disk's files in the order of their data
+typedef struct {
+	DWORD              dwVolume;     // the volume's serial number (0: the file can't be opened)
+	BOOL               bMapped;      // ullLocation is the first cluster of its data, not its file ID
+	ULONGLONG          ullLocation;
+	SIZE_T             iItem;
+} ITEMLOCATION, *PITEMLOCATION;
+
+// Finds where the file's data starts on its volume or, if it has none of its own (such as
+// a small file on NTFS, which lives in its MFT record) or that can't be told, its file ID
+// (whose low 48 bits are, on NTFS, the number of that record, so roughly where it lies)
+static VOID WINAPI LocateItem( PCTSTR pszPath, PITEMLOCATION pil )
+{
+	HANDLE hFile = CreateFile(pszPath, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                          NULL, OPEN_EXISTING, 0, NULL);
+	BY_HANDLE_FILE_INFORMATION bhfi;
+	STARTING_VCN_INPUT_BUFFER svib;
+	RETRIEVAL_POINTERS_BUFFER rpb;  // room for just the first extent
+	DWORD cbReturned;
+
+	pil->dwVolume = 0;
+	pil->bMapped = FALSE;
+	pil->ullLocation = 0;
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	if (GetFileInformationByHandle(hFile, &bhfi))
+	{
+		pil->dwVolume = bhfi.dwVolumeSerialNumber;
+		pil->ullLocation = ((ULONGLONG)bhfi.nFileIndexHigh << 32 | bhfi.nFileIndexLow) & 0xFFFFFFFFFFFF;
+	}
+
+	svib.StartingVcn.QuadPart = 0;
+	if ( (DeviceIoControl(hFile, FSCTL_GET_RETRIEVAL_POINTERS, &svib, sizeof(svib), &rpb, sizeof(rpb), &cbReturned, NULL) ||
+	      GetLastError() == ERROR_MORE_DATA) &&
+	     rpb.ExtentCount && rpb.Extents[0].Lcn.QuadPart >= 0 )  // (an LCN of -1 is a sparse run)
+	{
+		pil->bMapped = TRUE;
+		pil->ullLocation = rpb.Extents[0].Lcn.QuadPart;
+	}
+
+	CloseHandle(hFile);
+}
+
+static int __cdecl CompareItemLocations( const void *pv1, const void *pv2 )
+{
+	PITEMLOCATION pil1 = (PITEMLOCATION)pv1, pil2 = (PITEMLOCATION)pv2;
+
+	if (pil1->dwVolume != pil2->dwVolume)
+		return(pil1->dwVolume < pil2->dwVolume ? -1 : 1);
+	if (pil1->bMapped != pil2->bMapped)
+		return(pil1->bMapped ? 1 : -1);
+	if (pil1->ullLocation != pil2->ullLocation)
+		return(pil1->ullLocation < pil2->ullLocation ? -1 : 1);
+	return(pil1->iItem < pil2->iItem ? -1 : pil1->iItem > pil2->iItem);
+}
+
+// Puts the queue's items in the order of their data on the disk; returns FALSE (leaving
+// them as they were) if there's no memory to, they already were, or the user cancels
+static BOOL WINAPI SortByLocation( PCOMMONCONTEXT pcmnctx, PDEVICEQUEUE pdq, PFNITEMPATH pfnPath,
+                                   PVOID pvContext, PTSTR pszPath )
+{
+	PITEMLOCATION pLocations = (PITEMLOCATION)malloc(pdq->cItems * sizeof(ITEMLOCATION));
+	BOOL bReordered = FALSE;
+	SIZE_T i;
+
+	if (pLocations == NULL)
+		return(FALSE);
+
+	for (i = 0; i < pdq->cItems; ++i)
+	{
+		if (pcmnctx->status == CANCEL_REQUESTED)
+		{
+			free(pLocations);
+			return(FALSE);
+		}
+
+		pfnPath(pvContext, pdq->piItems[i], pszPath);
+		LocateItem(pszPath, &pLocations[i]);
+		pLocations[i].iItem = pdq->piItems[i];
+	}
+
+	qsort(pLocations, pdq->cItems, sizeof(ITEMLOCATION), CompareItemLocations);
+
+	for (i = 0; i < pdq->cItems; ++i)
+	{
+		bReordered |= pdq->piItems[i] != pLocations[i].iItem;
+		pdq->piItems[i] = pLocations[i].iItem;
+	}
+
+	free(pLocations);
+	return(bReordered);
+}
+
+// Finds the device of each item (looking it up just once for every run of items in the same
+// directory), and queues the items by device (a rotational disk's, in the order of their data
+// on it, in which case bReordered is set), each with its depth and batch size for hashing with
+// the algorithms in dwFlags (no queue having more threads than batches); returns NULL if
+// there's no memory, or if the user cancels meanwhile
+PDEVICEQUEUES WINAPI DeviceQueuesCreate( PCOMMONCONTEXT pcmnctx, SIZE_T cItems, PFNITEMPATH pfnPath,
+                                         PVOID pvContext, DWORD dwFlags )
+{
+	PDEVICEQUEUES pdqs = (PDEVICEQUEUES)calloc(1, sizeof(DEVICEQUEUES));
+	PUINT piQueues = (PUINT)malloc(cItems * sizeof(UINT) + 1);
+	PTSTR pszPath = (PTSTR)malloc(MAX_PATH_BUFFER * sizeof(TCHAR) * 2);
+	PTSTR pszLastDir = pszPath + MAX_PATH_BUFFER;
+	SIZE_T cchLastDir = (SIZE_T)-1, i;
+	UINT iQueue = 0, cAlloc = 0, cMaxWorkers;
+
+	if (! (pdqs && piQueues && pszPath && (pdqs->piItems = (PSIZE_T)malloc(cItems * sizeof(SIZE_T) + 1))))
+		goto cleanup_failed;
+
+	for (i = 0; i < cItems; ++i)
+	{
+		PTSTR pszTail;
+		SIZE_T cchDir;
+		DWORD dwDeviceID;
+		UINT uClass;
+
+		pfnPath(pvContext, i, pszPath);
+		pszTail = StrRChr(pszPath, NULL, TEXT('\\'));
+		cchDir = pszTail ? pszTail - pszPath : 0;
+
+		if (cchDir != cchLastDir || StrCmpNI(pszPath, pszLastDir, (int)cchDir))
+		{
+			if (pcmnctx->status == CANCEL_REQUESTED)
+				goto cleanup_failed;
+
+			uClass = GetDeviceClass(pszPath, &dwDeviceID);
+
+			for (iQueue = 0; iQueue < pdqs->cQueues && pdqs->pQueues[iQueue].dwDeviceID != dwDeviceID; ++iQueue);
+
+			if (iQueue == pdqs->cQueues)
+			{
+				if (pdqs->cQueues == cAlloc)
+				{
+					PDEVICEQUEUE pQueues = (PDEVICEQUEUE)realloc(pdqs->pQueues, (cAlloc += 4) * sizeof(DEVICEQUEUE));
+					if (pQueues == NULL)
+						goto cleanup_failed;
+					pdqs->pQueues = pQueues;
+				}
+
+				ZeroMemory(&pdqs->pQueues[iQueue], sizeof(DEVICEQUEUE));
+				pdqs->pQueues[iQueue].dwDeviceID = dwDeviceID;
+				pdqs->pQueues[iQueue].uClass = uClass;
+				++pdqs->cQueues;
+			}
+
+			SSChainNCpy(pszLastDir, pszPath, cchDir);
+			cchLastDir = cchDir;
+		}
+
+		piQueues[i] = iQueue;
+		++pdqs->pQueues[iQueue].cItems;
+	}
+
+	// Lay the queues' items out one queue after another, and give each its batch size and depth
+	for (iQueue = 0, i = 0; iQueue < pdqs->cQueues; ++iQueue)
+	{
+		PDEVICEQUEUE pdq = &pdqs->pQueues[iQueue];
+		UINT cPerTake = (pdq->cLanes = DeviceLanes(dwFlags, pdq->uClass, pdq->cItems)) ? pdq->cLanes : 1;
+		SIZE_T cTakes = (pdq->cItems + cPerTake - 1) / cPerTake;
+
+		pdq->piItems = pdqs->piItems + i;
+		i += pdq->cItems;
+		pdq->cItems = 0;
+		pdq->cDepth = (UINT)max(min(DeviceDepth(dwFlags, pdq->uClass), cTakes), 1);
+		pdqs->cWorkers += pdq->cDepth;
+	}
+
+	// Keep the hashing within what the calibration allows for, however many devices there are
+	cMaxWorkers = max(WHTuningFileWorkers(dwFlags, TRUE), pdqs->cQueues);
+	while (pdqs->cWorkers > cMaxWorkers)
+	{
+		PDEVICEQUEUE pdqDeepest = pdqs->pQueues;
+
+		for (iQueue = 1; iQueue < pdqs->cQueues; ++iQueue)
+		{
+			if (pdqs->pQueues[iQueue].cDepth > pdqDeepest->cDepth)
+				pdqDeepest = &pdqs->pQueues[iQueue];
+		}
+
+		--pdqDeepest->cDepth;
+		--pdqs->cWorkers;
+	}
+
+	for (i = 0; i < cItems; ++i)
+	{
+		PDEVICEQUEUE pdq = &pdqs->pQueues[piQueues[i]];
+		pdq->piItems[pdq->cItems++] = i;
+	}
+
+	for (iQueue = 0; iQueue < pdqs->cQueues; ++iQueue)
+	{
+		PDEVICEQUEUE pdq = &pdqs->pQueues[iQueue];
+		if ( pdq->uClass == DEVICE_CLASS_HDD && pdq->cItems >= DEVICE_SORT_MIN_ITEMS &&
+		     SortByLocation(pcmnctx, pdq, pfnPath, pvContext, pszPath) )
+			pdqs->bReordered = TRUE;
+	}
+
+	if (pcmnctx->status == CANCEL_REQUESTED)
+		goto cleanup_failed;
+
+	free(pszPath);
+	free(piQueues);
+	return(pdqs);
+
+cleanup_failed:
+	free(pszPath);
+	free(piQueues);
+	DeviceQueuesFree(pdqs);
+	return(NULL);
+}
+
+// Takes up to cWanted of the queue's items, from any thread; returns how many were taken,
+// and where in piItems the first of them is
+UINT WINAPI DeviceQueueTake( PDEVICEQUEUE pdq, UINT cWanted, PSIZE_T piFirst )
+{
+	SIZE_T iFirst = (SIZE_T)(ULONG)InterlockedExchangeAdd(&pdq->iNext, (LONG)cWanted);
+
+	if (iFirst >= pdq->cItems)
+		return(0);
+
+	*piFirst = iFirst;
+	return((UINT)min(cWanted, pdq->cItems - iFirst));
+}
+
+VOID WINAPI DeviceQueuesFree( PDEVICEQUEUES pdqs )
+{
+	if (pdqs == NULL)
+		return;
+
+	free(pdqs->piItems);
+	free(pdqs->pQueues);
+	free(pdqs);
+}
@@ -0,0 +1,55 @@
+/**
+ * Queues of files to hash, one per device
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ **/
+
+#ifndef __DEVICEQUEUE_H__
+#define __DEVICEQUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <windows.h>
+#include "HashCheckCommon.h"
+
+// A network share is latency-bound rather than CPU- or seek-bound, so it gets at least this
+// many files hashed at once
+#define DEVICE_REMOTE_DEPTH  8
+
+// A rotational disk's files are only put in the order of their data on it if there are at
+// least this many, since finding where each one lies costs an open of its own
+#define DEVICE_SORT_MIN_ITEMS  32
+
+typedef struct {
+	DWORD              dwDeviceID;   // as from GetDeviceClass
+	UINT               uClass;       // DEVICE_CLASS_*
+	UINT               cDepth;       // how many of its files are hashed at once (at least 1)
+	UINT               cLanes;       // how many files each take hashes as a batch (0: one at a time)
+	SIZE_T             cItems;
+	PSIZE_T            piItems;      // its items' indices, in their original order (or, on a
+	                                 // rotational disk, in that of their data on it)
+	volatile LONG      iNext;        // the position in piItems of the next to be taken
+} DEVICEQUEUE, *PDEVICEQUEUE;
+
+typedef struct {
+	UINT               cQueues;
+	UINT               cWorkers;     // the sum of the queues' depths (at most WHTuningFileWorkers's
+	                                 // for an SSD, or one per queue if there are more queues)
+	PDEVICEQUEUE       pQueues;
+	PSIZE_T            piItems;      // every queue's items, one queue after another
+	BOOL               bReordered;   // some queue's items aren't in their original order
+} DEVICEQUEUES, *PDEVICEQUEUES;
+
+UINT WINAPI DeviceDepth( DWORD dwFlags, UINT uClass );
+PDEVICEQUEUES WINAPI DeviceQueuesCreate( PCOMMONCONTEXT pcmnctx, SIZE_T cItems, PFNITEMPATH pfnPath,
+                                         PVOID pvContext, DWORD dwFlags );
+UINT WINAPI DeviceQueueTake( PDEVICEQUEUE pdq, UINT cWanted, PSIZE_T piFirst );
+VOID WINAPI DeviceQueuesFree( PDEVICEQUEUES pdqs );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -125,13 +125,15 @@ BOOL WINAPI HashCalcPrepare( PHASHCALCCONTEXT phcctx )
 			}
 			else
 			{
-				PHASHCALCITEM pItem = SLAddItem(phcctx->hList, NULL, sizeof(HASHCALCITEM) + cbCurrent);
+				PHASHCALCITEM pItem = SLAddItem(phcctx->hList, NULL, HASHCALCITEM_RESULTS_OFFSET(cchCurrent) +
+				                                                      WHResultSize(phcctx->dwResultSlots));
 
 				if (pItem)
 				{
-                    pItem->results.dwFlags = 0;
 					pItem->cchPath = cchCurrent;
 					memcpy(pItem->szPath, pszCurrent, cbCurrent);
+					HashCalcItemResults(pItem)->dwFlags = 0;
+					HashCalcItemResults(pItem)->dwSlots = phcctx->dwResultSlots;
 
 					if (phcctx->cchMax < cchCurrent)
 						phcctx->cchMax = cchCurrent;
@@ -190,13 +192,15 @@ VOID WINAPI HashCalcWalkDirectory( PHASHCALCCONTEXT phcctx, PTSTR pszPath, UINT
 			{
 				// File: Add to the list
 				UINT cbPathBuffer = (cchNew + 1) * sizeof(TCHAR);
-				PHASHCALCITEM pItem = SLAddItem(phcctx->hList, NULL, sizeof(HASHCALCITEM) + cbPathBuffer);
+				PHASHCALCITEM pItem = SLAddItem(phcctx->hList, NULL, HASHCALCITEM_RESULTS_OFFSET(cchNew) +
+				                                                      WHResultSize(phcctx->dwResultSlots));
 
 				if (pItem)
 				{
-                    pItem->results.dwFlags = 0;
 					pItem->cchPath = cchNew;
 					memcpy(pItem->szPath, pszPath, cbPathBuffer);
+					HashCalcItemResults(pItem)->dwFlags = 0;
+					HashCalcItemResults(pItem)->dwSlots = phcctx->dwResultSlots;
 
 					if (phcctx->cchMax < cchNew)
 						phcctx->cchMax = cchNew;
@@ -256,7 +260,7 @@ VOID WINAPI HashCalcInitSave( PHASHCALCCONTEXT phcctx )
 	phcctx->hFileOut = INVALID_HANDLE_VALUE;
 
 	// Load settings
-	phcctx->opt.dwFlags = HCOF_FILTERINDEX | HCOF_SAVEENCODING;
+	phcctx->opt.dwFlags = HCOF_FILTERINDEX | HCOF_SAVEENCODING | HCOF_TUNING;
 	OptionsLoad(&phcctx->opt);
 
 	// Initialize the struct for the first time, if needed
@@ -383,9 +387,11 @@ VOID WINAPI HashCalcSetSaveFormat( PHASHCALCCONTEXT phcctx )
 	}
 }
 
-BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem )
+// Writes the item's line, followed by its block list if there is one (all in one write,
+// so that lines written by other threads don't get between them)
+BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem, PCBLOCKLIST pBlocks )
 {
-	PCTSTR pszHash;                     // will be pointed to the hash name
+	TCHAR szHash[MAX_DIGEST_STRING_LENGTH]; // the hash, in hex
     WCHAR szWbuffer[MAX_PATH_BUFFER];   // wide-char buffer
     CHAR  szAbuffer[MAX_PATH_BUFFER];   // narrow-char buffer
 #ifdef UNICODE
@@ -397,10 +403,11 @@ BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem )
     size_t cchLine = MAX_PATH_BUFFER;   // starts off as count of remaining TCHARS in the buffer
     PVOID pvLine;                       // will be pointed to the buffer to write out
     size_t cbLine;                      // will be line length in bytes, EXCLUDING nul terminator
+    PBYTE pbWithBlocks = NULL;          // the line followed by the block list, if any
     BOOL bRetval = TRUE;
 
 	// If the checksum to save isn't present in the results
-    if (! ((1 << (phcctx->ofn.nFilterIndex - 1)) & pItem->results.dwFlags))
+    if (! ((1 << (phcctx->ofn.nFilterIndex - 1)) & HashCalcItemResults(pItem)->dwFlags))
     {
         // Start with a commented-out error message - "; UNREADABLE:"
         WCHAR szUnreadable[MAX_STRINGRES];
@@ -408,24 +415,18 @@ BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem )
         StringCchPrintfEx(szTbufferAppend, cchLine, &szTbufferAppend, &cchLine, 0, TEXT("; %s:\r\n"), szUnreadable);
 
         // We'll still output a hash, but it will be all 0's, that way Verify will indicate an mismatch
-        HashCalcClearInvalid(&pItem->results, TEXT('0'));
         bRetval = FALSE;
     }
 
-	// Translate the filter index to a hash
-	switch (phcctx->ofn.nFilterIndex)
-	{
-#define HASH_INDEX_TO_RESULTS_op(alg) \
-        case alg:  pszHash = pItem->results.szHex##alg;  break;
-        FOR_EACH_HASH(HASH_INDEX_TO_RESULTS_op)
-		default: return(FALSE);
-	}
+	// Format the hash (the digests are kept in binary until they are written)
+	if (! HashCalcResultToHex(HashCalcItemResults(pItem), phcctx->ofn.nFilterIndex, szHash, TEXT('0')))
+		return(FALSE);
 
 	// Format the line
 	#define HashCalcFormat(a, b) StringCchPrintfEx(szTbufferAppend, cchLine, &szTbufferAppend, &cchLine, 0, phcctx->szFormat, a, b)
 	(phcctx->ofn.nFilterIndex == 1) ?
-		HashCalcFormat(pItem->szPath + phcctx->cchAdjusted, pszHash) : // SFV
-		HashCalcFormat(pszHash, pItem->szPath + phcctx->cchAdjusted);  // everything else
+		HashCalcFormat(pItem->szPath + phcctx->cchAdjusted, szHash) : // SFV
+		HashCalcFormat(szHash, pItem->szPath + phcctx->cchAdjusted);  // everything else
 	#undef HashCalcFormat
 
 #ifdef _TIMED
@@ -484,7 +485,23 @@ BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem )
 		if (cbLine > 0)
 		{
 			INT cbWritten;
+
+			if (pBlocks && pBlocks->cBlocks && bRetval)
+			{
+				BOOL bWide = phcctx->opt.dwSaveEncoding == 1;
+				size_t cbBlocks = BlockListFormat(pBlocks, NULL, bWide);
+
+				if (pbWithBlocks = (PBYTE)malloc(cbLine + cbBlocks))
+				{
+					memcpy(pbWithBlocks, pvLine, cbLine);
+					BlockListFormat(pBlocks, pbWithBlocks + cbLine, bWide);
+					pvLine = pbWithBlocks;
+					cbLine += cbBlocks;
+				}
+			}
+
 			WriteFile(phcctx->hFileOut, pvLine, (DWORD)cbLine, &cbWritten, NULL);
+			free(pbWithBlocks);
 			if (cbLine != cbWritten) return(FALSE);
 		}
 		else return(FALSE);
@@ -494,21 +511,29 @@ BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem )
 	return(bRetval);
 }
 
-VOID WINAPI HashCalcClearInvalid( PWHRESULTEX pwhres, WCHAR cInvalid )
+// Formats the uAlg digest of pwhres into pszDest or, if it's not present, fills
+// in that many cInvalid characters; returns NULL only if uAlg isn't valid
+PTSTR WINAPI HashCalcResultToHex( PCWHRESULTEX pwhres, UINT uAlg, PTSTR pszDest, TCHAR cInvalid )
 {
-#ifdef UNICODE
-#   define _tmemset wmemset
-#else
-#   define _tmemset memset
-#endif
+    PTSTR pszEnd = WHResultToHex(pwhres, uAlg, pszDest);
+    UINT cchHex;
 
-#define HASH_CLEAR_INVALID_op(alg)                                                \
-    if (! (pwhres->dwFlags & WHEX_CHECK##alg))                                    \
-    {                                                                             \
-        _tmemset(pwhres->szHex##alg, cInvalid, countof(pwhres->szHex##alg) - 1);  \
-        pwhres->szHex##alg[countof(pwhres->szHex##alg) - 1] = L'\0';              \
-    }
-    FOR_EACH_HASH(HASH_CLEAR_INVALID_op)
+    if (pszEnd)
+        return(pszEnd);
+
+	switch (uAlg)
+	{
+#define HASH_INVALID_LENGTH_op(alg) \
+        case alg:  cchHex = alg##_DIGEST_LENGTH * 2;  break;
+        FOR_EACH_HASH(HASH_INVALID_LENGTH_op)
+		default: return(NULL);
+	}
+
+    for (pszEnd = pszDest; cchHex; --cchHex)
+        *pszEnd++ = cInvalid;
+    *pszEnd = TEXT('\0');
+
+    return(pszEnd);
 }
 
 // This can only succeed on Windows Vista and later;
@@ -636,24 +661,5 @@ VOID WINAPI HashCalcSetSavePrefix( PHASHCALCCONTEXT phcctx, PTSTR pszSave )
 
 VOID WINAPI HashCalcTogglePrep( PHASHCALCCONTEXT phcctx, BOOL bState )
 {
-	DWORD dwStyle = (DWORD)GetWindowLongPtr(phcctx->hWndPBTotal, GWL_STYLE);
-
-	if (bState)
-	{
-		dwStyle &= ~PBS_SMOOTH;
-		dwStyle |= PBS_MARQUEE;
-		phcctx->dwFlags |= HCF_MARQUEE;
-	}
-	else
-	{
-		dwStyle |= PBS_SMOOTH;
-		dwStyle &= ~PBS_MARQUEE;
-		phcctx->dwFlags &= ~HCF_MARQUEE;
-	}
-
-	SetWindowLongPtr(phcctx->hWndPBTotal, GWL_STYLE, dwStyle);
-	SendMessage(phcctx->hWndPBTotal, PBM_SETMARQUEE, bState, MARQUEE_INTERVAL);
-
-	if (!bState)
-		SendMessage(phcctx->hWndPBTotal, PBM_SETRANGE32, 0, phcctx->cTotal);
+	SetProgressBarMarquee((PCOMMONCONTEXT)phcctx, bState, phcctx->cTotal);
 }
@@ -18,6 +18,7 @@ extern "C" {
 #include <windows.h>
 #include "HashCheckOptions.h"
 #include "libs/WinHash.h"
+#include "BlockList.h"
 
 /**
  * Much of what is in the HashCalc module used to reside within HashProp; with
@@ -79,6 +80,7 @@ typedef struct {
 	UINT               cchAdjusted;  // cchPrefix, adjusted for the path of the output file
 	UINT               cTotal;       // total number of files
 	UINT               cSuccess;     // total number of successfully hashed
+	DWORD              dwResultSlots;// WHEX_CHECK* flags of the digests each item has room for
 #ifdef _TIMED
 	DWORD              dwElapsed;    // time in ms taken to compute hashes of all files
 #endif
@@ -89,10 +91,10 @@ typedef struct {
 	HASHCALCSCRATCH    scratch;      // scratch buffers
 } HASHCALCCONTEXT, *PHASHCALCCONTEXT;
 
-// Per-file data
+// Per-file data; the item's WHRESULTEX, with room for just the digests in
+// dwResultSlots, follows the path (see HashCalcItemResults)
 typedef struct {
 	UINT cchPath;                    // length of path in characters, not including NULL
-	WHRESULTEX results;              // hash results
 #ifdef _TIMED
 	DWORD dwElapsed;                 // time in ms taken to compute all hashes of one file
 #endif
@@ -100,12 +102,17 @@ typedef struct {
 	TCHAR szPath[];                  // unaltered path
 } HASHCALCITEM, *PHASHCALCITEM;
 
+#define HASHCALCITEM_RESULTS_OFFSET(cchPath) \
+	((sizeof(HASHCALCITEM) + ((cchPath) + 1) * sizeof(TCHAR) + sizeof(DWORD) - 1) & ~(sizeof(DWORD) - 1))
+#define HashCalcItemResults(pItem) \
+	((PWHRESULTEX)((PBYTE)(pItem) + HASHCALCITEM_RESULTS_OFFSET((pItem)->cchPath)))
+
 // Public functions
 BOOL WINAPI HashCalcPrepare( PHASHCALCCONTEXT phcctx );
 VOID WINAPI HashCalcInitSave( PHASHCALCCONTEXT phcctx );
 VOID WINAPI HashCalcSetSaveFormat( PHASHCALCCONTEXT phcctx );
-BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem );
-VOID WINAPI HashCalcClearInvalid( PWHRESULTEX pwhres, WCHAR cInvalid );
+BOOL WINAPI HashCalcWriteResult( PHASHCALCCONTEXT phcctx, PHASHCALCITEM pItem, PCBLOCKLIST pBlocks );
+PTSTR WINAPI HashCalcResultToHex( PCWHRESULTEX pwhres, UINT uAlg, PTSTR pszDest, TCHAR cInvalid );
 BOOL WINAPI HashCalcDeleteFileByHandle( HANDLE hFile );
 VOID WINAPI HashCalcTogglePrep( PHASHCALCCONTEXT phcctx, BOOL bState );
 
@@ -180,7 +180,7 @@ STDAPI DllRegisterServerEx( LPCTSTR lpszModuleName )
 		RegCloseKey(hKey);
 	} else return(SELFREG_E_CLASS);
 
-	// The actual association of .sfv/.md5/.sha1/.sha256/.sha512/.sha3-256/.sha3-512/.asc files with our program ID
+	// The actual association of .sfv/.md5/.sha1/.sha256/.sha512/.sha3-256/.sha3-512/.blake3/.xxh128/.crc32c/.sha512-256/.asc files with our program ID
 	// will be handled by DllInstall, not DllRegisterServer.
 
 	// Register approval
@@ -12,10 +12,36 @@
 #include "globals.h"
 #include "HashCheckCommon.h"
 #include "GetHighMSB.h"
+#include "IsSSD.h"
+#include "Checkpoint.h"
+#include "DeviceQueue.h"
 #include <Strsafe.h>
 
 #define PROGRESS_BAR_STEPS 300
 
+// A large file for which only CRC-32 is needed can be hashed as several
+// ranges in parallel; each range is at least this big, and there are at most
+// this many of them
+#define CRC32_RANGE_MIN_SIZE  (READ_BUFFER_SIZE * 64)
+#define CRC32_RANGES_MAX      16
+
+// At most this many threads check the blocks of a file with a block list
+#define BLOCK_CHECKERS_MAX    16
+
+// A file hashed from a mapped view is mapped this much at a time, at an offset
+// that is a multiple of the allocation granularity (64K on every Windows)
+#define MAPPED_WINDOW_SIZE    0x4000000
+#define MAPPED_WINDOW_ALIGN   0x10000
+#define MAPPED_PAGE_SIZE      0x1000
+
+// Files at least this long on a local SSD are hashed from a mapped view; 0 if disabled
+static volatile ULONGLONG g_cbMappedMin;
+
+// Files at least this long are read unbuffered; 0 if disabled
+static volatile ULONGLONG g_cbUnbufferedMin;
+
+#define FILE_SHARE_ALL  (FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE)
+
 HANDLE __fastcall CreateThreadCRT( PVOID pThreadProc, PVOID pvParam )
 {
 	if (!pThreadProc)
@@ -51,7 +77,7 @@ HANDLE __fastcall OpenFileForReading( PCTSTR pszPath )
 	return(CreateFile(
 		pszPath,
 		GENERIC_READ,
-		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		FILE_SHARE_ALL,
 		NULL,
 		OPEN_EXISTING,
 		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
@@ -59,6 +85,36 @@ HANDLE __fastcall OpenFileForReading( PCTSTR pszPath )
 	));
 }
 
+// If bUnbuffered, opens the file bypassing the system file cache (so that reading
+// a huge file doesn't flush everything else out of it), or, if it can't be, as
+// usual; an unbuffered read must be of whole sectors, at a sector-aligned offset
+// into a sector-aligned buffer, which reads of READ_BUFFER_SIZE (a multiple of any
+// sector size) at multiples of it into page-aligned buffers are, except that the
+// last read of a file just comes up short
+HANDLE __fastcall OpenFileForReadingEx( PCTSTR pszPath, BOOL bUnbuffered )
+{
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+
+	if (bUnbuffered)
+	{
+		hFile = CreateFile(pszPath, GENERIC_READ, FILE_SHARE_ALL, NULL, OPEN_EXISTING,
+		                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_NO_BUFFERING, NULL);
+	}
+
+	return((hFile != INVALID_HANDLE_VALUE) ? hFile : OpenFileForReading(pszPath));
+}
+
+VOID WINAPI SetUnbufferedMinFileSize( ULONGLONG cbMinFileSize )
+{
+	g_cbUnbufferedMin = cbMinFileSize;
+}
+
+__inline BOOL IsUnbuffered( ULONGLONG cbFileSize )
+{
+	ULONGLONG cbUnbufferedMin = g_cbUnbufferedMin;
+	return(cbUnbufferedMin && cbFileSize >= cbUnbufferedMin);
+}
+
 VOID __fastcall HCNormalizeString( PTSTR psz )
 {
 	if (!psz) return;
@@ -121,6 +177,30 @@ VOID WINAPI FormatFractionalResults( PTSTR pszFormat, PTSTR pszBuffer, UINT uPar
 		StringCchPrintf(pszBuffer, MAX_STRINGMSG, pszFormat + 1, uTotal, uPart);
 }
 
+VOID WINAPI SetProgressBarMarquee( PCOMMONCONTEXT pcmnctx, BOOL bState, UINT cTotal )
+{
+	DWORD dwStyle = (DWORD)GetWindowLongPtr(pcmnctx->hWndPBTotal, GWL_STYLE);
+
+	if (bState)
+	{
+		dwStyle &= ~PBS_SMOOTH;
+		dwStyle |= PBS_MARQUEE;
+		pcmnctx->dwFlags |= HCF_MARQUEE;
+	}
+	else
+	{
+		dwStyle |= PBS_SMOOTH;
+		dwStyle &= ~PBS_MARQUEE;
+		pcmnctx->dwFlags &= ~HCF_MARQUEE;
+	}
+
+	SetWindowLongPtr(pcmnctx->hWndPBTotal, GWL_STYLE, dwStyle);
+	SendMessage(pcmnctx->hWndPBTotal, PBM_SETMARQUEE, bState, MARQUEE_INTERVAL);
+
+	if (!bState)
+		SendMessage(pcmnctx->hWndPBTotal, PBM_SETRANGE32, 0, cTotal);
+}
+
 VOID WINAPI SetProgressBarPause( PCOMMONCONTEXT pcmnctx, WPARAM iState )
 {
 	// For Windows Classic, we can change the color to indicate a pause
@@ -265,6 +345,31 @@ DWORD WINAPI WorkerThreadStartup( PCOMMONCONTEXT pcmnctx )
 	return(0);
 }
 
+PBYTE WINAPI AllocWorkerBuffer( )
+{
+	// The zero-filled memory doubles as the initial state of the hash contexts
+	return((PBYTE)VirtualAlloc(NULL, WORKER_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE));
+}
+
+VOID WINAPI FreeWorkerBuffer( PVOID pbBuffer )
+{
+	UINT i;
+
+	for (i = 0; i < WHEX_MAX_LANES; ++i)
+		WHFreeEx(WorkerBufferContext(pbBuffer) + i);
+	BlockListFree(WorkerBufferBlockList(pbBuffer));
+	VirtualFree(pbBuffer, 0, MEM_RELEASE);
+}
+
+// Returns a pipeline for hashing large files with a thread per algorithm, or NULL
+// unless the calibration predicts that it would beat WHUpdateEx with these
+// algorithms: not with only one, nor without cores to spare, nor where
+// WHUpdateEx already fans each read out to them all
+PWHPIPELINE WINAPI CreateWorkerPipeline( DWORD dwFlags )
+{
+	return(WHTuningPipeline(dwFlags, READ_BUFFER_SIZE) ? WHPipelineCreate(READ_BUFFER_SIZE) : NULL);
+}
+
 // Post messages to update the progress bar. If there are multiple file-hashing threads,
 // then only the thread currently operating on the largest file updates the progress bar.
 __inline VOID UpdateProgressBar( HWND hWndPBFile, PCRITICAL_SECTION pCritSec,
@@ -332,9 +437,343 @@ __inline VOID UpdateProgressBar( HWND hWndPBFile, PCRITICAL_SECTION pCritSec,
     }
 }
 
-VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
+#ifdef USE_PPL
+
+// One range of a file whose CRC-32 is being calculated in parallel
+typedef struct {
+	PCOMMONCONTEXT     pcmnctx;      // context of the owning worker thread
+	PCTSTR             pszPath;      // file to read
+	ULONGLONG          ibStart;      // offset of the range within the file
+	ULONGLONG          cbRange;      // length of the range
+	BOOL               bUnbuffered;  // read it bypassing the file cache?
+	volatile LONGLONG* pcbDone;      // bytes hashed so far, across all ranges
+	UINT32             crc;          // CRC-32 of the range, valid iff bCompleted
+	BOOL               bCompleted;   // TRUE if the entire range was read
+} CRC32RANGE, *PCRC32RANGE;
+
+__inline UINT CountCRC32Ranges( ULONGLONG cbFileSize )
+{
+	SYSTEM_INFO si;
+	ULONGLONG cRanges = cbFileSize / CRC32_RANGE_MIN_SIZE;
+
+	GetSystemInfo(&si);
+
+	if (cRanges > si.dwNumberOfProcessors)
+		cRanges = si.dwNumberOfProcessors;
+	if (cRanges > CRC32_RANGES_MAX)
+		cRanges = CRC32_RANGES_MAX;
+
+	return((UINT)cRanges);
+}
+
+DWORD WINAPI HashRangeCRC32( PCRC32RANGE pRange )
+{
+	PCOMMONCONTEXT pcmnctx = pRange->pcmnctx;
+	ULONGLONG cbLeft = pRange->cbRange;
+	LARGE_INTEGER ibStart;
+	HANDLE hFile;
+	PBYTE pbBuffer;
+
+	if ((hFile = OpenFileForReadingEx(pRange->pszPath, pRange->bUnbuffered)) == INVALID_HANDLE_VALUE)
+		return(0);
+
+	ibStart.QuadPart = (LONGLONG)pRange->ibStart;
+
+	if ( SetFilePointerEx(hFile, ibStart, NULL, FILE_BEGIN) &&
+	     (pbBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE)) )
+	{
+		DWORD cbBufferRead;
+
+		pRange->crc = 0;
+
+		while (cbLeft)
+		{
+			if (pcmnctx->status == PAUSED)
+				WaitForSingleObject(pcmnctx->hUnpauseEvent, INFINITE);
+			if (pcmnctx->status == CANCEL_REQUESTED)
+				break;
+
+			// Every range but the last is a multiple of the read size, and the last
+			// ends with the file, so whole reads are fine (and unbuffered ones need them)
+			if ( !ReadFile(hFile, pbBuffer, READ_BUFFER_SIZE, &cbBufferRead, NULL) ||
+			     cbBufferRead == 0 )
+				break;
+
+			cbBufferRead = (DWORD)min(cbLeft, cbBufferRead);
+			pRange->crc = crc32(pRange->crc, pbBuffer, cbBufferRead);
+			cbLeft -= cbBufferRead;
+			InterlockedExchangeAdd64(pRange->pcbDone, cbBufferRead);
+		}
+
+		pRange->bCompleted = (cbLeft == 0);
+		VirtualFree(pbBuffer, 0, MEM_RELEASE);
+	}
+
+	CloseHandle(hFile);
+	return(0);
+}
+
+// Calculates the CRC-32 of cRanges equal parts of the file in parallel, and
+// merges them into pctx; returns the number of bytes successfully hashed
+ULONGLONG WINAPI HashFileRangesCRC32( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath, PWHCTXCRC32 pctx,
+                                      ULONGLONG cbFileSize, UINT cRanges, BOOL bUpdateProgress,
+                                      BOOL bUnbuffered, volatile ULONGLONG* pcbCurrentMaxSize )
+{
+	CRC32RANGE ranges[CRC32_RANGES_MAX];
+	HANDLE hThreads[CRC32_RANGES_MAX];
+	volatile LONGLONG cbDone = 0;
+	ULONGLONG cbRange, cbHashed = 0;
+	BOOL bCurrentlyUpdating = FALSE;
+	UINT lastProgress = 0;
+	UINT i, cThreads = 0;
+
+	// Keep every range but the last a multiple of the read size
+	cbRange = cbFileSize / cRanges;
+	cbRange -= cbRange % READ_BUFFER_SIZE;
+
+	for (i = 0; i < cRanges; ++i)
+	{
+		ranges[i].pcmnctx = pcmnctx;
+		ranges[i].pszPath = pszPath;
+		ranges[i].ibStart = cbRange * i;
+		ranges[i].cbRange = (i < cRanges - 1) ? cbRange : cbFileSize - cbRange * i;
+		ranges[i].bUnbuffered = bUnbuffered;
+		ranges[i].pcbDone = &cbDone;
+		ranges[i].bCompleted = FALSE;
+	}
+
+	for (i = 0; i < cRanges; ++i)
+	{
+		if (!(hThreads[i] = CreateThreadCRT(HashRangeCRC32, &ranges[i])))
+			break;
+
+		++cThreads;
+	}
+
+	// Wait for the range threads, updating the progress bar as they go (this
+	// is only ever the sole file-hashing thread, so there is no critical section)
+	while (cThreads && WaitForMultipleObjects(cThreads, hThreads, TRUE, MARQUEE_INTERVAL) == WAIT_TIMEOUT)
+	{
+		if (bUpdateProgress)
+			UpdateProgressBar(pcmnctx->hWndPBFile, NULL, &bCurrentlyUpdating,
+			                  pcbCurrentMaxSize, cbFileSize, cbDone, &lastProgress);
+	}
+
+	for (i = 0; i < cThreads; ++i)
+		CloseHandle(hThreads[i]);
+
+	// Any ranges that didn't get a thread are hashed on this one instead
+	for (i = cThreads; i < cRanges; ++i)
+	{
+		HashRangeCRC32(&ranges[i]);
+
+		if (bUpdateProgress)
+			UpdateProgressBar(pcmnctx->hWndPBFile, NULL, &bCurrentlyUpdating,
+			                  pcbCurrentMaxSize, cbFileSize, cbDone, &lastProgress);
+	}
+
+	// Merge the CRCs in file order, stopping at the first incomplete range
+	for (i = 0; i < cRanges && ranges[i].bCompleted; ++i)
+	{
+		pctx->state = (i == 0) ? ranges[i].crc : crc32_combine(pctx->state, ranges[i].crc, ranges[i].cbRange);
+		cbHashed += ranges[i].cbRange;
+	}
+
+	return(cbHashed);
+}
+
+#endif
+
+// A file that takes more than one read is read ahead: a second handle to it, opened
+// for overlapped I/O, reads the next READ_BUFFER_SIZE into one of the worker buffer's
+// read buffers while the last one read is hashed, so that the disk and the CPU work
+// at the same time instead of taking turns
+typedef struct {
+	HANDLE             hFile;        // overlapped handle to the file
+	OVERLAPPED         ov;           // the read in flight, if bPending
+	PBYTE              pbBuffers;    // the worker buffer, whose read buffers are used in turn
+	UINT               iBuffer;      // the read buffer being read into
+	BOOL               bPending;     // is there a read in flight?
+} READAHEAD, *PREADAHEAD;
+
+VOID WINAPI ReadAheadStart( PREADAHEAD pra, ULONGLONG ibOffset )
+{
+	pra->ov.Offset = (DWORD)ibOffset;
+	pra->ov.OffsetHigh = (DWORD)(ibOffset >> 32);
+
+	// A read that fails to start (e.g. at the end of the file) reads nothing
+	pra->bPending = ReadFile(pra->hFile, pra->pbBuffers + READ_BUFFER_SIZE * pra->iBuffer,
+	                         READ_BUFFER_SIZE, NULL, &pra->ov) || GetLastError() == ERROR_IO_PENDING;
+}
+
+// Starts reading the file ahead from ibOffset (unbuffered if asked, and ibOffset is
+// a multiple of READ_BUFFER_SIZE); returns FALSE if it can't be, in which case it
+// should be read as usual, with hFile
+BOOL WINAPI ReadAheadBegin( PREADAHEAD pra, HANDLE hFile, PBYTE pbBuffers, ULONGLONG ibOffset, BOOL bUnbuffered )
+{
+	pra->hFile = INVALID_HANDLE_VALUE;
+	if (bUnbuffered && ibOffset % READ_BUFFER_SIZE == 0)
+		pra->hFile = ReOpenFile(hFile, GENERIC_READ, FILE_SHARE_ALL,
+		                        FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_NO_BUFFERING);
+	if (pra->hFile == INVALID_HANDLE_VALUE)
+		pra->hFile = ReOpenFile(hFile, GENERIC_READ, FILE_SHARE_ALL, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN);
+	if (pra->hFile == INVALID_HANDLE_VALUE)
+		return(FALSE);
+
+	ZeroMemory(&pra->ov, sizeof(pra->ov));
+	if (! (pra->ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)))
+	{
+		CloseHandle(pra->hFile);
+		return(FALSE);
+	}
+
+	pra->pbBuffers = pbBuffers;
+	pra->iBuffer = 0;
+	ReadAheadStart(pra, ibOffset);
+	return(TRUE);
+}
+
+// Waits for the read in flight and, unless it came up short, starts the next one
+// into the next buffer; returns the buffer read, which is valid until the next call
+PBYTE WINAPI ReadAheadNext( PREADAHEAD pra, PDWORD pcbRead )
+{
+	PBYTE pbRead = pra->pbBuffers + READ_BUFFER_SIZE * pra->iBuffer;
+
+	if (! (pra->bPending && GetOverlappedResult(pra->hFile, &pra->ov, pcbRead, TRUE)))
+		*pcbRead = 0;
+
+	pra->bPending = FALSE;
+
+	if (*pcbRead == READ_BUFFER_SIZE)
+	{
+		pra->iBuffer = (pra->iBuffer + 1) % READ_BUFFER_COUNT;
+		ReadAheadStart(pra, ((ULONGLONG)pra->ov.OffsetHigh << 32 | pra->ov.Offset) + READ_BUFFER_SIZE);
+	}
+
+	return(pbRead);
+}
+
+VOID WINAPI ReadAheadEnd( PREADAHEAD pra )
+{
+	DWORD cbRead;
+
+	// The read in flight, if any, must be done with its buffer before it's reused
+	if (pra->bPending)
+	{
+		CancelIoEx(pra->hFile, &pra->ov);
+		GetOverlappedResult(pra->hFile, &pra->ov, &cbRead, TRUE);
+	}
+
+	CloseHandle(pra->ov.hEvent);
+	CloseHandle(pra->hFile);
+}
+
+// A large file on a local SSD can instead be hashed straight from a view of it,
+// mapped a window at a time, which saves copying it into the read buffer (and a
+// system call per READ_BUFFER_SIZE); if a view can't be mapped, or its pages read
+// in, the rest of the file is read as usual
+typedef struct {
+	HANDLE             hFile;        // the file, for reading the rest if mapping fails
+	PBYTE              pbBuffer;     // read buffer, likewise
+	HANDLE             hMapping;     // the file's mapping, or NULL once mapping has failed
+	PBYTE              pbView;       // the window mapped, if any
+	ULONGLONG          ibView;       // its offset in the file
+	SIZE_T             cbView;       // its length
+	ULONGLONG          cbFileSize;   // the file's size
+} MAPPEDFILE, *PMAPPEDFILE;
+
+VOID WINAPI SetMappedMinFileSize( ULONGLONG cbMinFileSize )
+{
+	g_cbMappedMin = cbMinFileSize;
+}
+
+BOOL WINAPI MappedFileBegin( PMAPPEDFILE pmf, HANDLE hFile, PBYTE pbBuffer, ULONGLONG cbFileSize )
+{
+	pmf->hFile = hFile;
+	pmf->pbBuffer = pbBuffer;
+	pmf->pbView = NULL;
+	pmf->cbFileSize = cbFileSize;
+	return((pmf->hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL);
+}
+
+VOID WINAPI MappedFileEnd( PMAPPEDFILE pmf )
+{
+	if (pmf->pbView)
+		UnmapViewOfFile(pmf->pbView);
+	if (pmf->hMapping)
+		CloseHandle(pmf->hMapping);
+
+	pmf->pbView = NULL;
+	pmf->hMapping = NULL;
+}
+
+// Touches every page of the cb bytes at pb, so that a read error is raised here, as
+// an in-page exception that can be caught, rather than in WHUpdateEx (or one of its
+// tasks); returns FALSE if a page couldn't be read in
+BOOL WINAPI MappedFileTouch( PCBYTE pb, DWORD cb )
+{
+	volatile BYTE bTouched;
+	DWORD i;
+
+	__try
+	{
+		for (i = 0; i < cb; i += MAPPED_PAGE_SIZE)
+			bTouched = pb[i];
+		bTouched = pb[cb - 1];
+		return(TRUE);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+	{
+		return(FALSE);
+	}
+}
+
+// Returns the next READ_BUFFER_SIZE (or what's left) of the file, at ibOffset, from
+// the view, sliding the window along when it runs off its end, or, if mapping has
+// failed, read into the read buffer
+PBYTE WINAPI MappedFileRead( PMAPPEDFILE pmf, ULONGLONG ibOffset, PDWORD pcbRead )
+{
+	if (pmf->hMapping)
+	{
+		DWORD cbWant = (DWORD)min(READ_BUFFER_SIZE, pmf->cbFileSize - min(ibOffset, pmf->cbFileSize));
+		LARGE_INTEGER liOffset;
+
+		*pcbRead = 0;
+		if (cbWant == 0)
+			return(pmf->pbBuffer);
+
+		if (! pmf->pbView || ibOffset < pmf->ibView || ibOffset + cbWant > pmf->ibView + pmf->cbView)
+		{
+			if (pmf->pbView)
+				UnmapViewOfFile(pmf->pbView);
+
+			pmf->ibView = ibOffset - ibOffset % MAPPED_WINDOW_ALIGN;
+			pmf->cbView = (SIZE_T)min(MAPPED_WINDOW_SIZE, pmf->cbFileSize - pmf->ibView);
+			pmf->pbView = (PBYTE)MapViewOfFile(pmf->hMapping, FILE_MAP_READ, (DWORD)(pmf->ibView >> 32),
+			                                   (DWORD)pmf->ibView, pmf->cbView);
+		}
+
+		if (pmf->pbView && MappedFileTouch(pmf->pbView + (ibOffset - pmf->ibView), cbWant))
+		{
+			*pcbRead = cbWant;
+			return(pmf->pbView + (ibOffset - pmf->ibView));
+		}
+
+		// Read the rest, from here on
+		MappedFileEnd(pmf);
+		liOffset.QuadPart = (LONGLONG)ibOffset;
+		if (! SetFilePointerEx(pmf->hFile, liOffset, NULL, FILE_BEGIN))
+			return(pmf->pbBuffer);
+	}
+
+	ReadFile(pmf->hFile, pmf->pbBuffer, READ_BUFFER_SIZE, pcbRead, NULL);
+	return(pmf->pbBuffer);
+}
+
+// If the file has been opened ahead (see OpenAhead.c), ppo is it, and it's left open
+VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath, PPREOPENED ppo,
                                   PWHCTXEX pwhctx, PWHRESULTEX pwhres, PBYTE pbuffer,
-                                  PFILESIZE pFileSize, LPARAM lParam,
+                                  PWHPIPELINE pPipeline, PBLOCKLIST pBlocks, PFILESIZE pFileSize, LPARAM lParam,
                                   PCRITICAL_SECTION pUpdateCritSec, volatile ULONGLONG* pcbCurrentMaxSize
 #ifdef _TIMED
                                 , PDWORD pdwElapsed
@@ -343,6 +782,10 @@ VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
 {
 	HANDLE hFile;
 
+	// No block list unless this file gets one of its own
+	if (pBlocks)
+		pBlocks->cBlocks = 0;
+
 	// If the worker thread is working so fast that the UI cannot catch up,
 	// pause for a bit to let things settle down
 	while (pcmnctx->cSentMsgs > pcmnctx->cHandledMsgs + 50)
@@ -368,14 +811,26 @@ VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
 	// Indicate that we want lower-case results (TODO: make this an option)
 	pwhctx->uCaseMode = WHFMT_LOWERCASE;
 
-	if ((hFile = OpenFileForReading(pszPath)) != INVALID_HANDLE_VALUE)
+	if ((hFile = ppo ? ppo->hFile : OpenFileForReading(pszPath)) != INVALID_HANDLE_VALUE)
 	{
 		ULONGLONG cbFileSize, cbFileRead = 0;
 		DWORD cbBufferRead;
+		PBYTE pbRead;
 		UINT lastProgress = 0;
 		UINT8 cInner = 0;
+		BOOL bPipelined, bBlocks, bUnbuffered, bMapped, bReadAhead, bFirst, bRanges = FALSE, bCheckpointed = FALSE;
+		HANDLE hPipelineFile = hFile;
+		CHECKPOINT ckpt;
+		MAPPEDFILE mf;
+		READAHEAD ra;
+#ifdef USE_PPL
+		UINT cRanges;
+#endif
 
-		if (GetFileSizeEx(hFile, (PLARGE_INTEGER)&cbFileSize))
+		if (ppo)
+			cbFileSize = ppo->cbFileSize;
+
+		if (ppo || GetFileSizeEx(hFile, (PLARGE_INTEGER)&cbFileSize))
 		{
 			// The progress bar is updates only once every 4 buffer reads; if
 			// the file is small enough that it requires only one such cycle,
@@ -399,24 +854,145 @@ VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
                 dwStarted = GetTickCount();
 #endif
 			// Finally, read the file and calculate the checksum; the
-			// progress bar is updated only once every 4 buffer reads (512K)
-			WHInitEx(pwhctx);
+			// progress bar is updated only once every 4 buffer reads (512K);
+			// if the caller provides a pipeline, a large file needing several
+			// algorithms is hashed with a thread per algorithm
+			bPipelined = pPipeline && (pwhctx->dwFlags & (pwhctx->dwFlags - 1)) &&
+			             cbFileSize > READ_BUFFER_SIZE && WHPipelineBegin(pPipeline, pwhctx);
+
+			// If the caller wants a block list, each block is also hashed on its own
+			// (with the next lane's context), which takes the whole file in one go
+			bBlocks = pBlocks && ! bPipelined &&
+			          BlockListBegin(pBlocks, pwhctx->dwFlags, cbFileSize, WorkerBufferContext(pbuffer) + 1);
+			if (! bPipelined)
+			{
+				// A long file is checkpointed as it's hashed, and picks up from its
+				// last checkpoint (if it hasn't changed since) instead of the start,
+				// or, if hashed incrementally and it has only grown, from its old end
+				bCheckpointed = ! bBlocks && cbFileSize >= CheckpointMinFileSize() && CheckpointOpen(&ckpt, hFile, pwhctx->dwFlags);
+				if (! (bCheckpointed && CheckpointLoad(&ckpt, hFile, pwhctx, &cbFileRead)))
+				{
+					cbFileRead = 0;
+					WHInitEx(pwhctx);
+				}
+			}
+
+			// A huge file is read unbuffered, if enabled, so that hashing it doesn't
+			// flush everything else out of the file cache (see OpenFileForReadingEx;
+			// the pipeline's slots are page-aligned too)
+			if ((bUnbuffered = IsUnbuffered(cbFileSize)) && bPipelined)
+			{
+				hPipelineFile = ReOpenFile(hFile, GENERIC_READ, FILE_SHARE_ALL,
+				                           FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_NO_BUFFERING);
+				if (hPipelineFile == INVALID_HANDLE_VALUE)
+					hPipelineFile = hFile;
+			}
+
+#ifdef USE_PPL
+			// A large file that needs only CRC-32 (e.g. for an .sfv) is split into
+			// ranges that are hashed in parallel and then combined, but only if we
+			// are the sole file-hashing thread and the device takes parallel reads
+			// (as many as DeviceDepth would hash files at once)
+			bRanges = pwhctx->dwFlags == WHEX_CHECKCRC32 && pUpdateCritSec == NULL && cbFileRead == 0 && ! bBlocks &&
+			          (cRanges = CountCRC32Ranges(cbFileSize)) > 1 &&
+			          (cRanges = min(cRanges, DeviceDepth(WHEX_CHECKCRC32, GetDeviceClass(pszPath, NULL)))) > 1;
+#endif
 
+			// Otherwise a large file on a local SSD (which a network volume never is)
+			// is hashed from a mapped view, if enabled (and it's not to bypass the file
+			// cache, which mapping can't), or else the file is read ahead, if it takes
+			// more than one read (a pipeline already reads into one slot while the
+			// others are hashed)
+			bMapped = ! bPipelined && ! bRanges && ! bUnbuffered && g_cbMappedMin && cbFileSize >= g_cbMappedMin &&
+			          IsSSD(pszPath) && MappedFileBegin(&mf, hFile, pbuffer, cbFileSize);
+
+			// A file opened ahead has had its first buffer read already, which is used
+			// unless the file is picking up from a checkpoint, or is hashed in ranges
+			// or from a view (otherwise the handle is put back to where it's read from)
+			bFirst = ppo && ppo->cbFirst >= min(cbFileSize, READ_BUFFER_SIZE) &&
+			         ! bCheckpointed && ! bRanges && ! bMapped;
+			if (ppo)
+			{
+				LARGE_INTEGER liOffset;
+				liOffset.QuadPart = bFirst ? ppo->cbFirst : (LONGLONG)cbFileRead;
+				if (! bCheckpointed)
+					SetFilePointerEx(hFile, liOffset, NULL, FILE_BEGIN);
+				if (hPipelineFile != hFile)
+					SetFilePointerEx(hPipelineFile, liOffset, NULL, FILE_BEGIN);
+			}
+
+			bReadAhead = ! bPipelined && ! bRanges && ! bMapped && cbFileSize - cbFileRead > READ_BUFFER_SIZE &&
+			             ReadAheadBegin(&ra, hFile, pbuffer, cbFileRead + (bFirst ? ppo->cbFirst : 0), bUnbuffered);
+
+#ifdef USE_PPL
+			if (bRanges)
+			{
+				cbFileRead = HashFileRangesCRC32(pcmnctx, pszPath, &pwhctx->ctxCRC32, cbFileSize,
+				                                 cRanges, bUpdateProgress, bUnbuffered, pcbCurrentMaxSize);
+
+				if (pcmnctx->status == CANCEL_REQUESTED)
+				{
+					if (! ppo)
+						CloseHandle(hFile);
+					return;
+				}
+			}
+			else
+#endif
 			do // Outer loop: keep going until the end
 			{
 				do // Inner loop: break every 4 cycles or if the end is reached
 				{
                     if (pcmnctx->status == PAUSED)
+                    {
+                        // The process might not outlive the pause
+                        if (bCheckpointed)
+                            CheckpointSave(&ckpt, pwhctx, cbFileRead, FALSE);
                         WaitForSingleObject(pcmnctx->hUnpauseEvent, INFINITE);
+                    }
 					if (pcmnctx->status == CANCEL_REQUESTED)
 					{
-						CloseHandle(hFile);
+						if (bPipelined)
+							WHPipelineFinish(pPipeline, NULL);
+						if (hPipelineFile != hFile)
+							CloseHandle(hPipelineFile);
+						if (bCheckpointed)
+							CheckpointSave(&ckpt, pwhctx, cbFileRead, FALSE);
+						if (bMapped)
+							MappedFileEnd(&mf);
+						if (bReadAhead)
+							ReadAheadEnd(&ra);
+						if (! ppo)
+							CloseHandle(hFile);
 						return;
 					}
 
-					ReadFile(hFile, pbuffer, READ_BUFFER_SIZE, &cbBufferRead, NULL);
-					WHUpdateEx(pwhctx, pbuffer, cbBufferRead);
+					if (bPipelined)
+					{
+						PBYTE pbSlot = WHPipelineAcquire(pPipeline);
+						if (bFirst)
+							memcpy(pbSlot, ppo->pbFirst, cbBufferRead = ppo->cbFirst);
+						else
+							ReadFile(hPipelineFile, pbSlot, READ_BUFFER_SIZE, &cbBufferRead, NULL);
+						WHPipelineSubmit(pPipeline, cbBufferRead);
+					}
+					else
+					{
+						if (bFirst)
+							pbRead = ppo->pbFirst, cbBufferRead = ppo->cbFirst;
+						else if (bMapped)
+							pbRead = MappedFileRead(&mf, cbFileRead, &cbBufferRead);
+						else if (bReadAhead)
+							pbRead = ReadAheadNext(&ra, &cbBufferRead);
+						else
+							ReadFile(hFile, pbRead = pbuffer, READ_BUFFER_SIZE, &cbBufferRead, NULL);
+
+						WHUpdateEx(pwhctx, pbRead, cbBufferRead);
+						if (bBlocks)
+							BlockListUpdate(pBlocks, pbRead, cbBufferRead);
+					}
 					cbFileRead += cbBufferRead;
+					bFirst = FALSE;
 
 				} while (cbBufferRead == READ_BUFFER_SIZE && (++cInner & 0x03));
 
@@ -424,9 +1000,36 @@ VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
 					UpdateProgressBar(pcmnctx->hWndPBFile, pUpdateCritSec, &bCurrentlyUpdating,
 					                  pcbCurrentMaxSize, cbFileSize, cbFileRead, &lastProgress);
 
+				if (bCheckpointed && cbBufferRead == READ_BUFFER_SIZE)
+					CheckpointSave(&ckpt, pwhctx, cbFileRead, TRUE);
+
 			} while (cbBufferRead == READ_BUFFER_SIZE);
 
-			WHFinishEx(pwhctx, pwhres);
+			if (hPipelineFile != hFile)
+				CloseHandle(hPipelineFile);
+			if (bMapped)
+				MappedFileEnd(&mf);
+			if (bReadAhead)
+				ReadAheadEnd(&ra);
+
+			// The checkpoint is no longer needed, but the state at the end may be
+			// (before WHFinishEx finalizes it)
+			if (bCheckpointed)
+			{
+				if (cbFileRead == cbFileSize)
+					CheckpointFinish(&ckpt, hFile, pwhctx, cbFileRead);
+				else
+					CheckpointDelete(&ckpt);
+			}
+
+			if (bPipelined)
+				WHPipelineFinish(pPipeline, pwhres);
+			else
+				WHFinishEx(pwhctx, pwhres);
+
+			// The list's root also covers the file's digest
+			if (bBlocks)
+				BlockListEnd(pBlocks, cbFileRead == cbFileSize, pwhres);
 #ifdef _TIMED
             if (pdwElapsed)
                 *pdwElapsed = GetTickCount() - dwStarted;
@@ -442,7 +1045,406 @@ VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
 				                  pcbCurrentMaxSize, cbFileSize, 0, &lastProgress);
 		}
 
+		if (! ppo)
+			CloseHandle(hFile);
+	}
+}
+
+// One of the threads checking the blocks of a file against its block list
+typedef struct {
+	PCOMMONCONTEXT     pcmnctx;      // context of the owning worker thread
+	PCTSTR             pszPath;      // file to read
+	PBLOCKLIST         pbl;          // the list, whose pbState says which blocks to check
+	volatile LONG*     piNext;       // next block to claim, across all threads
+	volatile LONGLONG* pcbDone;      // bytes checked so far, across all threads
+	BOOL               bUnbuffered;  // read the file bypassing the file cache?
+} BLOCKCHECKER, *PBLOCKCHECKER;
+
+DWORD WINAPI CheckBlocks( PBLOCKCHECKER pChecker )
+{
+	PCOMMONCONTEXT pcmnctx = pChecker->pcmnctx;
+	PBLOCKLIST pbl = pChecker->pbl;
+	PWHCTXEX pwhctx;
+	HANDLE hFile;
+	PBYTE pbBuffer;
+	UINT iBlock;
+
+	if ((hFile = OpenFileForReadingEx(pChecker->pszPath, pChecker->bUnbuffered)) == INVALID_HANDLE_VALUE)
+		return(0);
+
+	// The zero-filled memory doubles as the initial state of the hash context
+	if (pbBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE + sizeof(WHCTXEX), MEM_COMMIT, PAGE_READWRITE))
+	{
+		pwhctx = (PWHCTXEX)(pbBuffer + READ_BUFFER_SIZE);
+		pwhctx->dwFlags = BlockListFlags(pbl);
+
+		// Blocks are claimed one at a time, so the threads stay close together in the file
+		while ((iBlock = (UINT)InterlockedIncrement(pChecker->piNext) - 1) < pbl->cBlocks)
+		{
+			ULONGLONG ibStart = (ULONGLONG)iBlock * pbl->cbBlock;
+			ULONGLONG cbLeft = min(pbl->cbBlock, pbl->cbFileSize - ibStart);
+			LARGE_INTEGER liStart;
+			DWORD cbBufferRead;
+
+			if (pbl->pbState[iBlock] != BLOCK_UNCHECKED)
+				continue;
+
+			liStart.QuadPart = (LONGLONG)ibStart;
+			if (! SetFilePointerEx(hFile, liStart, NULL, FILE_BEGIN))
+				break;
+
+			WHInitEx(pwhctx);
+
+			while (cbLeft)
+			{
+				if (pcmnctx->status == PAUSED)
+					WaitForSingleObject(pcmnctx->hUnpauseEvent, INFINITE);
+				if (pcmnctx->status == CANCEL_REQUESTED)
+					break;
+
+				// Blocks are whole MiB, and the last ends with the file, so whole
+				// reads are fine (and unbuffered ones need them)
+				if ( !ReadFile(hFile, pbBuffer, READ_BUFFER_SIZE, &cbBufferRead, NULL) ||
+				     cbBufferRead == 0 )
+					break;
+
+				cbBufferRead = (DWORD)min(cbLeft, cbBufferRead);
+				WHUpdateEx(pwhctx, pbBuffer, cbBufferRead);
+				cbLeft -= cbBufferRead;
+				InterlockedExchangeAdd64(pChecker->pcbDone, cbBufferRead);
+			}
+
+			// A block that was cut short by a cancellation is left unchecked
+			if (pcmnctx->status == CANCEL_REQUESTED)
+				break;
+
+			// An unreadable block is as bad as a damaged one
+			pbl->pbState[iBlock] = (cbLeft == 0 && BlockListMatch(pbl, iBlock, pwhctx)) ? BLOCK_GOOD : BLOCK_BAD;
+		}
+
+		WHFreeEx(pwhctx);
+		VirtualFree(pbBuffer, 0, MEM_RELEASE);
+	}
+
+	CloseHandle(hFile);
+	return(0);
+}
+
+// Checks a file against its block list, marking each block in pbl->pbState as good or bad:
+// every block, or, if the last check found bad blocks, just those (see BlockListLoadRepairs).
+// The blocks are checked on as many threads as the device takes, if this is the sole
+// file-hashing thread.  Returns FALSE if the file can't be checked this way (it can't be
+// opened, or it's not the size that the list is for), in which case it should be hashed.
+BOOL WINAPI WorkerThreadCheckBlocks( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath, PBLOCKLIST pbl,
+                                     PFILESIZE pFileSize, LPARAM lParam,
+                                     PCRITICAL_SECTION pUpdateCritSec, volatile ULONGLONG* pcbCurrentMaxSize )
+{
+	BLOCKCHECKER checker;
+	HANDLE hThreads[BLOCK_CHECKERS_MAX];
+	volatile LONG iNext = 0;
+	volatile LONGLONG cbDone = 0;
+	ULONGLONG cbFileSize, cbToCheck = 0;
+	BOOL bCurrentlyUpdating = FALSE, bUpdateProgress;
+	UINT lastProgress = 0;
+	UINT i, cUnchecked = 0, cThreads = 0, cMaxThreads = 1;
+	HANDLE hFile;
+
+	// If the worker thread is working so fast that the UI cannot catch up,
+	// pause for a bit to let things settle down
+	while (pcmnctx->cSentMsgs > pcmnctx->cHandledMsgs + 50)
+	{
+		Sleep(50);
+		if (pcmnctx->status == PAUSED)
+			WaitForSingleObject(pcmnctx->hUnpauseEvent, INFINITE);
+		if (pcmnctx->status == CANCEL_REQUESTED)
+			return(TRUE);
+	}
+
+	if ((hFile = OpenFileForReading(pszPath)) == INVALID_HANDLE_VALUE)
+		return(FALSE);
+
+	if (! GetFileSizeEx(hFile, (PLARGE_INTEGER)&cbFileSize) || cbFileSize != pbl->cbFileSize)
+	{
 		CloseHandle(hFile);
+		return(FALSE);
+	}
+
+	pFileSize->ui64 = cbFileSize;
+	StrFormatKBSize(cbFileSize, pFileSize->sz, countof(pFileSize->sz));
+	PostMessage(pcmnctx->hWnd, HM_WORKERTHREAD_SETSIZE, (WPARAM)pcmnctx, lParam);
+
+	BlockListLoadRepairs(pbl, hFile);
+
+	for (i = 0; i < pbl->cBlocks; ++i)
+	{
+		if (pbl->pbState[i] == BLOCK_UNCHECKED)
+		{
+			++cUnchecked;
+			cbToCheck += min(pbl->cbBlock, cbFileSize - (ULONGLONG)i * pbl->cbBlock);
+		}
+	}
+
+	bUpdateProgress = cbToCheck >= READ_BUFFER_SIZE * 4;
+
+#ifdef USE_PPL
+	// As with a CRC-32 split into ranges, only the sole file-hashing thread fans out
+	if (pUpdateCritSec == NULL)
+		cMaxThreads = min(DeviceDepth(BlockListFlags(pbl), GetDeviceClass(pszPath, NULL)), BLOCK_CHECKERS_MAX);
+#endif
+
+	checker.pcmnctx = pcmnctx;
+	checker.pszPath = pszPath;
+	checker.pbl = pbl;
+	checker.piNext = &iNext;
+	checker.pcbDone = &cbDone;
+	checker.bUnbuffered = IsUnbuffered(cbFileSize);
+
+	while (cThreads < min(cMaxThreads, cUnchecked) && (hThreads[cThreads] = CreateThreadCRT(CheckBlocks, &checker)))
+		++cThreads;
+
+	if (cThreads == 0 && cUnchecked)
+	{
+		CloseHandle(hFile);
+		return(FALSE);
+	}
+
+	// Wait for the checker threads, updating the progress bar as they go
+	while (cThreads && WaitForMultipleObjects(cThreads, hThreads, TRUE, MARQUEE_INTERVAL) == WAIT_TIMEOUT)
+	{
+		if (bUpdateProgress)
+			UpdateProgressBar(pcmnctx->hWndPBFile, pUpdateCritSec, &bCurrentlyUpdating,
+			                  pcbCurrentMaxSize, cbToCheck, cbDone, &lastProgress);
+	}
+
+	for (i = 0; i < cThreads; ++i)
+		CloseHandle(hThreads[i]);
+
+	// A block that no thread got to couldn't be read (a thread couldn't open the file, or seek)
+	if (pcmnctx->status != CANCEL_REQUESTED)
+	{
+		for (i = 0; i < pbl->cBlocks; ++i)
+		{
+			if (pbl->pbState[i] == BLOCK_UNCHECKED)
+				pbl->pbState[i] = BLOCK_BAD;
+		}
+
+		BlockListSaveRepairs(pbl, hFile);
+	}
+
+	if (bUpdateProgress)
+		UpdateProgressBar(pcmnctx->hWndPBFile, pUpdateCritSec, &bCurrentlyUpdating,
+		                  pcbCurrentMaxSize, cbToCheck, 0, &lastProgress);
+
+	CloseHandle(hFile);
+	return(TRUE);
+}
+
+// A read of one lane of a batch, in flight; ReadFileEx ignores ov.hEvent, which instead
+// points to the batch's count of reads in flight
+typedef struct {
+	OVERLAPPED         ov;
+	DWORD              cbRead;       // bytes read, once complete
+} BATCHREAD, *PBATCHREAD;
+
+VOID CALLBACK BatchReadDone( DWORD dwErrorCode, DWORD cbRead, LPOVERLAPPED pov )
+{
+	PBATCHREAD pRead = CONTAINING_RECORD(pov, BATCHREAD, ov);
+
+	pRead->cbRead = (dwErrorCode == ERROR_SUCCESS) ? cbRead : 0;
+	--*(PUINT)pov->hEvent;
+}
+
+// Hashes a batch of up to WHEX_MAX_LANES small files together, with WHUpdateMultiEx, each
+// file being read into its own slice of pbuffer. Files larger than BATCH_MAX_FILE_SIZE are
+// skipped and returned with pbBatched[i] == FALSE, for the caller to hash individually with
+// WorkerThreadHashFile. As with WorkerThreadHashFile, the paths may live inside pbuffer,
+// because every file is opened before anything is read into it. The files are opened for
+// overlapped I/O, and every lane's read is started at once, so that the device has them
+// all to work on together rather than one at a time, and their completions are collected
+// on this thread, in an alertable wait. A file that has been opened ahead (pppo, if not
+// NULL, has a non-NULL entry for it) is hashed straight from its first buffer instead,
+// which holds all of it, and is left open.
+VOID WINAPI WorkerThreadHashFiles( PCOMMONCONTEXT pcmnctx, UINT cFiles, PCTSTR ppszPaths[], PPREOPENED pppo[],
+                                   PWHCTXEX ppwhctx[], PWHRESULTEX ppwhres[], PBYTE pbuffer,
+                                   PFILESIZE ppFileSizes[], PBOOL pbBatched
+#ifdef _TIMED
+                                 , PDWORD ppdwElapsed[]
+#endif
+                                 )
+{
+	HANDLE ahFile[WHEX_MAX_LANES];
+	UINT aiFile[WHEX_MAX_LANES];  // which file each lane is hashing
+	ULONGLONG acbFileSize[WHEX_MAX_LANES], acbFileRead[WHEX_MAX_LANES];
+	DWORD acbFirst[WHEX_MAX_LANES];
+	PWHCTXEX apwhctx[WHEX_MAX_LANES];
+	PCBYTE apbFirst[WHEX_MAX_LANES];  // the file's first buffer, if it was opened ahead
+	PCBYTE apbIn[WHEX_MAX_LANES];
+	UINT acbIn[WHEX_MAX_LANES];
+	BATCHREAD aReads[WHEX_MAX_LANES];
+	UINT cbSlice = BATCH_SLICE_SIZE(cFiles);
+	UINT cLanes = 0, cPending, i;
+#ifdef _TIMED
+	DWORD dwStarted = GetTickCount();
+#endif
+
+	// If the worker thread is working so fast that the UI cannot catch up,
+	// pause for a bit to let things settle down
+	while (pcmnctx->cSentMsgs > pcmnctx->cHandledMsgs + 50)
+	{
+		Sleep(50);
+		if (pcmnctx->status == PAUSED)
+			WaitForSingleObject(pcmnctx->hUnpauseEvent, INFINITE);
+		if (pcmnctx->status == CANCEL_REQUESTED)
+			return;
+	}
+
+	// Open every file, and start hashing those small enough
+	for (i = 0; i < cFiles; ++i)
+	{
+		PPREOPENED ppo = pppo ? pppo[i] : NULL;
+		HANDLE hFile;
+		ULONGLONG cbFileSize;
+
+		pbBatched[i] = TRUE;
+#ifdef _TIMED
+		if (ppdwElapsed[i])
+			*ppdwElapsed[i] = 0;
+#endif
+		if (ppwhctx[i]->dwFlags == 0)
+			continue;
+
+		if (ppo)
+		{
+			if ((hFile = ppo->hFile) == INVALID_HANDLE_VALUE)
+				continue;
+
+			if ((cbFileSize = ppo->cbFileSize) > BATCH_MAX_FILE_SIZE)
+			{
+				pbBatched[i] = FALSE;
+				continue;
+			}
+		}
+		else
+		{
+			hFile = CreateFile(ppszPaths[i], GENERIC_READ, FILE_SHARE_ALL, NULL, OPEN_EXISTING,
+			                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				continue;
+
+			if (! GetFileSizeEx(hFile, (PLARGE_INTEGER)&cbFileSize))
+			{
+				CloseHandle(hFile);
+				continue;
+			}
+
+			if (cbFileSize > BATCH_MAX_FILE_SIZE)
+			{
+				pbBatched[i] = FALSE;
+				CloseHandle(hFile);
+				continue;
+			}
+		}
+
+		if (ppFileSizes)
+		{
+			ppFileSizes[i]->ui64 = cbFileSize;
+			StrFormatKBSize(cbFileSize, ppFileSizes[i]->sz, countof(ppFileSizes[i]->sz));
+		}
+
+		ppwhctx[i]->uCaseMode = WHFMT_LOWERCASE;
+		WHInitEx(ppwhctx[i]);
+
+		ahFile[cLanes] = hFile;
+		aiFile[cLanes] = i;
+		acbFileSize[cLanes] = cbFileSize;
+		acbFileRead[cLanes] = 0;
+		apwhctx[cLanes] = ppwhctx[i];
+		apbFirst[cLanes] = ppo ? ppo->pbFirst : NULL;
+		acbFirst[cLanes] = ppo ? ppo->cbFirst : 0;
+		cLanes++;
+	}
+
+	// Read the next slice of every file still in progress, and hash all of them together
+	while (cLanes)
+	{
+		if (pcmnctx->status == PAUSED)
+			WaitForSingleObject(pcmnctx->hUnpauseEvent, INFINITE);
+		if (pcmnctx->status == CANCEL_REQUESTED)
+		{
+			for (i = 0; i < cLanes; ++i)
+			{
+				if (! apbFirst[i])
+					CloseHandle(ahFile[i]);
+			}
+			return;
+		}
+
+		for (i = 0, cPending = 0; i < cLanes; ++i)
+		{
+			// A file opened ahead is already read, and its slices are taken from there
+			if (apbFirst[i])
+			{
+				apbIn[i] = apbFirst[i] + acbFileRead[i];
+				aReads[i].cbRead = (DWORD)min(cbSlice, acbFirst[i] - acbFileRead[i]);
+				continue;
+			}
+
+			apbIn[i] = pbuffer + i * cbSlice;
+			ZeroMemory(&aReads[i].ov, sizeof(aReads[i].ov));
+			aReads[i].ov.Offset = (DWORD)acbFileRead[i];
+			aReads[i].ov.OffsetHigh = (DWORD)(acbFileRead[i] >> 32);
+			aReads[i].ov.hEvent = (HANDLE)&cPending;
+			aReads[i].cbRead = 0;
+
+			// A read that fails to start (e.g. at the end of the file) reads nothing
+			if (ReadFileEx(ahFile[i], pbuffer + i * cbSlice, cbSlice, &aReads[i].ov, BatchReadDone))
+				++cPending;
+		}
+
+		// BatchReadDone runs for each as it completes
+		while (cPending)
+			SleepEx(INFINITE, TRUE);
+
+		for (i = 0; i < cLanes; ++i)
+		{
+			acbIn[i] = aReads[i].cbRead;
+			acbFileRead[i] += aReads[i].cbRead;
+		}
+
+		WHUpdateMultiEx(apwhctx, apbIn, acbIn, cLanes);
+
+		// Finish the files which have reached their end, and move the last lane into their place
+		for (i = 0; i < cLanes; )
+		{
+			if (acbIn[i] == cbSlice)
+			{
+				++i;
+				continue;
+			}
+
+			WHFinishEx(apwhctx[i], ppwhres[aiFile[i]]);
+#ifdef _TIMED
+			if (ppdwElapsed[aiFile[i]])
+				*ppdwElapsed[aiFile[i]] = GetTickCount() - dwStarted;
+#endif
+			// If we encountered a file read error
+			if (acbFileRead[i] != acbFileSize[i])
+				// Clear the valid-results bits for the hashes we just calculated
+				ppwhres[aiFile[i]]->dwFlags &= ~apwhctx[i]->dwFlags;
+
+			if (! apbFirst[i])
+				CloseHandle(ahFile[i]);
+
+			--cLanes;
+			ahFile[i]      = ahFile[cLanes];
+			aiFile[i]      = aiFile[cLanes];
+			acbFileSize[i] = acbFileSize[cLanes];
+			acbFileRead[i] = acbFileRead[cLanes];
+			apwhctx[i]     = apwhctx[cLanes];
+			apbFirst[i]    = apbFirst[cLanes];
+			acbFirst[i]    = acbFirst[cLanes];
+			acbIn[i]       = acbIn[cLanes];
+		}
 	}
 }
 
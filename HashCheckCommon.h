@@ -18,13 +18,29 @@ extern "C" {
 #include <windows.h>
 #include "HashCheckUI.h"
 #include "libs/WinHash.h"
+#include "BlockList.h"
+#include "OpenAhead.h"
 
 // Tuning constants
 #define MAX_PATH_BUFFER       0x800
 #define READ_BUFFER_SIZE      0x40000
+#define READ_BUFFER_COUNT     2  // a large file is read into one buffer while another is hashed
 #define BASE_STACK_SIZE       0x1000
 #define MARQUEE_INTERVAL      100  // marquee progress bar animation interval
 
+#define BATCH_MAX_FILE_SIZE   READ_BUFFER_SIZE  // larger files are never hashed in batches
+#define BATCH_SLICE_SIZE(c)   ((READ_BUFFER_SIZE / (c)) & ~0xFFF)  // per-file read size in a batch of c
+#define BATCH_IO_LANES        8  // a hard disk's or share's small files are batched at least this many
+                                 // at a time, for their reads
+
+// Each file-hashing thread allocates a single block holding its read buffers followed by
+// its hash contexts (one per batch lane) and its block list, which are reused from one
+// file to the next (VirtualAlloc zeroes them); only the first read buffer is used unless
+// a file is read ahead
+#define WORKER_BUFFER_SIZE    (READ_BUFFER_SIZE * READ_BUFFER_COUNT + WHEX_MAX_LANES * sizeof(WHCTXEX) + sizeof(BLOCKLIST))
+#define WorkerBufferContext(pb) ((PWHCTXEX)((PBYTE)(pb) + READ_BUFFER_SIZE * READ_BUFFER_COUNT))
+#define WorkerBufferBlockList(pb) ((PBLOCKLIST)(WorkerBufferContext(pb) + WHEX_MAX_LANES))
+
 // Progress bar states (Vista-only)
 #ifndef PBM_SETSTATE
 #define PBM_SETSTATE          (WM_USER + 16)
@@ -87,6 +103,7 @@ typedef struct {
 
 // Convenience wrappers
 HANDLE __fastcall OpenFileForReading( PCTSTR pszPath );
+HANDLE __fastcall OpenFileForReadingEx( PCTSTR pszPath, BOOL bUnbuffered );
 
 // Parsing helpers
 VOID __fastcall HCNormalizeString( PTSTR psz );
@@ -95,6 +112,7 @@ VOID __fastcall HCNormalizeString( PTSTR psz );
 VOID WINAPI SetControlText( HWND hWnd, UINT uCtrlID, UINT uStringID );
 VOID WINAPI EnableControl( HWND hWnd, UINT uCtrlID, BOOL bEnable );
 VOID WINAPI FormatFractionalResults( PTSTR pszFormat, PTSTR pszBuffer, UINT uPart, UINT uTotal );
+VOID WINAPI SetProgressBarMarquee( PCOMMONCONTEXT pcmnctx, BOOL bState, UINT cTotal );
 VOID WINAPI SetProgressBarPause( PCOMMONCONTEXT pcmnctx, WPARAM iState );
 
 // Functions used by the main thread to control the worker thread
@@ -104,14 +122,29 @@ VOID WINAPI WorkerThreadCleanup( PCOMMONCONTEXT pcmnctx );
 
 // Worker thread functions
 DWORD WINAPI WorkerThreadStartup( PCOMMONCONTEXT pcmnctx );
-VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath,
+PBYTE WINAPI AllocWorkerBuffer( );
+VOID WINAPI FreeWorkerBuffer( PVOID pbBuffer );
+PWHPIPELINE WINAPI CreateWorkerPipeline( DWORD dwFlags );
+VOID WINAPI SetMappedMinFileSize( ULONGLONG cbMinFileSize );
+VOID WINAPI SetUnbufferedMinFileSize( ULONGLONG cbMinFileSize );
+VOID WINAPI WorkerThreadHashFile( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath, PPREOPENED ppo,
                                   PWHCTXEX pwhctx, PWHRESULTEX pwhres, PBYTE pbuffer,
-                                  PFILESIZE pFileSize, LPARAM lParam,
+                                  PWHPIPELINE pPipeline, PBLOCKLIST pBlocks, PFILESIZE pFileSize, LPARAM lParam,
                                   PCRITICAL_SECTION pUpdateCritSec, volatile ULONGLONG* pcbCurrentMaxSize
 #ifdef _TIMED
                                 , PDWORD pdwElapsed
 #endif
                                 );
+BOOL WINAPI WorkerThreadCheckBlocks( PCOMMONCONTEXT pcmnctx, PCTSTR pszPath, PBLOCKLIST pbl,
+                                     PFILESIZE pFileSize, LPARAM lParam,
+                                     PCRITICAL_SECTION pUpdateCritSec, volatile ULONGLONG* pcbCurrentMaxSize );
+VOID WINAPI WorkerThreadHashFiles( PCOMMONCONTEXT pcmnctx, UINT cFiles, PCTSTR ppszPaths[], PPREOPENED pppo[],
+                                   PWHCTXEX ppwhctx[], PWHRESULTEX ppwhres[], PBYTE pbuffer,
+                                   PFILESIZE ppFileSizes[], PBOOL pbBatched
+#ifdef _TIMED
+                                 , PDWORD ppdwElapsed[]
+#endif
+                                 );
 
 // Wrappers for SHGetInstanceExplorer
 ULONG_PTR __fastcall HostAddRef( );
@@ -14,6 +14,7 @@
 #include "HashCheckOptions.h"
 #include "libs/WinHash.h"
 #include "RegHelpers.h"
+#include "Checkpoint.h"
 #include "libs/IsFontAvailable.h"
 #include <Strsafe.h>
 
@@ -175,6 +176,27 @@ VOID __fastcall OptionsLoad( PHASHCHECKOPTIONS popt )
 		}
 	}
 
+	if (popt->dwFlags & HCOF_TUNING)
+	{
+		// These have no UI; each is 0 (calibrated, see WHGetTuning) unless set by hand
+		if (!(hKey && RegGetDW(hKey, TEXT("ParallelMinBytes"), &popt->dwParallelMin)))
+			popt->dwParallelMin = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("ParallelMaxTasks"), &popt->dwParallelMaxTasks)))
+			popt->dwParallelMaxTasks = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("FileWorkers"), &popt->dwFileWorkers)))
+			popt->dwFileWorkers = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("FileWorkersHDD"), &popt->dwFileWorkersHDD)))
+			popt->dwFileWorkersHDD = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("IncrementalMinSize"), &popt->dwIncrementalMinSize)))
+			popt->dwIncrementalMinSize = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("BlockListSize"), &popt->dwBlockListSize)))
+			popt->dwBlockListSize = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("MappedMinSize"), &popt->dwMappedMinSize)))
+			popt->dwMappedMinSize = 0;
+		if (!(hKey && RegGetDW(hKey, TEXT("UnbufferedMinSize"), &popt->dwUnbufferedMinSize)))
+			popt->dwUnbufferedMinSize = 0;
+	}
+
 	if (hKey)
 		RegCloseKey(hKey);
 }
@@ -204,6 +226,62 @@ VOID __fastcall OptionsSave( PHASHCHECKOPTIONS popt )
 		if (popt->dwFlags & HCOF_FONT)
 			RegSetValueEx(hKey, TEXT("Font"), 0, REG_BINARY, (PBYTE)&popt->lfFont, sizeof(LOGFONT));
 
+		if (popt->dwFlags & HCOF_TUNING)
+		{
+			RegSetDW(hKey, TEXT("ParallelMinBytes"), popt->dwParallelMin);
+			RegSetDW(hKey, TEXT("ParallelMaxTasks"), popt->dwParallelMaxTasks);
+			RegSetDW(hKey, TEXT("FileWorkers"), popt->dwFileWorkers);
+			RegSetDW(hKey, TEXT("FileWorkersHDD"), popt->dwFileWorkersHDD);
+			RegSetDW(hKey, TEXT("IncrementalMinSize"), popt->dwIncrementalMinSize);
+			RegSetDW(hKey, TEXT("BlockListSize"), popt->dwBlockListSize);
+			RegSetDW(hKey, TEXT("MappedMinSize"), popt->dwMappedMinSize);
+			RegSetDW(hKey, TEXT("UnbufferedMinSize"), popt->dwUnbufferedMinSize);
+		}
+
+		RegCloseKey(hKey);
+	}
+}
+
+VOID __fastcall OptionsApplyTuning( PHASHCHECKOPTIONS popt, DWORD dwChecksums )
+{
+	static volatile LONG s_lReported = FALSE;
+	WHTUNING whtOverrides = { 0 };
+	PCWHTUNING pwht;
+	HKEY hKey;
+
+	// The first call in the process calibrates, which takes a few tens of
+	// milliseconds, so this belongs on a worker thread
+	whtOverrides.cbParallelMin = popt->dwParallelMin;
+	whtOverrides.cMaxTasks = popt->dwParallelMaxTasks;
+	whtOverrides.cFileWorkers = popt->dwFileWorkers;
+	whtOverrides.cFileWorkersHDD = popt->dwFileWorkersHDD;
+	WHSetTuning(&whtOverrides);
+	pwht = WHGetTuning();
+
+	// Incremental hashing of append-only files is off unless asked for (see Checkpoint.c)
+	CheckpointSetIncremental((ULONGLONG)popt->dwIncrementalMinSize << 20);
+
+	// As are hashing from mapped views and reading unbuffered (see WorkerThreadHashFile)
+	SetMappedMinFileSize((ULONGLONG)popt->dwMappedMinSize << 20);
+	SetUnbufferedMinFileSize((ULONGLONG)popt->dwUnbufferedMinSize << 20);
+
+	// Report what is in effect for these checksums, and what it was derived
+	// from, in a subkey of its own so it can't be mistaken for the overrides;
+	// the calibration is made once per process, and so is the report
+	if ( InterlockedCompareExchange(&s_lReported, TRUE, FALSE) == FALSE &&
+	     (hKey = RegOpen(HKEY_CURRENT_USER, OPTIONS_KEYNAME TEXT("\\Tuning"), NULL, TRUE)) )
+	{
+		RegSetDW(hKey, TEXT("Checksums"), dwChecksums);
+		RegSetDW(hKey, TEXT("ParallelMinBytes"), WHTuningParallelMin(dwChecksums));
+		RegSetDW(hKey, TEXT("ParallelMaxTasks"), WHTuningMaxTasks());
+		RegSetDW(hKey, TEXT("FileWorkers"), WHTuningFileWorkers(dwChecksums, TRUE));
+		RegSetDW(hKey, TEXT("FileWorkersHDD"), WHTuningFileWorkers(dwChecksums, FALSE));
+		RegSetDW(hKey, TEXT("DispatchNs"), pwht->uDispatchNs);
+
+#define OPT_REPORT_SPEED_op(alg)  \
+		RegSetDW(hKey, HASH_NAME_##alg TEXT(" ps/byte"), pwht->auPsPerByte[alg - 1]);
+		FOR_EACH_HASH(OPT_REPORT_SPEED_op)
+
 		RegCloseKey(hKey);
 	}
 }
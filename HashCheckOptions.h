@@ -25,6 +25,14 @@ typedef struct {
 	DWORD dwSaveEncoding;
 	DWORD dwChecksums;
 	LOGFONT lfFont;
+	DWORD dwParallelMin;     // Tuning overrides (see WHTUNING); 0 keeps the calibrated value
+	DWORD dwParallelMaxTasks;
+	DWORD dwFileWorkers;
+	DWORD dwFileWorkersHDD;
+	DWORD dwIncrementalMinSize;  // MiB; files this long are hashed incrementally (0: never)
+	DWORD dwBlockListSize;       // MiB; saved files larger than this get a block list (0: none)
+	DWORD dwMappedMinSize;       // MiB; files this long on a local SSD are hashed mapped (0: never)
+	DWORD dwUnbufferedMinSize;   // MiB; files this long are read bypassing the file cache (0: never)
 } HASHCHECKOPTIONS, *PHASHCHECKOPTIONS;
 
 // Options flags
@@ -33,12 +41,14 @@ typedef struct {
 #define HCOF_SAVEENCODING 0x00000004  // The dwSaveEncoding member is valid
 #define HCOF_FONT         0x00000008  // The lfFont member is valid
 #define HCOF_CHECKSUMS    0x00000010  // The dwChecksums member is valid
-#define HCOF_ALL          0x0000001F
+#define HCOF_TUNING       0x00000020  // The dwParallel*, dwFileWorkers*, dwIncrementalMinSize, dwBlockListSize, dwMappedMinSize and dwUnbufferedMinSize members are valid
+#define HCOF_ALL          0x0000003F
 
 // Public functions
 VOID __fastcall OptionsDialog( HWND hWndOwner, PHASHCHECKOPTIONS popt );
 VOID __fastcall OptionsLoad( PHASHCHECKOPTIONS popt );
 VOID __fastcall OptionsSave( PHASHCHECKOPTIONS popt );
+VOID __fastcall OptionsApplyTuning( PHASHCHECKOPTIONS popt, DWORD dwChecksums );
 
 #ifdef __cplusplus
 }
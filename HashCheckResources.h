@@ -66,3 +66,6 @@
 #define IDC_OPT_FONT_PREVIEW            519
 #define IDC_OPT_LINK                    520
 #define IDC_OPT_CHK_BLAKE3              521
+#define IDC_OPT_CHK_XXH3_128            522
+#define IDC_OPT_CHK_CRC32C              523
+#define IDC_OPT_CHK_SHA512_256          524
@@ -79,6 +79,7 @@ UINT CALLBACK HashPropCallback( HWND hWnd, UINT uMsg, LPPROPSHEETPAGE ppsp )
 			{
 				phpctx->status = INACTIVE;
 				phpctx->hListRaw = hList;
+				phpctx->dwResultSlots = WHEX_ALL;  // more checksum types can be added later
 				return(1);
 			}
 		}
@@ -99,7 +100,7 @@ VOID __fastcall HashPropWorkerMain( PHASHPROPCONTEXT phpctx )
 	// be asynchronous, or else there may be a deadlock.
 
 	PHASHPROPITEM pItem;
-    WHCTXEX whctx;
+    PWHCTXEX pwhctx;
 
 	// Prep: if not already done, expand directories, establish prefix, etc.
     if (! (phpctx->dwFlags & HPF_HLIST_PREPPED))
@@ -113,12 +114,19 @@ VOID __fastcall HashPropWorkerMain( PHASHPROPCONTEXT phpctx )
 
 	// Which checksum types we want to calculate
     // (this is loaded earlier in HashPropDlgInit())
-    DWORD checksumFlags = (UINT8)phpctx->opt.dwChecksums;
+    DWORD checksumFlags = phpctx->opt.dwChecksums & WHEX_ALL;
 
-    // Read buffer
-    PBYTE pbBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE);
+    // Apply any tuning overrides (calibrating, the first time in this process)
+    OptionsApplyTuning(&phpctx->opt, checksumFlags);
+
+    // Read buffer and hash contexts
+    PBYTE pbBuffer = AllocWorkerBuffer();
     if (pbBuffer == NULL)
         return;
+    pwhctx = WorkerBufferContext(pbBuffer);
+
+    // Large files are hashed with a thread per algorithm, if there are cores to spare
+    PWHPIPELINE pPipeline = CreateWorkerPipeline(checksumFlags);
 
 #ifdef _TIMED
     DWORD dwStarted;
@@ -130,15 +138,18 @@ VOID __fastcall HashPropWorkerMain( PHASHPROPCONTEXT phpctx )
         // Some results might already be present if the user changes which checksum types
         // to calculate and we're going through the list a second+ time for all/some items;
         // only calculate the checksums we don't already have (usually all those requested)
-        whctx.dwFlags = checksumFlags & ~pItem->results.dwFlags;
+        pwhctx->dwFlags = checksumFlags & ~HashCalcItemResults(pItem)->dwFlags;
 
 		// Get the hash
 		WorkerThreadHashFile(
 			(PCOMMONCONTEXT)phpctx,
 			pItem->szPath,
-			&whctx,
-			&pItem->results,
+			NULL,  // each file is opened as it's hashed
+			pwhctx,
+			HashCalcItemResults(pItem),
 			pbBuffer,
+			pPipeline,
+			NULL,  // block lists are only for checksum files
 			NULL, 0, NULL, NULL
 #ifdef _TIMED
           , &pItem->dwElapsed
@@ -157,7 +168,9 @@ VOID __fastcall HashPropWorkerMain( PHASHPROPCONTEXT phpctx )
 #ifdef _TIMED
     phpctx->dwElapsed = GetTickCount() - dwStarted;
 #endif
-    VirtualFree(pbBuffer, 0, MEM_RELEASE);
+    if (pPipeline)
+        WHPipelineDestroy(pPipeline);
+    FreeWorkerBuffer(pbBuffer);
 }
 
 
@@ -438,7 +451,7 @@ VOID WINAPI HashPropDlgInit( PHASHPROPCONTEXT phpctx )
 	}
 
     // Load the two configuration items we need
-    phpctx->opt.dwFlags = HCOF_FONT | HCOF_CHECKSUMS;
+    phpctx->opt.dwFlags = HCOF_FONT | HCOF_CHECKSUMS | HCOF_TUNING;
     OptionsLoad(&phpctx->opt);
 
 	// Initialize the results text box
@@ -615,25 +628,25 @@ VOID WINAPI HashPropUpdateResults( PHASHPROPCONTEXT phpctx, PHASHPROPITEM pItem
 	 *    of a single file (it is cleared before returning if necessary)
 	 **/
 
+	PCWHRESULTEX pwhres = HashCalcItemResults(pItem);
 	PTSTR pszScratchAppend;
     size_t cchMaxBufferRequired = 0;  // max tchar count for text results of one file
 
-    // Check to see of any desired hashes are not present in the results
-    if (phpctx->opt.dwChecksums & ~pItem->results.dwFlags)
-        // Replace the invalid hashes with X's
-        HashCalcClearInvalid(&pItem->results, TEXT('X'));
-    else
-		// Otherwise, we can increment the success count
+    // If all of the desired hashes are present in the results, we can increment
+    // the success count (any that are missing are shown as X's below)
+    if (! (phpctx->opt.dwChecksums & ~pwhres->dwFlags))
 		++phpctx->cSuccess;
 
 	// Get the scratch buffer; we will be using the entire scratch struct
 	// as a single monolithic buffer
     pszScratchAppend = BYTEADD(&phpctx->scratch, phpctx->obScratch);
 
-	// Copy the file label
+	// Copy the file label; the translations are as wide as an 8-character hash name,
+	// so pad them out to HASH_RNAME_WIDTH to keep the colons aligned
+	pszScratchAppend = SSChainNCpy(pszScratchAppend, _T("        "), HASH_RNAME_WIDTH - 8);
 	pszScratchAppend += LoadString(g_hModThisDll, IDS_HP_FILELABEL,
 		                           pszScratchAppend, MAX_STRINGRES);
-    cchMaxBufferRequired += MAX_STRINGRES;
+    cchMaxBufferRequired += HASH_RNAME_WIDTH - 8 + MAX_STRINGRES;
 
 	// Copy the path, appending CRLF
     pszScratchAppend = SSChainNCpy2(
@@ -647,12 +660,14 @@ VOID WINAPI HashPropUpdateResults( PHASHPROPCONTEXT phpctx, PHASHPROPITEM pItem
     PTSTR pszScratchBeforeResults = pszScratchAppend;
 #define HASH_RESULT_APPEND_op(alg)                                              \
     if (phpctx->opt.dwChecksums & WHEX_CHECK##alg)                              \
-        pszScratchAppend = SSChainNCpy3(                                        \
+    {                                                                           \
+        pszScratchAppend = SSChainNCpy(                                         \
             pszScratchAppend,                                                   \
-            HASH_RESULT_op(alg), sizeof(HASH_RESULT_op(alg))/sizeof(TCHAR) - 1, /* the "- 1" excludes the terminating NUL */ \
-            pItem->results.szHex##alg, alg##_DIGEST_LENGTH * 2,                 \
-            CRLF, CCH_CRLF                                                      \
-        );
+            HASH_RESULT_op(alg), sizeof(HASH_RESULT_op(alg))/sizeof(TCHAR) - 1  /* the "- 1" excludes the terminating NUL */ \
+        );                                                                      \
+        pszScratchAppend = HashCalcResultToHex(pwhres, alg, pszScratchAppend, TEXT('X'));  \
+        pszScratchAppend = SSChainNCpy(pszScratchAppend, CRLF, CCH_CRLF);       \
+    }
     FOR_EACH_HASH(HASH_RESULT_APPEND_op)
     cchMaxBufferRequired += pszScratchAppend - pszScratchBeforeResults;  // always the same length
 
@@ -819,7 +834,7 @@ VOID WINAPI HashPropSaveResults( PHASHPROPCONTEXT phpctx )
     {
         // If the last item in the list already has the desired hash computed
         DWORD dwDesiredHash = 1 << (phpctx->ofn.nFilterIndex - 1);
-        if (((PHASHPROPITEM)SLGetDataLast(phpctx->hList))->results.dwFlags & dwDesiredHash)
+        if (HashCalcItemResults((PHASHPROPITEM)SLGetDataLast(phpctx->hList))->dwFlags & dwDesiredHash)
         {
             HashPropDoSaveResults(phpctx);
         }
@@ -848,7 +863,7 @@ VOID WINAPI HashPropDoSaveResults(PHASHPROPCONTEXT phpctx)
 		SLReset(phpctx->hList);
 
 		while (pItem = SLGetDataAndStep(phpctx->hList))
-			HashCalcWriteResult(phpctx, pItem);
+			HashCalcWriteResult(phpctx, pItem, NULL);
 	}
 
 	CloseHandle(phpctx->hFileOut);
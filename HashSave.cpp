@@ -13,7 +13,7 @@
 #include "HashCheckCommon.h"
 #include "HashCalc.h"
 #include "SetAppID.h"
-#include "IsSSD.h"
+#include "DeviceQueue.h"
 #include <Strsafe.h>
 #include <vector>
 #include <cassert>
@@ -149,12 +149,13 @@ VOID __fastcall HashSaveWorkerMain( PHASHSAVECONTEXT phsctx )
 	// Note that ALL message communication to and from the main window MUST
 	// be asynchronous, or else there may be a deadlock.
 
-	// Prep: expand directories, max path, etc. (prefix was set by earlier call)
+	// Prep: expand directories, max path, etc. (prefix was set by earlier call);
+	// only the hash type being saved needs room in each item's results
 	PostMessage(phsctx->hWnd, HM_WORKERTHREAD_TOGGLEPREP, (WPARAM)phsctx, TRUE);
+	phsctx->dwResultSlots = 1 << (phsctx->ofn.nFilterIndex - 1);
 	if (! HashCalcPrepare(phsctx))
         return;
     HashCalcSetSaveFormat(phsctx);
-	PostMessage(phsctx->hWnd, HM_WORKERTHREAD_TOGGLEPREP, (WPARAM)phsctx, FALSE);
 
     // Extract the slist into a vector for parallel_for_each
     std::vector<PHASHSAVEITEM> vecpItems;
@@ -164,22 +165,51 @@ VOID __fastcall HashSaveWorkerMain( PHASHSAVECONTEXT phsctx )
     vecpItems.pop_back();
     assert(vecpItems.back() != nullptr);
 
+    // Indicate which hash type we are after, see WHEX... values in WinHash.h
+    const DWORD dwFlags = 1 << (phsctx->ofn.nFilterIndex - 1);
+
+    // Apply any tuning overrides (calibrating, the first time in this process)
+    OptionsApplyTuning(&phsctx->opt, dwFlags);
+
+    // Files larger than this many MiB also get a list of per-block hashes (see BlockList.c)
+    const DWORD cbBlock = min(phsctx->opt.dwBlockListSize, BLOCKLIST_MAX_BLOCK_SIZE / BLOCKLIST_UNIT) * BLOCKLIST_UNIT;
+
+    // The files are queued by the device they're on, each queue hashing as many at once as the
+    // device and the calibrated speed of the algorithm warrant, and in batches where those pay
+    // (see DeviceQueue.c); finding where a rotational disk's files lie on it is still part of
+    // the prep
+    PDEVICEQUEUES pQueues = DeviceQueuesCreate((PCOMMONCONTEXT)phsctx, vecpItems.size(), [](PVOID pvItems, SIZE_T iItem, PTSTR pszPath)
+    {
+        StringCchCopy(pszPath, MAX_PATH_BUFFER, (*(std::vector<PHASHSAVEITEM>*)pvItems)[iItem]->szPath);
+    }, &vecpItems, dwFlags);
+	PostMessage(phsctx->hWnd, HM_WORKERTHREAD_TOGGLEPREP, (WPARAM)phsctx, FALSE);
+    if (pQueues == NULL)
+        return;
+
 #ifdef USE_PPL
-    const bool bMultithreaded = vecpItems.size() > 1 && IsSSD(vecpItems[0]->szPath);
-    concurrency::concurrent_vector<void*> vecBuffers;  // a vector of all allocated read buffers (one per thread)
-    DWORD dwBufferTlsIndex = TlsAlloc();               // TLS index of the current thread's read buffer
+    const UINT cWorkers = pQueues->cWorkers;
+    const bool bMultithreaded = cWorkers > 1;
+    concurrency::concurrent_vector<void*> vecBuffers;  // a vector of all allocated worker buffers (one per thread)
+    DWORD dwBufferTlsIndex = TlsAlloc();               // TLS index of the current thread's worker buffer
     if (dwBufferTlsIndex == TLS_OUT_OF_INDEXES)
+    {
+        DeviceQueuesFree(pQueues);
         return;
+    }
 #else
     constexpr bool bMultithreaded = false;
 #endif
 
-    PBYTE pbTheBuffer;  // file read buffer, used iff not multithreaded
+    PBYTE pbTheBuffer;  // file read buffer and hash contexts, used iff not multithreaded
     if (! bMultithreaded)
     {
-        pbTheBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE);
+        pbTheBuffer = AllocWorkerBuffer();
         if (pbTheBuffer == NULL)
+        {
+            DeviceQueuesFree(pQueues);
             return;
+        }
+        WorkerBufferBlockList(pbTheBuffer)->cbBlock = cbBlock;
     }
 
     // Initialize the progress bar update synchronization vars
@@ -188,6 +218,28 @@ VOID __fastcall HashSaveWorkerMain( PHASHSAVECONTEXT phsctx )
     if (bMultithreaded)
         InitializeCriticalSection(&updateCritSec);
 
+    // If a rotational disk's files are hashed in the order of their data on it (see
+    // DeviceQueue.c), each line is held back until those before it have been written,
+    // along with a copy of its block list, so the file still lists them in the same order
+    const bool bHoldBack = pQueues->bReordered != FALSE;
+    std::vector<BYTE> vecbHeld;
+    std::vector<PBLOCKLIST> vecpHeldBlocks;
+    SIZE_T iNextWrite = 0;
+    CRITICAL_SECTION writeCritSec;
+    if (bHoldBack)
+    {
+        vecbHeld.resize(vecpItems.size(), FALSE);
+        vecpHeldBlocks.resize(vecpItems.size(), nullptr);
+        if (bMultithreaded)
+            InitializeCriticalSection(&writeCritSec);
+    }
+
+#ifdef USE_PPL
+    // This thread's queues below run on a scheduler with just that many workers
+    if (bMultithreaded)
+        concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(1, concurrency::MaxConcurrency, cWorkers));
+#endif
+
 #ifdef _TIMED
     DWORD dwStarted;
     dwStarted = GetTickCount();
@@ -195,47 +247,92 @@ VOID __fastcall HashSaveWorkerMain( PHASHSAVECONTEXT phsctx )
 
     class CanceledException {};
 
-    // concurrency::parallel_for_each(vecpItems.cbegin(), vecpItems.cend(), ...
-    auto per_file_worker = [&](PHASHSAVEITEM pItem)
-	{
-        WHCTXEX whctx;
-
-        // Indicate which hash type we are after, see WHEX... values in WinHash.h
-        whctx.dwFlags = 1 << (phsctx->ofn.nFilterIndex - 1);
-
-        PBYTE pbBuffer;
+#pragma warning(push)
+#pragma warning(disable: 4700 4703)  // potentially uninitialized local pointer variable 'pbTheBuffer' used
+    auto get_worker_buffer = [&]() -> PBYTE
+    {
 #ifdef USE_PPL
         if (bMultithreaded)
         {
-            // Allocate or retrieve the already-allocated read buffer for the current thread
-            pbBuffer = (PBYTE)TlsGetValue(dwBufferTlsIndex);
+            // Allocate or retrieve the already-allocated worker buffer for the current thread
+            PBYTE pbBuffer = (PBYTE)TlsGetValue(dwBufferTlsIndex);
             if (pbBuffer == NULL)
             {
-                pbBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE);
+                pbBuffer = AllocWorkerBuffer();
                 if (pbBuffer == NULL)
                     throw CanceledException();
-                // Cache the read buffer for the current thread
+                WorkerBufferBlockList(pbBuffer)->cbBlock = cbBlock;
+                // Cache the worker buffer for the current thread
                 vecBuffers.push_back(pbBuffer);
                 TlsSetValue(dwBufferTlsIndex, pbBuffer);
             }
+            return pbBuffer;
         }
 #endif
+        return pbTheBuffer;
+    };
+#pragma warning(pop)
+
+    // ppo is the file, if it was opened ahead
+    auto hash_one_file = [&](PHASHSAVEITEM pItem, PBYTE pbBuffer, PPREOPENED ppo)
+    {
+        PWHCTXEX pwhctx = WorkerBufferContext(pbBuffer);
+        pwhctx->dwFlags = dwFlags;
 
-#pragma warning(push)
-#pragma warning(disable: 4700 4703)  // potentially uninitialized local pointer variable 'pbBuffer' used
 		// Get the hash
 		WorkerThreadHashFile(
 			(PCOMMONCONTEXT)phsctx,
 			pItem->szPath,
-			&whctx,
-			&pItem->results,
-            bMultithreaded ? pbBuffer : pbTheBuffer,
+			ppo,
+			pwhctx,
+			HashCalcItemResults(pItem),
+            pbBuffer,
+            NULL,  // only one algorithm is saved at a time
+            WorkerBufferBlockList(pbBuffer),
 			NULL, 0,
             bMultithreaded ? &updateCritSec : NULL, &cbCurrentMaxSize
 #ifdef _TIMED
           , &pItem->dwElapsed
 #endif
         );
+    };
+
+    // Writes the item's line now, or once all of those before it have been
+    auto write_result = [&](SIZE_T iItem, PCBLOCKLIST pBlocks)
+    {
+        if (! bHoldBack)
+        {
+            HashCalcWriteResult(phsctx, vecpItems[iItem], pBlocks);
+            return;
+        }
+
+        if (bMultithreaded)
+            EnterCriticalSection(&writeCritSec);
+
+        if (iItem == iNextWrite)
+        {
+            HashCalcWriteResult(phsctx, vecpItems[iItem], pBlocks);
+            while (++iNextWrite < vecpItems.size() && vecbHeld[iNextWrite])
+            {
+                HashCalcWriteResult(phsctx, vecpItems[iNextWrite], vecpHeldBlocks[iNextWrite]);
+                free(vecpHeldBlocks[iNextWrite]);
+                vecpHeldBlocks[iNextWrite] = nullptr;
+            }
+        }
+        else
+        {
+            vecbHeld[iItem] = TRUE;
+            vecpHeldBlocks[iItem] = pBlocks ? BlockListCopy(pBlocks) : nullptr;
+        }
+
+        if (bMultithreaded)
+            LeaveCriticalSection(&writeCritSec);
+    };
+
+    // pBlocks is the item's block list, if it was hashed by hash_one_file
+    auto file_done = [&](SIZE_T iItem, PCBLOCKLIST pBlocks)
+    {
+        PHASHSAVEITEM pItem = vecpItems[iItem];
 
         if (phsctx->status == PAUSED)
             WaitForSingleObject(phsctx->hUnpauseEvent, INFINITE);
@@ -243,25 +340,137 @@ VOID __fastcall HashSaveWorkerMain( PHASHSAVECONTEXT phsctx )
             throw CanceledException();
 
 		// Write the data
-		HashCalcWriteResult(phsctx, pItem);
+		write_result(iItem, pBlocks);
 
 		// Update the UI
 		InterlockedIncrement(&phsctx->cSentMsgs);
 		PostMessage(phsctx->hWnd, HM_WORKERTHREAD_UPDATE, (WPARAM)phsctx, (LPARAM)pItem);
     };
-#pragma warning(pop)
+
+    // The iItem'th item is hashed on its own
+    auto per_file_worker = [&](SIZE_T iItem)
+	{
+        PBYTE pbBuffer = get_worker_buffer();
+        hash_one_file(vecpItems[iItem], pbBuffer, NULL);
+        file_done(iItem, WorkerBufferBlockList(pbBuffer));
+    };
+
+    // The cFiles items of piItems are hashed together; they're at iPos in their queue, whose
+    // files are opened ahead if pOpenAhead
+    auto per_batch_worker = [&](PSIZE_T piItems, UINT cFiles, POPENAHEAD pOpenAhead, SIZE_T iPos)
+    {
+        PBYTE pbBuffer = get_worker_buffer();
+        UINT i;
+
+        PCTSTR ppszPaths[WHEX_MAX_LANES];
+        PPREOPENED pppo[WHEX_MAX_LANES];
+        PWHCTXEX ppwhctx[WHEX_MAX_LANES];
+        PWHRESULTEX ppwhres[WHEX_MAX_LANES];
+        BOOL pbBatched[WHEX_MAX_LANES];
+#ifdef _TIMED
+        PDWORD ppdwElapsed[WHEX_MAX_LANES];
+#endif
+        for (i = 0; i < cFiles; ++i)
+        {
+            ppszPaths[i] = vecpItems[piItems[i]]->szPath;
+            pppo[i] = pOpenAhead ? OpenAheadTake(pOpenAhead, iPos + i) : NULL;
+            ppwhctx[i] = WorkerBufferContext(pbBuffer) + i;
+            ppwhctx[i]->dwFlags = dwFlags;
+            ppwhres[i] = HashCalcItemResults(vecpItems[piItems[i]]);
+#ifdef _TIMED
+            ppdwElapsed[i] = &vecpItems[piItems[i]]->dwElapsed;
+#endif
+        }
+
+        WorkerThreadHashFiles((PCOMMONCONTEXT)phsctx, cFiles, ppszPaths, pppo, ppwhctx, ppwhres, pbBuffer, NULL, pbBatched
+#ifdef _TIMED
+                            , ppdwElapsed
+#endif
+        );
+
+        // Any files too large to batch are hashed on their own
+        for (i = 0; i < cFiles; ++i)
+        {
+            if (! pbBatched[i])
+                hash_one_file(vecpItems[piItems[i]], pbBuffer, pppo[i]);
+            file_done(piItems[i], pbBatched[i] ? NULL : WorkerBufferBlockList(pbBuffer));
+        }
+
+        if (pOpenAhead)
+            OpenAheadRelease(pOpenAhead, iPos + cFiles);
+    };
+
+    // One of a queue's workers, which takes its files a batch (or one) at a time until there
+    // are none left; a queue's only worker also has the next few files opened (and their first
+    // buffer read) while each batch is hashed, rather than one by one as it starts
+    auto queue_worker = [&](PDEVICEQUEUE pQueue)
+    {
+        auto open_ahead_path = [&](SIZE_T iPos, PTSTR pszPath)
+        {
+            StringCchCopy(pszPath, MAX_PATH_BUFFER, vecpItems[pQueue->piItems[iPos]]->szPath);
+        };
+        POPENAHEAD pOpenAhead = NULL;
+        if (pQueue->cDepth == 1 && pQueue->cLanes)
+        {
+            pOpenAhead = OpenAheadCreate(pQueue->cItems, [](PVOID pvPath, SIZE_T iPos, PTSTR pszPath)
+            {
+                (*(decltype(open_ahead_path)*)pvPath)(iPos, pszPath);
+            }, &open_ahead_path);
+        }
+
+        try
+        {
+            SIZE_T iPos;
+            UINT cFiles;
+            while ((cFiles = DeviceQueueTake(pQueue, max(pQueue->cLanes, 1u), &iPos)) > 0)
+            {
+                if (pQueue->cLanes)
+                    per_batch_worker(pQueue->piItems + iPos, cFiles, pOpenAhead, iPos);
+                else
+                    per_file_worker(pQueue->piItems[iPos]);
+            }
+        }
+        catch (CanceledException)
+        {
+            OpenAheadDestroy(pOpenAhead);
+            throw;
+        }
+
+        OpenAheadDestroy(pOpenAhead);
+    };
 
     try
     {
 #ifdef USE_PPL
         if (bMultithreaded)
-            concurrency::parallel_for_each(vecpItems.cbegin(), vecpItems.cend(), per_file_worker);
+        {
+            // Every queue's workers at once
+            concurrency::task_group tasks;
+            for (UINT iQueue = 0; iQueue < pQueues->cQueues; ++iQueue)
+            {
+                for (UINT iWorker = 0; iWorker < pQueues->pQueues[iQueue].cDepth; ++iWorker)
+                    tasks.run([&, iQueue] { queue_worker(&pQueues->pQueues[iQueue]); });
+            }
+            tasks.wait();
+        }
         else
 #endif
-            std::for_each(vecpItems.cbegin(), vecpItems.cend(), per_file_worker);
+            for (UINT iQueue = 0; iQueue < pQueues->cQueues; ++iQueue)
+                queue_worker(&pQueues->pQueues[iQueue]);
     }
     catch (CanceledException) {}  // ignore cancellation requests
 
+    DeviceQueuesFree(pQueues);
+
+    // Anything still held back was waiting on a file that a cancellation stopped
+    if (bHoldBack)
+    {
+        for (PBLOCKLIST pBlocks : vecpHeldBlocks)
+            free(pBlocks);
+        if (bMultithreaded)
+            DeleteCriticalSection(&writeCritSec);
+    }
+
 #ifdef _TIMED
     if (phsctx->cTotal > 1 && phsctx->status != CANCEL_REQUESTED)
     {
@@ -286,13 +495,14 @@ VOID __fastcall HashSaveWorkerMain( PHASHSAVECONTEXT phsctx )
 #ifdef USE_PPL
     if (bMultithreaded)
     {
+        concurrency::CurrentScheduler::Detach();
         for (void* pBuffer : vecBuffers)
-            VirtualFree(pBuffer, 0, MEM_RELEASE);
+            FreeWorkerBuffer(pBuffer);
         DeleteCriticalSection(&updateCritSec);
     }
     else
 #endif
-        VirtualFree(pbTheBuffer, 0, MEM_RELEASE);
+        FreeWorkerBuffer(pbTheBuffer);
 }
 
 
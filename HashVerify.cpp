@@ -13,7 +13,9 @@
 #include "HashCheckCommon.h"
 #include "SetAppID.h"
 #include "UnicodeHelpers.h"
-#include "IsSSD.h"
+#include "HashCheckOptions.h"
+#include "DeviceQueue.h"
+#include "libs/hexconv_impl.h"
 #include <uxtheme.h>
 #include <Strsafe.h>
 #include <cassert>
@@ -77,6 +79,7 @@ typedef struct {
 	BOOL               bBeenSeen;    // has the listview control asked for this item's info yet?
 	UINT8              uState;
 	UINT8              uStatusID;
+	PBLOCKLIST         pBlocks;      // the file's block list, if the checksum file has one
 	TCHAR              szActual[MAX_DIGEST_STRING_LENGTH];
 } HASHVERIFYITEM, *PHASHVERIFYITEM, *PHVITEM, **PPHVITEM;
 
@@ -123,6 +126,7 @@ typedef struct {
 __forceinline PBYTE WINAPI HashVerifyLoadData( PHASHVERIFYCONTEXT phvctx );
 VOID WINAPI HashVerifyParseData( PHASHVERIFYCONTEXT phvctx );
 BOOL WINAPI ValidateHexSequence( PTSTR psz, UINT cch );
+DWORD WINAPI HashVerifyNarrowType( PCTSTR pszPath, DWORD dwCandidates );
 
 // Worker thread
 VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx );
@@ -209,6 +213,9 @@ DWORD WINAPI HashVerifyThread( PTSTR pszPath )
 			(LPARAM)&hvctx
 		);
 
+		for (UINT i = 0; i < hvctx.cTotal; ++i)
+			free(hvctx.index[i]->pBlocks);
+
 		SLRelease(hvctx.hList);
 	}
 	else if (*pszPath)
@@ -273,6 +280,7 @@ PBYTE WINAPI HashVerifyLoadData( PHASHVERIFYCONTEXT phvctx )
 VOID WINAPI HashVerifyParseData( PHASHVERIFYCONTEXT phvctx )
 {
 	PTSTR pszData = phvctx->pszFileData;  // Points to the next line to process
+	PHASHVERIFYITEM pLastItem = NULL;     // The item of the last file line, which any block list is for
 
 	UINT cchChecksum;             // Expected length of the checksum in TCHARs
 	BOOL bReverseFormat = FALSE;  // TRUE if using SFV's format of putting the checksum last
@@ -337,6 +345,29 @@ VOID WINAPI HashVerifyParseData( PHASHVERIFYCONTEXT phvctx )
 			++pszData;
 		}
 
+		// Step 1b: A block list (see BlockList.c) belongs to the last file; a list
+		// with any line that doesn't make sense is dropped
+		if (pszStartOfLine[0] == TEXT(';') && pszStartOfLine[1] == TEXT('#'))
+		{
+			static const UINT cchHeader = countof(BLOCKLIST_HEADER_PREFIX) - 1;
+			static const UINT cchEntry = countof(BLOCKLIST_ENTRY_PREFIX) - 1;
+
+			if (pLastItem && StrCmpN(pszStartOfLine, BLOCKLIST_HEADER_PREFIX, cchHeader) == 0)
+			{
+				free(pLastItem->pBlocks);
+				pLastItem->pBlocks = BlockListParseHeader(pszStartOfLine + cchHeader);
+			}
+			else if ( pLastItem && pLastItem->pBlocks &&
+			          StrCmpN(pszStartOfLine, BLOCKLIST_ENTRY_PREFIX, cchEntry) == 0 &&
+			          ! BlockListParseEntry(pLastItem->pBlocks, pszStartOfLine + cchEntry) )
+			{
+				free(pLastItem->pBlocks);
+				pLastItem->pBlocks = NULL;
+			}
+
+			continue;
+		}
+
 		// Step 2a: Parse the line as SFV
 		if (bReverseFormat)
 		{
@@ -366,13 +397,13 @@ VOID WINAPI HashVerifyParseData( PHASHVERIFYCONTEXT phvctx )
 				if (ValidateHexSequence(pszStartOfLine, 8))
 				{
 					cchChecksum = 8;
-					phvctx->whctxFlags = WHEX_ALL32;  // WHEX_CHECKCRC32
+					phvctx->whctxFlags = HashVerifyNarrowType(phvctx->pszPath, WHEX_ALL32);  // WHEX_CHECKCRC32 | WHEX_CHECKCRC32C
 				}
 				// 128-bit algorithms (32-byte)
 				else if (ValidateHexSequence(pszStartOfLine, 32))
 				{
 					cchChecksum = 32;
-					phvctx->whctxFlags = WHEX_ALL128;  // WHEX_CHECKMD5
+					phvctx->whctxFlags = HashVerifyNarrowType(phvctx->pszPath, WHEX_ALL128);  // WHEX_CHECKMD5 | WHEX_CHECKXXH3_128
 				}
 				// 160-bit algorithms (40-byte)
 				else if (ValidateHexSequence(pszStartOfLine, 40))
@@ -384,13 +415,13 @@ VOID WINAPI HashVerifyParseData( PHASHVERIFYCONTEXT phvctx )
 				else if (ValidateHexSequence(pszStartOfLine, 64))
 				{
 					cchChecksum = 64;
-					phvctx->whctxFlags = WHEX_ALL256;  // WHEX_CHECKSHA256 | WHEX_CHECKSHA3_256
+					phvctx->whctxFlags = HashVerifyNarrowType(phvctx->pszPath, WHEX_ALL256);  // WHEX_CHECKSHA256 | WHEX_CHECKSHA3_256 | WHEX_CHECKBLAKE3 | WHEX_CHECKSHA512_256
 				}
 				// 512-bit algorithms (128-byte)
 				else if (ValidateHexSequence(pszStartOfLine, 128))
 				{
 					cchChecksum = 128;
-					phvctx->whctxFlags = WHEX_ALL512;  // WHEX_CHECKSHA512 | WHEX_CHECKSHA3_512
+					phvctx->whctxFlags = HashVerifyNarrowType(phvctx->pszPath, WHEX_ALL512);  // WHEX_CHECKSHA512 | WHEX_CHECKSHA3_512
 				}
 			}
 
@@ -434,8 +465,10 @@ VOID WINAPI HashVerifyParseData( PHASHVERIFYCONTEXT phvctx )
 			pItem->nListviewIndex = phvctx->cTotal;
 			pItem->bBeenSeen = FALSE;
 			pItem->uStatusID = HV_STATUS_NULL;
+			pItem->pBlocks = NULL;
 			pItem->szActual[0] = 0;
 
+			pLastItem = pItem;
 			++phvctx->cTotal;
 
 		} // If the current line was found to be valid
@@ -459,6 +492,14 @@ BOOL WINAPI ValidateHexSequence( PTSTR psz, UINT cch )
 	// Check that the given hex string matches /[0-9A-Fa-f]{cch}\b/, and if it
 	// does, convert to lower-case and NULL-terminate it.
 
+#ifdef UNICODE
+	// Whole blocks are checked and lower-cased by the SIMD kernels (hexconv.c),
+	// which leave the rest, and any block with a non-hex character, to the loop
+	UINT cchDone = (UINT)hex_validate_utf16((uint16_t *)psz, cch);
+	psz += cchDone;
+	cch -= cchDone;
+#endif
+
 	while (cch)
 	{
 		TCHAR ch = *psz;
@@ -490,6 +531,24 @@ BOOL WINAPI ValidateHexSequence( PTSTR psz, UINT cch )
 	return(FALSE);
 }
 
+DWORD WINAPI HashVerifyNarrowType( PCTSTR pszPath, DWORD dwCandidates )
+{
+	// When a checksum's length fits several algorithms, the name of a checksum
+	// file with an unknown extension often says which one it is, as in
+	// "SHA256SUMS" or "files.sha512-256.txt"; if exactly one of the candidates'
+	// extensions (less the dot) appears in the name, hash with only that one.
+	PCTSTR pszName = PathFindFileName(pszPath);
+	DWORD dwNamed = 0;
+
+#define HASH_VERIFY_NAME_HINT_op(alg)                           \
+	if ( (dwCandidates & WHEX_CHECK##alg) &&                    \
+	     StrStrI(pszName, HASH_EXT_##alg + 1) )                 \
+		dwNamed |= WHEX_CHECK##alg;
+	FOR_EACH_HASH(HASH_VERIFY_NAME_HINT_op)
+
+	return((dwNamed && !(dwNamed & (dwNamed - 1))) ? dwNamed : dwCandidates);
+}
+
 
 
 /*============================================================================*\
@@ -505,29 +564,73 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
 	PTSTR pszPathTail = StrRChr(phvctx->pszPath, NULL, TEXT('\\'));
 	SIZE_T cchPathPrefix = (pszPathTail) ? pszPathTail + 1 - phvctx->pszPath : 0;
 
+    // Apply any tuning overrides (calibrating, the first time in this process)
+    HASHCHECKOPTIONS opt;
+    opt.dwFlags = HCOF_TUNING;
+    OptionsLoad(&opt);
+    OptionsApplyTuning(&opt, phvctx->whctxFlags);
+
+    auto build_path = [&](PHASHVERIFYITEM pItem, PTSTR pszPath)
+    {
+        SIZE_T cchPrefix = cchPathPrefix;
+
+        // Do not use the prefix if pszDisplayName is an absolute path
+        if ( pItem->pszDisplayName[0] == TEXT('\\') ||
+             pItem->pszDisplayName[1] == TEXT(':') )
+        {
+            cchPrefix = 0;
+        }
+
+        SSChainNCpy2(
+            pszPath,
+            phvctx->pszPath, cchPrefix,
+            pItem->pszDisplayName, pItem->cchDisplayName
+        );
+    };
+
+    // The files are queued by the device they're on, each queue hashing as many at once as the
+    // device and the calibrated speed of the algorithm warrant, and in batches where those pay
+    // (see DeviceQueue.c); meanwhile, since finding where a rotational disk's files lie on it
+    // can take a while, the progress bar shows a marquee, as while a checksum file is saved
+    auto queue_path = [&](SIZE_T iItem, PTSTR pszPath)
+    {
+        build_path(phvctx->index[iItem], pszPath);
+    };
+    PostMessage(phvctx->hWnd, HM_WORKERTHREAD_TOGGLEPREP, (WPARAM)phvctx, TRUE);
+    PDEVICEQUEUES pQueues = DeviceQueuesCreate((PCOMMONCONTEXT)phvctx, phvctx->cTotal, [](PVOID pvPath, SIZE_T iItem, PTSTR pszPath)
+    {
+        (*(decltype(queue_path)*)pvPath)(iItem, pszPath);
+    }, &queue_path, phvctx->whctxFlags);
+    PostMessage(phvctx->hWnd, HM_WORKERTHREAD_TOGGLEPREP, (WPARAM)phvctx, FALSE);
+    if (pQueues == NULL)
+        return;
+
 #ifdef USE_PPL
-    // If the first file has an absolute path, use it for IsSSD(),
-    // otherwise use the checksum file itself
-    const bool bMultithreaded = phvctx->cTotal > 1 && IsSSD(
-        phvctx->index[0]->pszDisplayName[0] == TEXT('\\') ||
-        phvctx->index[0]->pszDisplayName[1] == TEXT(':') ?
-        phvctx->index[0]->pszDisplayName :
-        phvctx->pszPath);
-
-    concurrency::concurrent_vector<void*> vecBuffers;  // a vector of all allocated read buffers (one per thread)
-    DWORD dwBufferTlsIndex = TlsAlloc();               // TLS index of the current thread's read buffer
+    const UINT cWorkers = pQueues->cWorkers;
+    const bool bMultithreaded = cWorkers > 1;
+
+    concurrency::concurrent_vector<void*> vecBuffers;  // a vector of all allocated worker buffers (one per thread)
+    DWORD dwBufferTlsIndex = TlsAlloc();               // TLS index of the current thread's worker buffer
     if (dwBufferTlsIndex == TLS_OUT_OF_INDEXES)
+    {
+        DeviceQueuesFree(pQueues);
         return;
+    }
 #else
     constexpr bool bMultithreaded = false;
 #endif
 
-    PBYTE pbTheBuffer;  // filename/read buffer, used iff not multithreaded
+    PBYTE pbTheBuffer;  // filename/read buffer and hash contexts, used iff not multithreaded
+    PWHPIPELINE pPipeline = NULL;  // a thread per algorithm for large files, used iff not multithreaded
     if (! bMultithreaded)
     {
-        pbTheBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE);
+        pbTheBuffer = AllocWorkerBuffer();
         if (pbTheBuffer == NULL)
+        {
+            DeviceQueuesFree(pQueues);
             return;
+        }
+        pPipeline = CreateWorkerPipeline(phvctx->whctxFlags);
     }
 
     // Initialize the progress bar update synchronization vars
@@ -536,64 +639,63 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
     if (bMultithreaded)
         InitializeCriticalSection(&updateCritSec);
 
+#ifdef USE_PPL
+    // This thread's queues below run on a scheduler with just that many workers
+    if (bMultithreaded)
+        concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(1, concurrency::MaxConcurrency, cWorkers));
+#endif
+
 	// We need to keep track of the thread's execution time so that we can do a
 	// sound notification of completion when appropriate
 	phvctx->dwStarted = GetTickCount();
 
     class CanceledException {};
 
-    // concurrency::parallel_for_each(phvctx->index, phvctx->index + phvctx->cTotal, ...
-    auto per_file_worker = [&](PHASHVERIFYITEM pItem)
-	{
-        PBYTE pbBuffer;
+#pragma warning(push)
+#pragma warning(disable: 4700 4703)  // potentially uninitialized local pointer variable 'pbTheBuffer' used
+    auto get_worker_buffer = [&]() -> PBYTE
+    {
 #ifdef USE_PPL
         if (bMultithreaded)
         {
-            // Allocate or retrieve the already-allocated read buffer for the current thread
-            pbBuffer = (PBYTE)TlsGetValue(dwBufferTlsIndex);
+            // Allocate or retrieve the already-allocated worker buffer for the current thread
+            PBYTE pbBuffer = (PBYTE)TlsGetValue(dwBufferTlsIndex);
             if (pbBuffer == NULL)
             {
-                pbBuffer = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_COMMIT, PAGE_READWRITE);
+                pbBuffer = AllocWorkerBuffer();
                 if (pbBuffer == NULL)
                     throw CanceledException();
-                // Cache the read buffer for the current thread
+                // Cache the worker buffer for the current thread
                 vecBuffers.push_back(pbBuffer);
                 TlsSetValue(dwBufferTlsIndex, pbBuffer);
             }
+            return pbBuffer;
         }
-        else
 #endif
-            pbBuffer = pbTheBuffer;
+        return pbTheBuffer;
+    };
+#pragma warning(pop)
 
+    // ppo is the file, if it was opened ahead
+    auto hash_one_file = [&](PHASHVERIFYITEM pItem, PBYTE pbBuffer, PPREOPENED ppo, WHRESULTEX& whres)
+    {
 		// Part 1: Build the path
-		{
-			SIZE_T cchPrefix = cchPathPrefix;
-
-			// Do not use the prefix if pszDisplayName is an absolute path
-			if ( pItem->pszDisplayName[0] == TEXT('\\') ||
-			     pItem->pszDisplayName[1] == TEXT(':') )
-			{
-				cchPrefix = 0;
-			}
-
-			SSChainNCpy2(
-                (PTSTR)pbBuffer,
-				phvctx->pszPath, cchPrefix,
-				pItem->pszDisplayName, pItem->cchDisplayName
-			);
-		}
+        build_path(pItem, (PTSTR)pbBuffer);
 
 		// Part 2: Calculate the checksum(s)
-        WHCTXEX whctx;
-        WHRESULTEX whres;
-        whctx.dwFlags = phvctx->whctxFlags;
+        PWHCTXEX pwhctx = WorkerBufferContext(pbBuffer);
+        pwhctx->dwFlags = phvctx->whctxFlags;
         whres.dwFlags = 0;
+        whres.dwSlots = 0;  // room for every algorithm
 		WorkerThreadHashFile(
 			(PCOMMONCONTEXT)phvctx,
             (PTSTR)pbBuffer,
-			&whctx,
+            ppo,
+			pwhctx,
 			&whres,
             pbBuffer,
+            pPipeline,
+            NULL,  // block lists are made by HashSave
 			&pItem->filesize,
             pItem->nListviewIndex,
             bMultithreaded ? &updateCritSec : NULL, &cbCurrentMaxSize
@@ -601,7 +703,22 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
           , NULL
 #endif
         );
+    };
+
+    // Once a file has matched with one of several algorithms, the rest are
+    // most likely that one too, so only it is used from then on; worker
+    // threads may get here at once, so this only ever narrows the flags
+    auto narrow_flags = [&](DWORD dwMatched)
+    {
+        DWORD dwFlags = phvctx->whctxFlags;
 
+        while ( dwFlags != dwMatched && (dwFlags & dwMatched) == dwMatched &&
+                (DWORD)InterlockedCompareExchange((volatile LONG*)&phvctx->whctxFlags, dwMatched, dwFlags) != dwFlags )
+            dwFlags = phvctx->whctxFlags;
+    };
+
+    auto file_done = [&](PHASHVERIFYITEM pItem, WHRESULTEX& whres)
+    {
         if (phvctx->status == PAUSED)
             WaitForSingleObject(phvctx->hUnpauseEvent, INFINITE);
 		if (phvctx->status == CANCEL_REQUESTED)
@@ -612,6 +729,7 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
 		{
             UINT cHashes = 0;
             DWORD dwMatched = 0;
+            TCHAR szActual[MAX_DIGEST_STRING_LENGTH];
             PTSTR pszActual = NULL;
 
 #define HASH_VERIFY_ONE_HASH_op(alg)                                  \
@@ -620,7 +738,8 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
                 cHashes++;                                            \
                 if (! dwMatched)                                      \
                 {                                                     \
-                    pszActual = whres.szHex##alg;                     \
+                    WHResultToHex(&whres, alg, szActual);             \
+                    pszActual = szActual;                             \
                     if (StrCmpI(pItem->pszExpected, pszActual) == 0)  \
                         dwMatched = WHEX_CHECK##alg;                  \
                 }                                                     \
@@ -634,8 +753,8 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
                 pItem->uStatusID = HV_STATUS_MATCH;
                 
                 StringCbCopy(pItem->szActual, sizeof(pItem->szActual), pszActual);
-                if (cHashes > 1 && phvctx->whctxFlags != dwMatched)
-                    phvctx->whctxFlags = dwMatched;
+                if (cHashes > 1)
+                    narrow_flags(dwMatched);
             }
             else
             {
@@ -654,27 +773,194 @@ VOID __fastcall HashVerifyWorkerMain( PHASHVERIFYCONTEXT phvctx )
 		PostMessage(phvctx->hWnd, HM_WORKERTHREAD_UPDATE, (WPARAM)phvctx, (LPARAM)pItem);
     };
 
+    // A file with a block list is checked block by block (and, if this is the
+    // only file-hashing thread, on several threads) instead of being hashed
+    // whole, so that the damaged ranges, if any, can be shown; returns false
+    // if the list isn't usable, or the file has changed size, and it must be
+    // hashed after all
+    auto check_blocks = [&](PHASHVERIFYITEM pItem, PBYTE pbBuffer) -> bool
+    {
+        PBLOCKLIST pBlocks = pItem->pBlocks;
+
+        // The next lane's context is scratch for checking the list's root, which also
+        // ties it to the digest on the file's line
+        if (! (pBlocks && BlockListCheckRoot(pBlocks, phvctx->whctxFlags, pItem->pszExpected,
+                                             WorkerBufferContext(pbBuffer) + 1)))
+            return false;
+
+        build_path(pItem, (PTSTR)pbBuffer);
+        if (! WorkerThreadCheckBlocks((PCOMMONCONTEXT)phvctx, (PTSTR)pbBuffer, pBlocks, &pItem->filesize,
+                                      pItem->nListviewIndex, bMultithreaded ? &updateCritSec : NULL, &cbCurrentMaxSize))
+            return false;
+
+        if (phvctx->status == PAUSED)
+            WaitForSingleObject(phvctx->hUnpauseEvent, INFINITE);
+        if (phvctx->status == CANCEL_REQUESTED)
+            throw CanceledException();
+
+        // Every block matching is as good as the whole file matching (the file's own digest
+        // isn't computed, so there's no actual one to show, and none of the bad blocks either)
+        if (BlockListFormatBad(pBlocks, pItem->szActual, countof(pItem->szActual)) == 0)
+        {
+            pItem->uStatusID = HV_STATUS_MATCH;
+            narrow_flags(BlockListFlags(pBlocks));
+        }
+        else
+        {
+            pItem->uStatusID = HV_STATUS_MISMATCH;
+        }
+
+        ++phvctx->cSentMsgs;
+        PostMessage(phvctx->hWnd, HM_WORKERTHREAD_UPDATE, (WPARAM)phvctx, (LPARAM)pItem);
+        return true;
+    };
+
+    // pItem is checked on its own
+    auto per_file_worker = [&](PHASHVERIFYITEM pItem)
+	{
+        WHRESULTEX whres;
+        PBYTE pbBuffer = get_worker_buffer();
+        if (check_blocks(pItem, pbBuffer))
+            return;
+        hash_one_file(pItem, pbBuffer, NULL, whres);
+        file_done(pItem, whres);
+    };
+
+    // The cFiles items of piItems are hashed together; they're at iPos in their queue, whose
+    // files are opened ahead if pOpenAhead
+    auto per_batch_worker = [&](PSIZE_T piItems, UINT cFiles, POPENAHEAD pOpenAhead, SIZE_T iPos)
+    {
+        PBYTE pbBuffer = get_worker_buffer();
+        PHASHVERIFYITEM ppItems[WHEX_MAX_LANES];
+        UINT cbSlice = BATCH_SLICE_SIZE(cFiles), i;
+
+        PCTSTR ppszPaths[WHEX_MAX_LANES];
+        PPREOPENED pppo[WHEX_MAX_LANES];
+        PWHCTXEX ppwhctx[WHEX_MAX_LANES];
+        WHRESULTEX pwhres[WHEX_MAX_LANES];
+        PWHRESULTEX ppwhres[WHEX_MAX_LANES];
+        PFILESIZE ppFileSizes[WHEX_MAX_LANES];
+        BOOL pbBatched[WHEX_MAX_LANES];
+#ifdef _TIMED
+        PDWORD ppdwElapsed[WHEX_MAX_LANES];
+#endif
+        for (i = 0; i < cFiles; ++i)
+        {
+            ppItems[i] = phvctx->index[piItems[i]];
+            // Each path is built in the slice of the buffer that its file's data will be read into
+            build_path(ppItems[i], (PTSTR)(pbBuffer + i * cbSlice));
+            ppszPaths[i] = (PTSTR)(pbBuffer + i * cbSlice);
+            pppo[i] = pOpenAhead ? OpenAheadTake(pOpenAhead, iPos + i) : NULL;
+            ppwhctx[i] = WorkerBufferContext(pbBuffer) + i;
+            ppwhctx[i]->dwFlags = phvctx->whctxFlags;
+            pwhres[i].dwFlags = 0;
+            pwhres[i].dwSlots = 0;
+            ppwhres[i] = &pwhres[i];
+            ppFileSizes[i] = &ppItems[i]->filesize;
+#ifdef _TIMED
+            ppdwElapsed[i] = NULL;
+#endif
+        }
+
+        WorkerThreadHashFiles((PCOMMONCONTEXT)phvctx, cFiles, ppszPaths, pppo, ppwhctx, ppwhres, pbBuffer, ppFileSizes, pbBatched
+#ifdef _TIMED
+                            , ppdwElapsed
+#endif
+        );
+
+        // Any files too large to batch are hashed on their own
+        for (i = 0; i < cFiles; ++i)
+        {
+            if (! pbBatched[i])
+            {
+                if (check_blocks(ppItems[i], pbBuffer))
+                    continue;
+                hash_one_file(ppItems[i], pbBuffer, pppo[i], pwhres[i]);
+            }
+            file_done(ppItems[i], pwhres[i]);
+        }
+
+        if (pOpenAhead)
+            OpenAheadRelease(pOpenAhead, iPos + cFiles);
+    };
+
+    // One of a queue's workers, which takes its files a batch (or one) at a time until there
+    // are none left; a queue's only worker also has the next few files opened (and their first
+    // buffer read) while each batch is hashed, rather than one by one as it starts
+    auto queue_worker = [&](PDEVICEQUEUE pQueue)
+    {
+        auto open_ahead_path = [&](SIZE_T iPos, PTSTR pszPath)
+        {
+            build_path(phvctx->index[pQueue->piItems[iPos]], pszPath);
+        };
+        POPENAHEAD pOpenAhead = NULL;
+        if (pQueue->cDepth == 1 && pQueue->cLanes)
+        {
+            pOpenAhead = OpenAheadCreate(pQueue->cItems, [](PVOID pvPath, SIZE_T iPos, PTSTR pszPath)
+            {
+                (*(decltype(open_ahead_path)*)pvPath)(iPos, pszPath);
+            }, &open_ahead_path);
+        }
+
+        try
+        {
+            SIZE_T iPos;
+            UINT cFiles;
+            while ((cFiles = DeviceQueueTake(pQueue, max(pQueue->cLanes, 1u), &iPos)) > 0)
+            {
+                if (pQueue->cLanes)
+                    per_batch_worker(pQueue->piItems + iPos, cFiles, pOpenAhead, iPos);
+                else
+                    per_file_worker(phvctx->index[pQueue->piItems[iPos]]);
+            }
+        }
+        catch (CanceledException)
+        {
+            OpenAheadDestroy(pOpenAhead);
+            throw;
+        }
+
+        OpenAheadDestroy(pOpenAhead);
+    };
+
     try
     {
 #ifdef USE_PPL
         if (bMultithreaded)
-            concurrency::parallel_for_each(phvctx->index, phvctx->index + phvctx->cTotal, per_file_worker);
+        {
+            // Every queue's workers at once
+            concurrency::task_group tasks;
+            for (UINT iQueue = 0; iQueue < pQueues->cQueues; ++iQueue)
+            {
+                for (UINT iWorker = 0; iWorker < pQueues->pQueues[iQueue].cDepth; ++iWorker)
+                    tasks.run([&, iQueue] { queue_worker(&pQueues->pQueues[iQueue]); });
+            }
+            tasks.wait();
+        }
         else
 #endif
-            std::for_each(phvctx->index, phvctx->index + phvctx->cTotal, per_file_worker);
+            for (UINT iQueue = 0; iQueue < pQueues->cQueues; ++iQueue)
+                queue_worker(&pQueues->pQueues[iQueue]);
     }
     catch (CanceledException) {}  // ignore cancellation requests
 
+    DeviceQueuesFree(pQueues);
+
 #ifdef USE_PPL
     if (bMultithreaded)
     {
+        concurrency::CurrentScheduler::Detach();
         for (void* pBuffer : vecBuffers)
-            VirtualFree(pBuffer, 0, MEM_RELEASE);
+            FreeWorkerBuffer(pBuffer);
         DeleteCriticalSection(&updateCritSec);
     }
     else
 #endif
-        VirtualFree(pbTheBuffer, 0, MEM_RELEASE);
+    {
+        if (pPipeline)
+            WHPipelineDestroy(pPipeline);
+        FreeWorkerBuffer(pbTheBuffer);
+    }
 
 	// Play a sound to signal the normal, successful termination of operations,
 	// but exempt operations that were nearly instantaneous
@@ -840,6 +1126,13 @@ INT_PTR CALLBACK HashVerifyDlgProc( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
 			return(TRUE);
 		}
 
+		case HM_WORKERTHREAD_TOGGLEPREP:
+		{
+			phvctx = (PHASHVERIFYCONTEXT)wParam;
+			SetProgressBarMarquee((PCOMMONCONTEXT)phvctx, (BOOL)lParam, phvctx->cTotal);
+			return(TRUE);
+		}
+
 		case HM_WORKERTHREAD_SETSIZE:
 		{
 			phvctx = (PHASHVERIFYCONTEXT)wParam;
@@ -14,21 +14,148 @@
 #include "libs/SimpleString.h"
 #include <Strsafe.h>
 
-// Tries to determine if the given file is stored on an SSD or other
-// device with a fast seek time; errs on the side of not-on-an-SSD
-BOOL IsSSD(LPCWCH lpszPath)
+// What the volumes seen recently were found to be on, and until when that holds
+typedef struct {
+    DWORD dwVolumeID;      // HashMountPoint() of the volume's root (0: an unused slot)
+    DWORD dwDeviceID;
+    UINT uClass;
+    BOOL bMeasured;        // uClass is from ProbeDeviceClass, not the drive's seek penalty
+    BOOL bSeekPenalty;     // the drive reports a seek penalty
+    BOOL bProbing;         // a probe of the volume is under way
+    ULONGLONG ullExpires;  // GetTickCount64() after which the volume is looked at afresh
+} DEVICECLASSCACHE, *PDEVICECLASSCACHE;
+
+static DEVICECLASSCACHE s_aCache[DEVICE_CLASS_CACHE_SIZE];
+static SRWLOCK s_srwCache = SRWLOCK_INIT;
+
+// Tells apart volumes that aren't on a (known) physical drive by a hash of their root
+static DWORD HashMountPoint(PCTSTR pszMountPoint)
 {
-#ifdef FORCE_PPL
-    return(TRUE);
-#endif
-    TCHAR szMountPoint[MAX_PATH];
-    if (! GetVolumePathName(lpszPath, szMountPoint, MAX_PATH))
+    DWORD dwHash = 2166136261;  // FNV-1a
+    for ( ; *pszMountPoint; ++pszMountPoint)
+        dwHash = (dwHash ^ (DWORD)(ULONG_PTR)CharUpper((PTSTR)(ULONG_PTR)*pszMountPoint)) * 16777619;
+    return(dwHash & ~(DEVICE_ID_REMOTE | DEVICE_ID_VOLUME));
+}
+
+// Issues a probe read at each of the cReads offsets in pibOffsets, either all at once
+// or one at a time, and returns how long they took (in performance counter ticks),
+// or 0 if any failed
+static ULONGLONG ProbeReads(HANDLE hFile, PBYTE pbBuffer, PHANDLE phEvents,
+                            const ULONGLONG *pibOffsets, UINT cReads, BOOL bAtOnce)
+{
+    OVERLAPPED aov[DEVICE_PROBE_READS];
+    LARGE_INTEGER liStart, liEnd;
+    BOOL bFailed = FALSE;
+    UINT cIssued = 0, i;
+
+    QueryPerformanceCounter(&liStart);
+    while (cIssued < cReads && ! bFailed)
+    {
+        // Issue the next read (or all of them), then wait for whatever was issued
+        for (i = cIssued; i < cReads && (bAtOnce || i == cIssued); ++i)
+        {
+            ZeroMemory(&aov[i], sizeof(aov[i]));
+            aov[i].Offset = (DWORD)pibOffsets[i];
+            aov[i].OffsetHigh = (DWORD)(pibOffsets[i] >> 32);
+            aov[i].hEvent = phEvents[i];
+            if (! ReadFile(hFile, pbBuffer + i * DEVICE_PROBE_READ_SIZE, DEVICE_PROBE_READ_SIZE, NULL, &aov[i]) &&
+                GetLastError() != ERROR_IO_PENDING)
+            {
+                bFailed = TRUE;
+                break;
+            }
+        }
+        for ( ; cIssued < i; ++cIssued)
+        {
+            DWORD cbRead;
+            if (! GetOverlappedResult(hFile, &aov[cIssued], &cbRead, TRUE) || cbRead != DEVICE_PROBE_READ_SIZE)
+                bFailed = TRUE;
+        }
+    }
+    QueryPerformanceCounter(&liEnd);
+
+    return(bFailed ? 0 : max(liEnd.QuadPart - liStart.QuadPart, 1));
+}
+
+// Measures how the device under the given file behaves rather than asking it: a few
+// small unbuffered reads at random offsets, first one at a time and then all at once,
+// show whether it seeks quickly or, failing that, whether it serves reads in parallel
+// (as RAID sets, SANs and many virtual disks do); the latter only counts if the drive
+// doesn't report a seek penalty, since a lone hard drive's command queueing can also
+// serve a batch of reads faster than one at a time by reordering them;
+// returns FALSE if the file is too short to tell anything from, or can't be read
+static BOOL ProbeDeviceClass(LPCWCH lpszPath, BOOL bSeekPenalty, PUINT puClass)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (! GetFileAttributesEx(lpszPath, GetFileExInfoStandard, &fad) ||
+        ((ULONGLONG)fad.nFileSizeHigh << 32 | fad.nFileSizeLow) < DEVICE_PROBE_MIN_SIZE)
         return(FALSE);
 
-    TCHAR szVolumeGUID[MAX_PATH];
-    if (! GetVolumeNameForVolumeMountPoint(szMountPoint, szVolumeGUID, MAX_PATH))
+    HANDLE hFile = CreateFile(
+        lpszPath,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING | FILE_FLAG_RANDOM_ACCESS,
+        NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
         return(FALSE);
 
+    LARGE_INTEGER liFreq, liSize;
+    PBYTE pbBuffer = NULL;
+    HANDLE ahEvents[DEVICE_PROBE_READS];
+    UINT cEvents, i;
+    BOOL bProbed = FALSE;
+
+    for (cEvents = 0; cEvents < DEVICE_PROBE_READS; ++cEvents)
+        if (! (ahEvents[cEvents] = CreateEvent(NULL, TRUE, FALSE, NULL)))
+            break;
+
+    if ( cEvents == DEVICE_PROBE_READS && QueryPerformanceFrequency(&liFreq) &&
+         GetFileSizeEx(hFile, &liSize) && (ULONGLONG)liSize.QuadPart >= DEVICE_PROBE_MIN_SIZE &&
+         (pbBuffer = (PBYTE)VirtualAlloc(NULL, DEVICE_PROBE_READS * DEVICE_PROBE_READ_SIZE, MEM_COMMIT, PAGE_READWRITE)) )
+    {
+        // Distinct offsets for the two rounds, so that the second isn't served from any
+        // cache on the device that the first filled
+        ULONGLONG aibOffsets[2 * DEVICE_PROBE_READS];
+        ULONGLONG cSlots = liSize.QuadPart / DEVICE_PROBE_READ_SIZE;
+        ULONGLONG ullRandom = liFreq.QuadPart ^ GetTickCount64() ^ (ULONG_PTR)hFile;
+        for (i = 0; i < 2 * DEVICE_PROBE_READS; ++i)
+        {
+            ullRandom = ullRandom * 6364136223846793005 + 1442695040888963407;  // MMIX LCG
+            aibOffsets[i] = (ullRandom >> 16) % cSlots * DEVICE_PROBE_READ_SIZE;
+        }
+
+        ULONGLONG ullOneAtATime = ProbeReads(hFile, pbBuffer, ahEvents, aibOffsets, DEVICE_PROBE_READS, FALSE);
+        ULONGLONG ullAllAtOnce = ProbeReads(hFile, pbBuffer, ahEvents, aibOffsets + DEVICE_PROBE_READS, DEVICE_PROBE_READS, TRUE);
+        if (ullOneAtATime && ullAllAtOnce)
+        {
+            BOOL bFastSeeks = ullOneAtATime * 1000000 < (ULONGLONG)DEVICE_PROBE_FAST_US * DEVICE_PROBE_READS * liFreq.QuadPart;
+            BOOL bParallel = ullOneAtATime >= ullAllAtOnce * DEVICE_PROBE_SPEEDUP;
+            *puClass = bFastSeeks || (bParallel && ! bSeekPenalty) ? DEVICE_CLASS_SSD : DEVICE_CLASS_HDD;
+            bProbed = TRUE;
+        }
+
+        VirtualFree(pbBuffer, 0, MEM_RELEASE);
+    }
+
+    while (cEvents)
+        CloseHandle(ahEvents[--cEvents]);
+    CloseHandle(hFile);
+    return(bProbed);
+}
+
+// Looks up what a local volume is on: its physical drive's number (else the given
+// ID is left as is), and whether that drive reports a seek penalty
+static UINT QueryDeviceClass(PCTSTR pszMountPoint, PDWORD pdwDeviceID, PBOOL pbSeekPenalty)
+{
+    *pbSeekPenalty = FALSE;
+
+    TCHAR szVolumeGUID[MAX_PATH];
+    if (! GetVolumeNameForVolumeMountPoint(pszMountPoint, szVolumeGUID, MAX_PATH))
+        return(DEVICE_CLASS_HDD);
+
     // Remove any trailing backslash
     size_t cchVolumeGUIDLen;
     StringCchLength(szVolumeGUID, MAX_PATH, &cchVolumeGUIDLen);
@@ -44,7 +171,7 @@ BOOL IsSSD(LPCWCH lpszPath)
         FILE_ATTRIBUTE_NORMAL,
         NULL);
     if (hVolume == INVALID_HANDLE_VALUE)
-        return(FALSE);
+        return(DEVICE_CLASS_HDD);
 
     // There could be multiple extents on which this path resides; this checks only the first
     VOLUME_DISK_EXTENTS vde;
@@ -60,10 +187,11 @@ BOOL IsSSD(LPCWCH lpszPath)
           NULL))
     {
         CloseHandle(hVolume);
-        return(FALSE);
+        return(DEVICE_CLASS_HDD);
     }
 
     CloseHandle(hVolume);
+    *pdwDeviceID = vde.Extents[0].DiskNumber;
 
     TCHAR szPhysicalDrivePath[MAX_PATH];
     static const TCHAR szPhysicalDrivePrefix[] = TEXT("\\\\.\\PhysicalDrive");
@@ -84,7 +212,7 @@ BOOL IsSSD(LPCWCH lpszPath)
         FILE_ATTRIBUTE_NORMAL,
         NULL);
     if (hPhysicalDrive == INVALID_HANDLE_VALUE)
-        return FALSE;
+        return(DEVICE_CLASS_HDD);
 
     STORAGE_PROPERTY_QUERY spq;
     spq.PropertyId = StorageDeviceSeekPenaltyProperty;
@@ -101,10 +229,115 @@ BOOL IsSSD(LPCWCH lpszPath)
           NULL))
     {
         CloseHandle(hPhysicalDrive);
-        return(FALSE);
+        return(DEVICE_CLASS_HDD);
     }
 
     CloseHandle(hPhysicalDrive);
 
-    return(dspd.IncursSeekPenalty ? FALSE : TRUE);
+    *pbSeekPenalty = dspd.IncursSeekPenalty;
+    return(dspd.IncursSeekPenalty ? DEVICE_CLASS_HDD : DEVICE_CLASS_SSD);
+}
+
+// Tries to determine what kind of device the given file is stored on (a
+// network share, or a local drive with or without a seek penalty), and which
+// one: its physical drive number, or else an ID made from its volume's root;
+// errs on the side of a rotational drive. A local volume's class is measured
+// when a file on it long enough to probe comes along (until then, it's what
+// the drive reports), and either is remembered for DEVICE_CLASS_CACHE_TTL
+UINT GetDeviceClass(LPCWCH lpszPath, PDWORD pdwDeviceID)
+{
+    DWORD dwDeviceID;
+    if (pdwDeviceID == NULL)
+        pdwDeviceID = &dwDeviceID;
+    *pdwDeviceID = DEVICE_ID_VOLUME;
+
+#ifdef FORCE_PPL
+    return(DEVICE_CLASS_SSD);
+#endif
+    TCHAR szMountPoint[MAX_PATH];
+    if (! GetVolumePathName(lpszPath, szMountPoint, MAX_PATH))
+        return(DEVICE_CLASS_HDD);
+
+    // A network share, whether by UNC path or mapped drive, is its own device
+    if (PathIsUNC(szMountPoint) || GetDriveType(szMountPoint) == DRIVE_REMOTE)
+    {
+        *pdwDeviceID = DEVICE_ID_REMOTE | HashMountPoint(szMountPoint);
+        return(DEVICE_CLASS_REMOTE);
+    }
+
+    DWORD dwVolumeID = HashMountPoint(szMountPoint) | DEVICE_ID_VOLUME;
+    ULONGLONG ullNow = GetTickCount64();
+    PDEVICECLASSCACHE pEntry = NULL, pOldest = NULL;
+    UINT uClass = DEVICE_CLASS_HDD, i;
+    BOOL bKnown = FALSE, bProbe = FALSE, bSeekPenalty = FALSE;
+
+    // Is the volume known, and if it's yet to be measured, is anyone measuring it?
+    // Whoever is to measure it claims its entry first, so that meanwhile the others
+    // make do with what the drive reports instead of probing the volume as well
+    AcquireSRWLockExclusive(&s_srwCache);
+    for (i = 0; i < DEVICE_CLASS_CACHE_SIZE; ++i)
+    {
+        if (s_aCache[i].dwVolumeID == dwVolumeID)
+            pEntry = &s_aCache[i];
+        else if (! s_aCache[i].bProbing && (! pOldest || s_aCache[i].ullExpires < pOldest->ullExpires))
+            pOldest = &s_aCache[i];
+    }
+    if (pEntry && ullNow < pEntry->ullExpires)
+    {
+        bKnown = TRUE;
+        *pdwDeviceID = pEntry->dwDeviceID;
+        uClass = pEntry->uClass;
+        bSeekPenalty = pEntry->bSeekPenalty;
+        if (! pEntry->bMeasured && ! pEntry->bProbing)
+            bProbe = pEntry->bProbing = TRUE;
+    }
+    else if (pEntry && pEntry->bProbing)
+    {
+        // Another thread is looking at the volume for the first time
+        pEntry = NULL;
+    }
+    else if (pEntry || (pEntry = pOldest))
+    {
+        // Take over the volume's expired entry, if it had one, else the stalest; it
+        // holds nothing worth reading until the probe below fills it in
+        pEntry->dwVolumeID = dwVolumeID;
+        pEntry->bMeasured = FALSE;
+        pEntry->ullExpires = 0;
+        bProbe = pEntry->bProbing = TRUE;
+    }
+    ReleaseSRWLockExclusive(&s_srwCache);
+
+    if (bKnown && ! bProbe)
+        return(uClass);
+
+    if (! bKnown)
+    {
+        *pdwDeviceID = dwVolumeID;
+        uClass = QueryDeviceClass(szMountPoint, pdwDeviceID, &bSeekPenalty);
+        if (! bProbe)
+            return(uClass);
+    }
+    BOOL bMeasured = ProbeDeviceClass(lpszPath, bSeekPenalty, &uClass);
+
+    // No other thread takes over an entry while it's being probed
+    AcquireSRWLockExclusive(&s_srwCache);
+    pEntry->dwDeviceID = *pdwDeviceID;
+    pEntry->uClass = uClass;
+    pEntry->bSeekPenalty = bSeekPenalty;
+    pEntry->bProbing = FALSE;
+    if (! bKnown || bMeasured)
+    {
+        pEntry->bMeasured = bMeasured;
+        pEntry->ullExpires = GetTickCount64() + DEVICE_CLASS_CACHE_TTL;
+    }
+    ReleaseSRWLockExclusive(&s_srwCache);
+
+    return(uClass);
+}
+
+// Tries to determine if the given file is stored on an SSD or other
+// device with a fast seek time; errs on the side of not-on-an-SSD
+BOOL IsSSD(LPCWCH lpszPath)
+{
+    return(GetDeviceClass(lpszPath, NULL) == DEVICE_CLASS_SSD);
 }
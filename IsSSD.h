@@ -15,6 +15,28 @@ extern "C" {
 
 #include <windows.h>
 
+// Device classes, and the device IDs of volumes that aren't on a known physical drive
+#define DEVICE_CLASS_HDD     0  // a drive with a seek penalty, or anything unknown
+#define DEVICE_CLASS_SSD     1
+#define DEVICE_CLASS_REMOTE  2  // a network share
+#define DEVICE_ID_REMOTE     0x80000000
+#define DEVICE_ID_VOLUME     0x40000000
+
+// How long what a volume is on is remembered for, and for how many volumes at once
+#define DEVICE_CLASS_CACHE_TTL   600000  // 10 minutes
+#define DEVICE_CLASS_CACHE_SIZE  16
+
+// A volume is probed with this many unbuffered reads of this size, at random offsets in a
+// file at least this long; it's taken to be SSD-like if the reads take under DEVICE_PROBE_FAST_US
+// apiece one at a time, or (unless its drive reports a seek penalty) if all at once they're
+// DEVICE_PROBE_SPEEDUP times faster than that
+#define DEVICE_PROBE_READS      8
+#define DEVICE_PROBE_READ_SIZE  0x1000
+#define DEVICE_PROBE_MIN_SIZE   0x1000000  // 16 MiB
+#define DEVICE_PROBE_FAST_US    1000
+#define DEVICE_PROBE_SPEEDUP    2
+
+UINT GetDeviceClass(LPCWCH lpszPath, PDWORD pdwDeviceID);
 BOOL IsSSD(LPCWCH lpszPath);
 
 #ifdef __cplusplus
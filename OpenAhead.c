@@ -0,0 +1,212 @@
+/**
+ * Opening files ahead of their hashing
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ *
+ * On a network share, or an encrypted or rotational volume, opening a file,
+ * getting its size and reading its first buffer can take milliseconds, which
+ * a lone file-hashing thread would spend idle, once per file.  So when there
+ * is just the one, the next few files are opened, and their first buffer read
+ * (which is all of a small file), on the system thread pool while the current
+ * one is hashed, and handed to WorkerThreadHashFile (or WorkerThreadHashFiles)
+ * ready to go.  How many are opened ahead follows how long an open takes over
+ * how long a file takes to hash, each a moving average, so that the next file
+ * is just ready when it's wanted: one or two for a local disk, up to
+ * OPENAHEAD_MAX_AHEAD for a slow share.
+ *
+ * Files must be taken, and released, in order, by one thread.
+ **/
+
+#include "globals.h"
+#include "HashCheckCommon.h"
+#include "OpenAhead.h"
+
+typedef struct {
+	PREOPENED          po;           // what the consumer is handed (pbFirst is allocated on first use)
+	HANDLE             hDone;        // set once po is ready
+	LONGLONG           llLatency;    // how long the open and first read took, in QPC ticks
+	TCHAR              szPath[MAX_PATH_BUFFER];
+} OPENAHEADSLOT, *POPENAHEADSLOT;
+
+struct OPENAHEAD {
+	SIZE_T             cItems;       // items to be hashed, in all
+	PFNITEMPATH        pfnPath;
+	PVOID              pvContext;
+	SIZE_T             iReleased;    // items before this are done with (and closed)
+	SIZE_T             iTaken;       // items before this have been taken
+	SIZE_T             iSubmitted;   // items before this have been (or are being) opened
+	UINT               cAhead;       // how many to open ahead of the last taken
+	LONGLONG           llOpen;       // moving average of the open latency
+	LONGLONG           llHash;       // moving average of the time between releases, per item
+	LONGLONG           llLastRelease;
+	OPENAHEADSLOT      slots[OPENAHEAD_SLOTS];  // item i is in slot i % OPENAHEAD_SLOTS
+};
+
+#define OpenAheadSlot(poa, i)  (&(poa)->slots[(i) % OPENAHEAD_SLOTS])
+
+static __inline LONGLONG QPC( )
+{
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	return(li.QuadPart);
+}
+
+// Weighs the latest sample a quarter, or all if it's the first
+static __inline LONGLONG MovingAverage( LONGLONG llAverage, LONGLONG llSample )
+{
+	return(llAverage ? llAverage + (llSample - llAverage) / 4 : llSample);
+}
+
+VOID CALLBACK OpenAheadWork( PTP_CALLBACK_INSTANCE pInstance, PVOID pvSlot )
+{
+	POPENAHEADSLOT pSlot = (POPENAHEADSLOT)pvSlot;
+	PPREOPENED ppo = &pSlot->po;
+	LONGLONG llStarted = QPC();
+
+	ppo->cbFirst = 0;
+
+	if ((ppo->hFile = OpenFileForReading(pSlot->szPath)) != INVALID_HANDLE_VALUE)
+	{
+		if (! GetFileSizeEx(ppo->hFile, (PLARGE_INTEGER)&ppo->cbFileSize))
+		{
+			CloseHandle(ppo->hFile);
+			ppo->hFile = INVALID_HANDLE_VALUE;
+		}
+		else if (! ReadFile(ppo->hFile, ppo->pbFirst, READ_BUFFER_SIZE, &ppo->cbFirst, NULL))
+			ppo->cbFirst = 0;
+	}
+
+	pSlot->llLatency = QPC() - llStarted;
+	SetEvent(pSlot->hDone);
+}
+
+// Starts opening as many more items as are wanted ahead, and there are free slots for
+static VOID WINAPI OpenAheadSubmit( POPENAHEAD poa )
+{
+	while ( poa->iSubmitted < poa->cItems && poa->iSubmitted < poa->iTaken + poa->cAhead &&
+	        poa->iSubmitted < poa->iReleased + OPENAHEAD_SLOTS )
+	{
+		POPENAHEADSLOT pSlot = OpenAheadSlot(poa, poa->iSubmitted);
+
+		if (pSlot->po.pbFirst == NULL)
+		{
+			pSlot->po.pbFirst = (PBYTE)VirtualAlloc(NULL, READ_BUFFER_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (pSlot->po.pbFirst == NULL)
+				break;
+		}
+
+		poa->pfnPath(poa->pvContext, poa->iSubmitted, pSlot->szPath);
+		ResetEvent(pSlot->hDone);
+
+		// If the thread pool won't take it, it's opened right away
+		if (! TrySubmitThreadpoolCallback(OpenAheadWork, pSlot, NULL))
+			OpenAheadWork(NULL, pSlot);
+
+		++poa->iSubmitted;
+	}
+}
+
+POPENAHEAD WINAPI OpenAheadCreate( SIZE_T cItems, PFNITEMPATH pfnPath, PVOID pvContext )
+{
+	POPENAHEAD poa = (POPENAHEAD)calloc(1, sizeof(struct OPENAHEAD));
+	UINT i;
+
+	if (poa == NULL)
+		return(NULL);
+
+	for (i = 0; i < OPENAHEAD_SLOTS; ++i)
+	{
+		if (! (poa->slots[i].hDone = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		{
+			OpenAheadDestroy(poa);
+			return(NULL);
+		}
+	}
+
+	poa->cItems = cItems;
+	poa->pfnPath = pfnPath;
+	poa->pvContext = pvContext;
+	poa->cAhead = 2;
+	poa->llLastRelease = QPC();
+
+	OpenAheadSubmit(poa);
+	return(poa);
+}
+
+// Waits for item iItem to be opened and returns it, or returns NULL if it isn't being
+// opened ahead (and the caller should open it itself); it stays valid until released
+PPREOPENED WINAPI OpenAheadTake( POPENAHEAD poa, SIZE_T iItem )
+{
+	POPENAHEADSLOT pSlot = OpenAheadSlot(poa, iItem);
+
+	if (iItem != poa->iTaken)
+		return(NULL);
+
+	poa->iTaken = iItem + 1;
+	OpenAheadSubmit(poa);
+
+	if (iItem >= poa->iSubmitted)
+		return(NULL);
+
+	WaitForSingleObject(pSlot->hDone, INFINITE);
+	poa->llOpen = MovingAverage(poa->llOpen, pSlot->llLatency);
+	return(&pSlot->po);
+}
+
+// Closes the items before iEnd, which the caller is done with, and opens ahead as
+// many files as the time it's taking to hash each warrants
+VOID WINAPI OpenAheadRelease( POPENAHEAD poa, SIZE_T iEnd )
+{
+	LONGLONG llNow = QPC();
+	SIZE_T cReleased;
+
+	iEnd = min(iEnd, poa->iTaken);
+	if (iEnd <= poa->iReleased)
+		return;
+
+	for (cReleased = iEnd - poa->iReleased; poa->iReleased < iEnd; ++poa->iReleased)
+	{
+		POPENAHEADSLOT pSlot = OpenAheadSlot(poa, poa->iReleased);
+		if (pSlot->po.hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(pSlot->po.hFile);
+	}
+
+	poa->llHash = MovingAverage(poa->llHash, (llNow - poa->llLastRelease) / (LONGLONG)cReleased);
+	poa->llLastRelease = llNow;
+
+	// Enough to cover an open with the files hashed meanwhile, plus one in hand
+	poa->cAhead = (poa->llHash > 0) ?
+		(UINT)min((poa->llOpen + poa->llHash - 1) / poa->llHash + 1, OPENAHEAD_MAX_AHEAD) :
+		OPENAHEAD_MAX_AHEAD;
+
+	OpenAheadSubmit(poa);
+}
+
+// Waits for any opens still in flight, and closes whatever wasn't released
+VOID WINAPI OpenAheadDestroy( POPENAHEAD poa )
+{
+	UINT i;
+
+	if (poa == NULL)
+		return;
+
+	for ( ; poa->iTaken < poa->iSubmitted; ++poa->iTaken)
+		WaitForSingleObject(OpenAheadSlot(poa, poa->iTaken)->hDone, INFINITE);
+
+	for ( ; poa->iReleased < poa->iSubmitted; ++poa->iReleased)
+	{
+		POPENAHEADSLOT pSlot = OpenAheadSlot(poa, poa->iReleased);
+		if (pSlot->po.hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(pSlot->po.hFile);
+	}
+
+	for (i = 0; i < OPENAHEAD_SLOTS; ++i)
+	{
+		if (poa->slots[i].hDone)
+			CloseHandle(poa->slots[i].hDone);
+		if (poa->slots[i].po.pbFirst)
+			VirtualFree(poa->slots[i].po.pbFirst, 0, MEM_RELEASE);
+	}
+
+	free(poa);
+}
@@ -0,0 +1,43 @@
+/**
+ * Opening files ahead of their hashing
+ * Please refer to readme.txt for information about this source code.
+ * Please refer to license.txt for details about distribution and modification.
+ **/
+
+#ifndef __OPENAHEAD_H__
+#define __OPENAHEAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <windows.h>
+
+// At most this many files are opened ahead of the one being hashed, and this many
+// can be open at once in all (those being hashed, a batch's worth, included)
+#define OPENAHEAD_MAX_AHEAD  16
+#define OPENAHEAD_SLOTS      32
+
+// A file opened ahead, with its first READ_BUFFER_SIZE (or all of it) read already
+typedef struct {
+	HANDLE hFile;          // INVALID_HANDLE_VALUE if it couldn't be opened
+	ULONGLONG cbFileSize;  // its size when opened
+	PBYTE pbFirst;         // the start of the file
+	DWORD cbFirst;         // bytes of it read (fewer than asked for if the read failed)
+} PREOPENED, *PPREOPENED;
+
+typedef struct OPENAHEAD *POPENAHEAD;
+
+// Writes the path of item iItem (of those being hashed) to pszPath (of MAX_PATH_BUFFER)
+typedef VOID (CALLBACK *PFNITEMPATH)( PVOID pvContext, SIZE_T iItem, PTSTR pszPath );
+
+POPENAHEAD WINAPI OpenAheadCreate( SIZE_T cItems, PFNITEMPATH pfnPath, PVOID pvContext );
+PPREOPENED WINAPI OpenAheadTake( POPENAHEAD poa, SIZE_T iItem );
+VOID WINAPI OpenAheadRelease( POPENAHEAD poa, SIZE_T iEnd );
+VOID WINAPI OpenAheadDestroy( POPENAHEAD poa );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
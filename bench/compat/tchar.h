@@ -0,0 +1,15 @@
+/**
+ * <tchar.h> for the bench/compat build: TCHAR is always char here, as in an
+ * ANSI build of HashCheck
+ **/
+
+#ifndef __BENCH_COMPAT_TCHAR_H__
+#define __BENCH_COMPAT_TCHAR_H__
+
+typedef char TCHAR, *PTSTR, *LPTSTR;
+typedef const char *PCTSTR, *LPCTSTR;
+
+#define _T(x) x
+#define TEXT(x) x
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Just enough of <windows.h> to build WinHash.cpp, WinHashPipeline.cpp and
+ * the benchmarks with GCC or Clang on Linux (add -Ibench/compat); none of
+ * HashCheck proper builds against this.
+ **/
+
+#ifndef __BENCH_COMPAT_WINDOWS_H__
+#define __BENCH_COMPAT_WINDOWS_H__
+
+#if defined(_WIN32)
+#error "bench/compat is only for non-Windows builds"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t BYTE, *PBYTE;
+typedef uint8_t UINT8;
+typedef uint16_t WORD, UINT16;
+typedef uint32_t DWORD, *PDWORD;
+typedef uint32_t UINT32;
+typedef unsigned int UINT, *PUINT;
+typedef int32_t LONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG, *PULONGLONG, UINT64;
+typedef int BOOL;
+typedef void VOID, *PVOID;
+
+#define CONST const
+#define TRUE  1
+#define FALSE 0
+
+#define WINAPI
+#define __fastcall
+#define __forceinline inline __attribute__((always_inline))
+#define __inline inline
+
+// Only __declspec(align(n)) is used
+#define __declspec(x) __declspec_##x
+#define __declspec_align(n) __attribute__((aligned(n)))
+
+#define LOBYTE(w) ((BYTE)(w))
+#define HIBYTE(w) ((BYTE)((w) >> 8))
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+
+static inline LONG InterlockedIncrement( volatile LONG *p )
+{
+	return(__sync_add_and_fetch(p, 1));
+}
+
+static inline LONG InterlockedExchange( volatile LONG *p, LONG lValue )
+{
+	return(__sync_lock_test_and_set(p, lValue));
+}
+
+static inline LONG InterlockedCompareExchange( volatile LONG *p, LONG lExchange, LONG lComparand )
+{
+	return(__sync_val_compare_and_swap(p, lComparand, lExchange));
+}
+
+static inline PVOID InterlockedCompareExchangePointer( PVOID volatile *p, PVOID pvExchange, PVOID pvComparand )
+{
+	return(__sync_val_compare_and_swap(p, pvComparand, pvExchange));
+}
+
+#endif
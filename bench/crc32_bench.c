@@ -0,0 +1,135 @@
+/**
+ * CRC-32 kernel throughput benchmark
+ *
+ * Times crc32() and crc32c() with each runtime-dispatched kernel forced in
+ * turn, over buffer sizes from 64 bytes up to READ_BUFFER_SIZE, after checking
+ * that all of the kernels agree with the portable one (and, for CRC-32C, with
+ * the standard check value).
+ *
+ * Build (from the repository root) with MSVC:
+ *   cl /O2 /DCRC32_TESTING /Ilibs bench\crc32_bench.c libs\crc32.c libs\crc32_pclmul.c libs\crc32_avx512.c
+ *      libs\crc32c.c libs\crc32c_sse42.c
+ * or with GCC/Clang, where the kernels need their ISA flags:
+ *   cc -O2 -c -msse4.1 -mpclmul libs/crc32_pclmul.c
+ *   cc -O2 -c -msse4.1 -mpclmul -mavx512f -mvpclmulqdq libs/crc32_avx512.c
+ *   cc -O2 -c -msse4.2 libs/crc32c_sse42.c
+ *   cc -O2 -DCRC32_TESTING -Ilibs bench/crc32_bench.c libs/crc32.c libs/crc32c.c
+ *      crc32_pclmul.o crc32_avx512.o crc32c_sse42.o
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc32_impl.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+static double now_seconds( void )
+{
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter(&t);
+	QueryPerformanceFrequency(&f);
+	return((double)t.QuadPart / (double)f.QuadPart);
+}
+#else
+#include <time.h>
+static double now_seconds( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+#endif
+
+extern enum crc32_cpu_feature g_crc32_cpu_features;
+enum crc32_cpu_feature crc32_get_cpu_features( void );
+
+#define BENCH_BUFFER_SIZE  0x40000  // READ_BUFFER_SIZE
+#define BENCH_MIN_SECONDS  0.25
+
+typedef uint32_t (*crc32_function)( uint32_t crc, const uint8_t *buf, unsigned int size );
+
+static const struct {
+	const char *name;
+	enum crc32_cpu_feature features;
+	crc32_function fn;
+} kernels[] = {
+	{ "slicing-by-16", 0,                                    crc32  },
+	{ "pclmulqdq",     CRC32_PCLMUL,                         crc32  },
+	{ "vpclmulqdq",    CRC32_PCLMUL | CRC32_VPCLMUL_AVX512,  crc32  },
+	{ "c slicing-16",  0,                                    crc32c },
+	{ "c sse4.2",      CRC32_SSE42,                          crc32c }
+};
+
+static const size_t sizes[] = { 64, 256, 1024, 4096, 16384, 65536, BENCH_BUFFER_SIZE };
+
+int main( void )
+{
+	enum crc32_cpu_feature detected = crc32_get_cpu_features();
+	uint8_t *buffer = malloc(BENCH_BUFFER_SIZE);
+	uint32_t expected;
+	size_t i, j;
+
+	if (!buffer)
+		return(1);
+
+	for (i = 0; i < BENCH_BUFFER_SIZE; ++i)
+		buffer[i] = (uint8_t)(i * 2654435761u >> 24);
+
+	g_crc32_cpu_features = 0;
+	if (crc32c(0, (const uint8_t *)"123456789", 9) != 0xe3069283)
+	{
+		printf("CRC-32C check value MISMATCH\n");
+		return(1);
+	}
+
+	printf("%-14s", "kernel");
+	for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+		printf(" %9zuB", sizes[j]);
+	printf("   (MB/s)\n");
+
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i)
+	{
+		if ((kernels[i].features & detected) != kernels[i].features)
+		{
+			printf("%-14s unsupported by this CPU\n", kernels[i].name);
+			continue;
+		}
+
+		// Each algorithm's first kernel is the portable one
+		if (i == 0 || kernels[i].fn != kernels[i - 1].fn)
+		{
+			g_crc32_cpu_features = 0;
+			expected = kernels[i].fn(0, buffer, BENCH_BUFFER_SIZE);
+		}
+
+		g_crc32_cpu_features = kernels[i].features;
+		if (kernels[i].fn(0, buffer, BENCH_BUFFER_SIZE) != expected)
+		{
+			printf("%-14s MISMATCH\n", kernels[i].name);
+			return(1);
+		}
+
+		printf("%-14s", kernels[i].name);
+		for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+		{
+			volatile uint32_t sink = 0;
+			double start = now_seconds(), elapsed;
+			unsigned long long cbTotal = 0;
+
+			do
+			{
+				size_t k;
+				for (k = 0; k + sizes[j] <= BENCH_BUFFER_SIZE; k += sizes[j])
+					sink ^= kernels[i].fn(sink, buffer + k, (unsigned int)sizes[j]);
+				cbTotal += BENCH_BUFFER_SIZE - BENCH_BUFFER_SIZE % sizes[j];
+			} while ((elapsed = now_seconds() - start) < BENCH_MIN_SECONDS);
+
+			printf(" %10.0f", cbTotal / elapsed / 1e6);
+		}
+		printf("\n");
+	}
+
+	free(buffer);
+	return(0);
+}
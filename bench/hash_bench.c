@@ -0,0 +1,327 @@
+/**
+ * WinHash hash engine benchmark
+ *
+ * Measures WHUpdateEx, the way HashCheck drives it, and prints the results as
+ * JSON (on stdout; progress goes to stderr) so that runs on different CPUs
+ * and builds can be compared and tracked for regressions:
+ *
+ *  - "algorithms": every algorithm in FOR_EACH_HASH on its own, for update
+ *    sizes from 64 bytes to 64 MiB;
+ *  - "multi": sets of algorithms in one WHUpdateEx, against the sum of their
+ *    times alone ("speedup" > 1 means that hashing them together wins); with
+ *    PPL, this is where WHUpdateEx's calibrated fan-out threshold shows up;
+ *  - "tuning": what WHGetTuning measured, and the limits derived from it for
+ *    each of those sets;
+ *  - "blake3": BLAKE3 with each of its dispatch paths that the CPU supports
+ *    forced in turn.
+ *
+ * Each point is the best of a few rounds, each of which repeats the update
+ * for at least the given time (0.05 seconds by default, or argv[1]).  Cycles
+ * are TSC ticks, which run at the nominal clock, so turbo and power saving
+ * skew them; bytes per second is the figure to compare across machines.
+ *
+ * Build (from the repository root) with MSVC, linking the OpenSSL libcrypto:
+ *   cl /O2 /EHsc /DBLAKE3_TESTING /Ilibs /Ilibs\openssl\include bench\hash_bench.c libs\WinHash*.cpp
+ *      libs\hexconv*.c libs\crc32*.c libs\sha256_mb*.c libs\BLAKE3\blake3*.c libs\xxHash\xxhash.c
+ *      libcrypto.lib
+ * or with GCC/Clang on Linux, using the minimal Windows headers in bench/compat
+ * and giving the SIMD kernels their ISA flags:
+ *   cc -O2 -c -DBLAKE3_TESTING libs/BLAKE3/blake3.c libs/BLAKE3/blake3_dispatch.c
+ *      libs/BLAKE3/blake3_portable.c
+ *   cc -O2 -c -msse2 libs/BLAKE3/blake3_sse2.c
+ *   cc -O2 -c -msse4.1 libs/BLAKE3/blake3_sse41.c
+ *   cc -O2 -c -mavx2 libs/BLAKE3/blake3_avx2.c libs/sha256_mb_avx2.c libs/hexconv_avx2.c
+ *   cc -O2 -c -mavx512f -mavx512vl libs/BLAKE3/blake3_avx512.c libs/sha256_mb_avx512.c
+ *   cc -O2 -c -msse4.1 -mpclmul libs/crc32_pclmul.c
+ *   cc -O2 -c -msse4.1 -mpclmul -mavx512f -mvpclmulqdq libs/crc32_avx512.c
+ *   cc -O2 -c -msse4.2 libs/crc32c_sse42.c
+ *   cc -O2 -c libs/crc32.c libs/crc32c.c libs/sha256_mb.c libs/hexconv.c libs/xxHash/xxhash.c
+ *   c++ -O2 -c -Ibench/compat -Ilibs libs/WinHash.cpp libs/WinHashTuning.cpp
+ *   cc -O2 -DBLAKE3_TESTING -Ibench/compat -Ilibs bench/hash_bench.c *.o -lcrypto -lstdc++
+ *      -o hash_bench
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#include "WinHash.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BENCH_IS_X86
+#endif
+
+#if defined(_WIN32)
+static double now_seconds( void )
+{
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter(&t);
+	QueryPerformanceFrequency(&f);
+	return((double)t.QuadPart / (double)f.QuadPart);
+}
+#else
+#include <time.h>
+static double now_seconds( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+#endif
+
+static ULONGLONG now_cycles( void )
+{
+#if defined(BENCH_IS_X86)
+	return(__rdtsc());
+#else
+	return(0);
+#endif
+}
+
+// As in blake3_dispatch.c, which exposes g_cpu_features when built with BLAKE3_TESTING
+enum cpu_feature {
+	SSE2 = 1 << 0,
+	SSSE3 = 1 << 1,
+	SSE41 = 1 << 2,
+	AVX = 1 << 3,
+	AVX2 = 1 << 4,
+	AVX512F = 1 << 5,
+	AVX512VL = 1 << 6,
+	UNDEFINED = 1 << 30
+};
+
+extern enum cpu_feature g_cpu_features;
+enum cpu_feature get_cpu_features( void );
+
+#define BENCH_MAX_SIZE     ((UINT)64 << 20)
+#define BENCH_ROUNDS       3
+
+static const UINT sizes[] = {
+	64, 256, 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20, 16 << 20, 64 << 20
+};
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static const struct {
+	const char *name;
+	UINT cAlgorithms;
+	DWORD dwFlags;
+} sets[] = {
+	{ "SHA-1+SHA-256",                2, WHEX_CHECKSHA1 | WHEX_CHECKSHA256 },
+	{ "CRC-32+SHA-1+SHA-256+SHA-512", 4, WHEX_CHECKCRC32 | WHEX_CHECKSHA1 | WHEX_CHECKSHA256 | WHEX_CHECKSHA512 },
+	{ "all",                          NUM_HASHES, WHEX_ALL },
+};
+
+static const struct {
+	const char *name;
+	enum cpu_feature features;
+} blake3_paths[] = {
+	{ "portable", 0 },
+	{ "sse2",     SSE2 },
+	{ "sse41",    SSE2 | SSSE3 | SSE41 },
+	{ "avx2",     SSE2 | SSSE3 | SSE41 | AVX | AVX2 },
+	{ "avx512",   SSE2 | SSSE3 | SSE41 | AVX | AVX2 | AVX512F | AVX512VL },
+};
+
+#define HASH_NAME_op(alg) HASH_NAME_##alg,
+static const PCTSTR g_szHashNames[] = { FOR_EACH_HASH(HASH_NAME_op) };
+
+typedef struct {
+	double dSecondsPerByte;
+	double dCyclesPerByte;
+} BENCHPOINT;
+
+static WHCTXEX g_whctx;  // zero-initialized, as required before first use
+static WHRESULTEX g_whres;
+static double g_dMinSeconds = 0.05;
+
+// Returns the best time and cycle count per byte of repeated cbUpdate-byte updates with dwFlags
+static BENCHPOINT Measure( DWORD dwFlags, PCBYTE pbData, UINT cbUpdate )
+{
+	BENCHPOINT best = { 0, 0 };
+	UINT iRound;
+
+	for (iRound = 0; iRound < BENCH_ROUNDS; ++iRound)
+	{
+		double dStart, dElapsed;
+		ULONGLONG cStart, cUpdates = 0;
+
+		g_whctx.dwFlags = dwFlags;
+		WHInitEx(&g_whctx);
+
+		dStart = now_seconds();
+		cStart = now_cycles();
+		do
+		{
+			WHUpdateEx(&g_whctx, pbData, cbUpdate);
+			++cUpdates;
+		} while ((dElapsed = now_seconds() - dStart) < g_dMinSeconds);
+
+		if (best.dSecondsPerByte == 0 || dElapsed / ((double)cUpdates * cbUpdate) < best.dSecondsPerByte)
+		{
+			best.dSecondsPerByte = dElapsed / ((double)cUpdates * cbUpdate);
+			best.dCyclesPerByte = (double)(now_cycles() - cStart) / ((double)cUpdates * cbUpdate);
+		}
+
+		g_whres.dwFlags = 0;
+		WHFinishEx(&g_whctx, &g_whres);
+	}
+
+	return(best);
+}
+
+static void PrintPoint( const char *pszIndent, UINT cbUpdate, BENCHPOINT point, int bLast )
+{
+	printf("%s{ \"size\": %u, \"bytes_per_second\": %.6g, \"cycles_per_byte\": ",
+	       pszIndent, cbUpdate, 1 / point.dSecondsPerByte);
+#if defined(BENCH_IS_X86)
+	printf("%.4g }%s\n", point.dCyclesPerByte, bLast ? "" : ",");
+#else
+	printf("null }%s\n", bLast ? "" : ",");
+#endif
+}
+
+static void PrintCpuName( void )
+{
+	char szBrand[49] = "unknown";
+#if defined(BENCH_IS_X86)
+	unsigned regs[12], i;
+#if defined(_MSC_VER)
+	for (i = 0; i < 3; ++i)
+		__cpuid((int *)regs + 4 * i, 0x80000002 + i);
+#else
+	for (i = 0; i < 3; ++i)
+		__cpuid(0x80000002 + i, regs[4 * i], regs[4 * i + 1], regs[4 * i + 2], regs[4 * i + 3]);
+#endif
+	memcpy(szBrand, regs, 48);
+	szBrand[48] = 0;
+#endif
+	{
+		// Trim, and keep the string JSON-safe
+		char *psz = szBrand, *pszEnd;
+		while (*psz == ' ')
+			++psz;
+		for (pszEnd = psz; *pszEnd; ++pszEnd)
+			if (*pszEnd == '"' || *pszEnd == '\\' || (unsigned char)*pszEnd < 0x20)
+				*pszEnd = ' ';
+		while (pszEnd > psz && pszEnd[-1] == ' ')
+			*--pszEnd = 0;
+		printf("  \"cpu\": \"%s\",\n", psz);
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	PBYTE pbData = (PBYTE)malloc(BENCH_MAX_SIZE);
+	static BENCHPOINT single[NUM_HASHES][NUM_SIZES];
+	enum cpu_feature detected = get_cpu_features();
+	UINT iAlg, iSize, iSet, iPath;
+	PCWHTUNING pTuning;
+
+	if (pbData == NULL)
+		return(1);
+	if (argc > 1 && atof(argv[1]) > 0)
+		g_dMinSeconds = atof(argv[1]);
+
+	for (iSize = 0; iSize < BENCH_MAX_SIZE; ++iSize)
+		pbData[iSize] = (BYTE)(iSize * 2654435761u >> 24);
+
+	printf("{\n");
+	PrintCpuName();
+#if defined(_MSC_VER)
+	printf("  \"compiler\": \"MSVC %d\",\n", _MSC_FULL_VER);
+#elif defined(__VERSION__)
+	printf("  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+#ifdef USE_PPL
+	printf("  \"ppl\": true,\n");
+#else
+	printf("  \"ppl\": false,\n");
+#endif
+	printf("  \"min_seconds\": %g,\n", g_dMinSeconds);
+
+	// Each algorithm on its own
+	printf("  \"algorithms\": [\n");
+	for (iAlg = 0; iAlg < NUM_HASHES; ++iAlg)
+	{
+		fprintf(stderr, "%s\n", g_szHashNames[iAlg]);
+		printf("    { \"name\": \"%s\", \"results\": [\n", g_szHashNames[iAlg]);
+		for (iSize = 0; iSize < NUM_SIZES; ++iSize)
+		{
+			single[iAlg][iSize] = Measure(1UL << iAlg, pbData, sizes[iSize]);
+			PrintPoint("      ", sizes[iSize], single[iAlg][iSize], iSize == NUM_SIZES - 1);
+		}
+		printf("    ] }%s\n", iAlg == NUM_HASHES - 1 ? "" : ",");
+	}
+	printf("  ],\n");
+
+	// Several algorithms in one WHUpdateEx, against the sum of their times alone
+	// Calibrate (as the first multi-algorithm WHUpdateEx would) before timing any
+	fprintf(stderr, "tuning\n");
+	pTuning = WHGetTuning();
+	printf("  \"tuning\": {\n");
+	printf("    \"dispatch_ns\": %u, \"max_tasks\": %u,\n", pTuning->uDispatchNs, pTuning->cMaxTasks);
+	printf("    \"ps_per_byte\": {");
+	for (iAlg = 0; iAlg < NUM_HASHES; ++iAlg)
+		printf(" \"%s\": %u%s", g_szHashNames[iAlg], pTuning->auPsPerByte[iAlg], iAlg == NUM_HASHES - 1 ? " },\n" : ",");
+	printf("    \"sets\": [\n");
+	for (iSet = 0; iSet < sizeof(sets) / sizeof(sets[0]); ++iSet)
+	{
+		printf("      { \"name\": \"%s\", \"parallel_min\": %u, \"file_workers\": %u }%s\n",
+		       sets[iSet].name, WHTuningParallelMin(sets[iSet].dwFlags), WHTuningFileWorkers(sets[iSet].dwFlags, TRUE),
+		       iSet == sizeof(sets) / sizeof(sets[0]) - 1 ? "" : ",");
+	}
+	printf("    ]\n");
+	printf("  },\n");
+
+	printf("  \"multi\": [\n");
+	for (iSet = 0; iSet < sizeof(sets) / sizeof(sets[0]); ++iSet)
+	{
+		fprintf(stderr, "%s\n", sets[iSet].name);
+		printf("    { \"name\": \"%s\", \"algorithms\": %u, \"results\": [\n", sets[iSet].name, sets[iSet].cAlgorithms);
+		for (iSize = 0; iSize < NUM_SIZES; ++iSize)
+		{
+			BENCHPOINT together = Measure(sets[iSet].dwFlags, pbData, sizes[iSize]);
+			double dSeparately = 0;
+
+			for (iAlg = 0; iAlg < NUM_HASHES; ++iAlg)
+				if (sets[iSet].dwFlags & (1UL << iAlg))
+					dSeparately += single[iAlg][iSize].dSecondsPerByte;
+
+			printf("      { \"size\": %u, \"bytes_per_second\": %.6g, \"separately_bytes_per_second\": %.6g, "
+			       "\"speedup\": %.4g }%s\n", sizes[iSize], 1 / together.dSecondsPerByte, 1 / dSeparately,
+			       dSeparately / together.dSecondsPerByte, iSize == NUM_SIZES - 1 ? "" : ",");
+		}
+		printf("    ] }%s\n", iSet == sizeof(sets) / sizeof(sets[0]) - 1 ? "" : ",");
+	}
+	printf("  ],\n");
+
+	// BLAKE3 with each dispatch path that this CPU supports
+	printf("  \"blake3\": [\n");
+	for (iPath = 0; iPath < sizeof(blake3_paths) / sizeof(blake3_paths[0]); ++iPath)
+	{
+		int bLast = iPath == sizeof(blake3_paths) / sizeof(blake3_paths[0]) - 1 ||
+		            (blake3_paths[iPath + 1].features & detected) != blake3_paths[iPath + 1].features;
+
+		if ((blake3_paths[iPath].features & detected) != blake3_paths[iPath].features)
+			break;
+
+		fprintf(stderr, "BLAKE3 %s\n", blake3_paths[iPath].name);
+		g_cpu_features = blake3_paths[iPath].features;
+		printf("    { \"path\": \"%s\", \"results\": [\n", blake3_paths[iPath].name);
+		for (iSize = 0; iSize < NUM_SIZES; ++iSize)
+			PrintPoint("      ", sizes[iSize], Measure(WHEX_CHECKBLAKE3, pbData, sizes[iSize]), iSize == NUM_SIZES - 1);
+		printf("    ] }%s\n", bLast ? "" : ",");
+	}
+	g_cpu_features = detected;
+	printf("  ]\n");
+	printf("}\n");
+
+	WHFreeEx(&g_whctx);
+	free(pbData);
+	return(0);
+}
@@ -0,0 +1,357 @@
+/**
+ * Hex conversion benchmark
+ *
+ * Encodes, decodes and validates a million SHA-512-sized (64-byte, 128-digit)
+ * UTF-16 hex strings, as HashSave and HashVerify do for a million-line
+ * manifest, with the scalar loops of WHByteToHex, WHHexToByte and
+ * ValidateHexSequence alone and then with the SSE2 and AVX2 kernels in front
+ * of them, as WinHash.cpp and HashVerify.cpp use them; checks that every
+ * kernel agrees with the scalar code (including on strings with a bad digit
+ * and strings that end at a page boundary) and reports strings per second.
+ *
+ * Build (from the repository root) with MSVC:
+ *   cl /O2 /DHEXCONV_TESTING /Ilibs bench\hex_bench.c libs\hexconv.c libs\hexconv_avx2.c
+ * or with GCC/Clang, where the AVX2 kernels need their ISA flag:
+ *   cc -O2 -c -mavx2 libs/hexconv_avx2.c
+ *   cc -O2 -DHEXCONV_TESTING -Ilibs bench/hex_bench.c libs/hexconv.c hexconv_avx2.o
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hexconv_impl.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+static double now_seconds( void )
+{
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter(&t);
+	QueryPerformanceFrequency(&f);
+	return((double)t.QuadPart / (double)f.QuadPart);
+}
+// Returns a page that is followed by an inaccessible one
+static uint8_t *alloc_guarded_page( void )
+{
+	uint8_t *pb = (uint8_t *)VirtualAlloc(NULL, 2 * HEXCONV_PAGE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	DWORD dwOld;
+	if (pb && !VirtualProtect(pb + HEXCONV_PAGE_SIZE, HEXCONV_PAGE_SIZE, PAGE_NOACCESS, &dwOld))
+		return(NULL);
+	return(pb);
+}
+#else
+#include <time.h>
+#include <sys/mman.h>
+static double now_seconds( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+// Returns a page that is followed by an inaccessible one
+static uint8_t *alloc_guarded_page( void )
+{
+	uint8_t *pb = mmap(NULL, 2 * HEXCONV_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pb == MAP_FAILED || mprotect(pb + HEXCONV_PAGE_SIZE, HEXCONV_PAGE_SIZE, PROT_NONE))
+		return(NULL);
+	return(pb);
+}
+#endif
+
+extern enum hexconv_cpu_feature g_hexconv_cpu_features;
+enum hexconv_cpu_feature hexconv_get_cpu_features( void );
+
+#define BENCH_DIGEST_LENGTH  64
+#define BENCH_HEX_LENGTH     (BENCH_DIGEST_LENGTH * 2)
+#define BENCH_STRINGS        1000000
+#define BENCH_ROUNDS         3
+
+/**
+ * The scalar conversions, as in WinHash.cpp and HashVerify.cpp; "simd" puts
+ * the kernels in front of them, as those files do in Unicode builds
+ **/
+
+static uint16_t *byte_to_hex( const uint8_t *pbSrc, uint16_t *pszDest, unsigned cchHex, uint8_t uCaseMode, int simd )
+{
+	if (simd && !(cchHex & 1))
+	{
+		unsigned cbDone = (unsigned)hex_encode_utf16(pszDest, pbSrc, cchHex / 2, uCaseMode);
+		pbSrc += cbDone;
+		pszDest += cbDone * 2;
+		cchHex -= cbDone * 2;
+	}
+
+	while (cchHex)
+	{
+		uint8_t hex = *pbSrc;
+
+		if (!(cchHex & 1))
+			hex >>= 4;
+		else
+			++pbSrc;
+
+		hex &= 0x0F;
+		hex |= 0x30;
+
+		if (hex > '9')
+		{
+			hex += 'A' - ('0' + 10);
+			hex |= uCaseMode;
+		}
+
+		*pszDest = hex;
+
+		++pszDest;
+		--cchHex;
+	}
+
+	*pszDest = 0;
+
+	return(pszDest);
+}
+
+static int hex_to_byte( const uint16_t *pszSrc, uint8_t *pbDest, unsigned cchHex, int simd )
+{
+	if (simd && !(cchHex & 1))
+	{
+		unsigned cchDone = (unsigned)hex_decode_utf16(pbDest, pszSrc, cchHex);
+		pszSrc += cchDone;
+		pbDest += cchDone / 2;
+		cchHex -= cchDone;
+	}
+
+	while (cchHex)
+	{
+		uint8_t hex = (uint8_t)*pszSrc;
+
+		if (*pszSrc >> 8)
+			return(0);
+
+		if (hex < '0')
+		{
+			return(0);
+		}
+		else if (hex > '9')
+		{
+			hex |= 0x20;
+
+			if (hex < 'a') return(0);
+			if (hex > 'f') return(0);
+
+			hex -= 'a' - 10;
+		}
+		else
+		{
+			hex -= '0';
+		}
+
+		if (!(cchHex & 1))
+		{
+			*pbDest = hex << 4;
+		}
+		else
+		{
+			*pbDest |= hex;
+			++pbDest;
+		}
+
+		++pszSrc;
+		--cchHex;
+	}
+
+	return(1);
+}
+
+static int validate_hex( uint16_t *psz, unsigned cch, int simd )
+{
+	if (simd)
+	{
+		unsigned cchDone = (unsigned)hex_validate_utf16(psz, cch);
+		psz += cchDone;
+		cch -= cchDone;
+	}
+
+	while (cch)
+	{
+		uint16_t ch = *psz;
+
+		if (ch < '0')
+		{
+			return(0);
+		}
+		else if (ch > '9')
+		{
+			ch |= 0x20;
+
+			if (ch < 'a' || ch > 'f')
+				return(0);
+
+			*psz = ch;
+		}
+
+		++psz;
+		--cch;
+	}
+
+	if (*psz == 0 || *psz == '\n' || *psz == ' ')
+	{
+		*psz = 0;
+		return(1);
+	}
+
+	return(0);
+}
+
+static const struct {
+	const char *name;
+	int simd;
+	enum hexconv_cpu_feature features;
+} modes[] = {
+	{ "scalar", 0, 0 },
+	{ "sse2",   1, 0 },
+	{ "avx2",   1, HEXCONV_AVX2 },
+};
+
+static uint32_t g_seed = 1;
+
+static uint32_t next_random( void )
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return(g_seed >> 8);
+}
+
+// Compares each mode with the scalar code on random digests and damaged strings
+static int check_mode( unsigned m )
+{
+	static uint8_t *pbPage;
+	uint8_t abDigest[BENCH_DIGEST_LENGTH], abExpected[BENCH_DIGEST_LENGTH], abActual[BENCH_DIGEST_LENGTH];
+	uint16_t szExpected[BENCH_HEX_LENGTH + 2], szActual[BENCH_HEX_LENGTH + 2];
+	unsigned iTrial, cb, i;
+
+	if (pbPage == NULL && (pbPage = alloc_guarded_page()) == NULL)
+		return(0);
+
+	for (iTrial = 0; iTrial < 20000; ++iTrial)
+	{
+		uint8_t uCaseMode = (iTrial & 1) ? 0x20 : 0x00;
+		int bExpected, bActual;
+
+		cb = next_random() % (BENCH_DIGEST_LENGTH + 1);
+		for (i = 0; i < cb; ++i)
+			abDigest[i] = (uint8_t)next_random();
+
+		// Encoding
+		byte_to_hex(abDigest, szExpected, cb * 2, uCaseMode, 0);
+		byte_to_hex(abDigest, szActual, cb * 2, uCaseMode, modes[m].simd);
+		if (memcmp(szExpected, szActual, (cb * 2 + 1) * sizeof(uint16_t)))
+			return(0);
+
+		// Damage a digit now and then, with an ASCII or a wide character
+		szExpected[cb * 2] = (iTrial & 2) ? ' ' : 0;
+		if (cb && (iTrial % 3) == 0)
+		{
+			static const uint16_t bad[] = { '/', ':', '@', 'G', '`', 'g', 0, 0x0141, 0xFF41, 0x8030 };
+			szExpected[next_random() % (cb * 2)] = bad[next_random() % (sizeof(bad) / sizeof(bad[0]))];
+		}
+		memcpy(szActual, szExpected, sizeof(szExpected));
+
+		// Decoding
+		memset(abExpected, 0, sizeof(abExpected));
+		memset(abActual, 0, sizeof(abActual));
+		bExpected = hex_to_byte(szExpected, abExpected, cb * 2, 0);
+		bActual = hex_to_byte(szActual, abActual, cb * 2, modes[m].simd);
+		if (bExpected != bActual || (bExpected && memcmp(abExpected, abActual, cb)))
+			return(0);
+
+		// Validation, including the lower-casing of what precedes a bad digit
+		bExpected = validate_hex(szExpected, cb * 2, 0);
+		bActual = validate_hex(szActual, cb * 2, modes[m].simd);
+		if (bExpected != bActual || memcmp(szExpected, szActual, sizeof(szExpected)))
+			return(0);
+
+		// A short string that ends just before an inaccessible page must be
+		// told apart without the kernels reading past it
+		{
+			uint16_t *psz = (uint16_t *)(pbPage + HEXCONV_PAGE_SIZE) - (cb * 2 + 1);
+			byte_to_hex(abDigest, psz, cb * 2, uCaseMode, 0);
+			if (validate_hex(psz, BENCH_HEX_LENGTH, modes[m].simd) != (cb * 2 == BENCH_HEX_LENGTH) ||
+			    hex_to_byte(psz, abActual, BENCH_HEX_LENGTH, modes[m].simd) != (cb * 2 == BENCH_HEX_LENGTH))
+				return(0);
+		}
+	}
+
+	return(1);
+}
+
+int main( void )
+{
+	enum hexconv_cpu_feature detected = hexconv_get_cpu_features();
+	uint8_t *pbDigests = malloc((size_t)BENCH_STRINGS * BENCH_DIGEST_LENGTH);
+	uint16_t *pszHex = malloc((size_t)BENCH_STRINGS * (BENCH_HEX_LENGTH + 1) * sizeof(uint16_t));
+	uint8_t *pbDecoded = malloc((size_t)BENCH_STRINGS * BENCH_DIGEST_LENGTH);
+	unsigned m;
+	size_t i;
+
+	if (!pbDigests || !pszHex || !pbDecoded)
+		return(1);
+
+	for (i = 0; i < (size_t)BENCH_STRINGS * BENCH_DIGEST_LENGTH; ++i)
+		pbDigests[i] = (uint8_t)(i * 2654435761u >> 24);
+
+	printf("%-8s %14s %14s %14s   (strings/s, %u digits each)\n",
+	       "mode", "encode", "decode", "validate", BENCH_HEX_LENGTH);
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+	{
+		double best[3] = { 0, 0, 0 };
+		unsigned iRound;
+
+		if ((modes[m].features & detected) != modes[m].features)
+			continue;
+		g_hexconv_cpu_features = modes[m].features;
+
+		if (!check_mode(m))
+		{
+			printf("%-8s MISMATCH\n", modes[m].name);
+			return(1);
+		}
+
+		for (iRound = 0; iRound < BENCH_ROUNDS; ++iRound)
+		{
+			double t[4];
+
+			t[0] = now_seconds();
+			for (i = 0; i < BENCH_STRINGS; ++i)
+				byte_to_hex(pbDigests + i * BENCH_DIGEST_LENGTH, pszHex + i * (BENCH_HEX_LENGTH + 1),
+				            BENCH_HEX_LENGTH, 0x20, modes[m].simd);
+			t[1] = now_seconds();
+			for (i = 0; i < BENCH_STRINGS; ++i)
+				if (!hex_to_byte(pszHex + i * (BENCH_HEX_LENGTH + 1), pbDecoded + i * BENCH_DIGEST_LENGTH,
+				                 BENCH_HEX_LENGTH, modes[m].simd))
+					return(1);
+			t[2] = now_seconds();
+			for (i = 0; i < BENCH_STRINGS; ++i)
+				if (!validate_hex(pszHex + i * (BENCH_HEX_LENGTH + 1), BENCH_HEX_LENGTH, modes[m].simd))
+					return(1);
+			t[3] = now_seconds();
+
+			for (i = 0; i < 3; ++i)
+				if (best[i] == 0 || t[i + 1] - t[i] < best[i])
+					best[i] = t[i + 1] - t[i];
+		}
+
+		if (memcmp(pbDigests, pbDecoded, (size_t)BENCH_STRINGS * BENCH_DIGEST_LENGTH))
+		{
+			printf("%-8s MISMATCH\n", modes[m].name);
+			return(1);
+		}
+
+		printf("%-8s %14.0f %14.0f %14.0f\n", modes[m].name,
+		       BENCH_STRINGS / best[0], BENCH_STRINGS / best[1], BENCH_STRINGS / best[2]);
+	}
+
+	free(pbDigests);
+	free(pszHex);
+	free(pbDecoded);
+	return(0);
+}
@@ -0,0 +1,349 @@
+/**
+ * Mapped versus read file hashing benchmark
+ *
+ * Hashes a file with WHUpdateEx the two ways that WorkerThreadHashFile can:
+ * reading it READ_BUFFER_SIZE at a time into a buffer, and from views of it
+ * mapped MAPPED_WINDOW_SIZE at a time (with madvise(MADV_SEQUENTIAL) outside
+ * Windows), fed to WHUpdateEx READ_BUFFER_SIZE at a time without a copy; checks
+ * that both give the same digests and prints the throughput of each as JSON.
+ *
+ * With no arguments, a 256 MiB scratch file is written (and deleted after),
+ * so it is hashed from the page cache, where the copy that mapping saves is
+ * the whole difference; give the path of a large file (after dropping the
+ * page cache, or rebooting) to compare the two on the storage itself.  Each
+ * point is the best of a few rounds, and the first round of each also warms
+ * the cache for the rest.
+ *
+ * Build (from the repository root) with MSVC, linking the OpenSSL libcrypto:
+ *   cl /O2 /EHsc /Ilibs /Ilibs\openssl\include bench\mapped_bench.c libs\WinHash*.cpp
+ *      libs\hexconv*.c libs\crc32*.c libs\sha256_mb*.c libs\BLAKE3\blake3*.c libs\xxHash\xxhash.c
+ *      libcrypto.lib
+ * or with GCC/Clang on Linux, with the objects built as for hash_bench.c:
+ *   cc -O2 -Ibench/compat -Ilibs bench/mapped_bench.c *.o -lcrypto -lstdc++ -o mapped_bench
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if ! defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include "WinHash.h"
+
+#define READ_BUFFER_SIZE    0x40000    // as in HashCheckCommon.h
+#define MAPPED_WINDOW_SIZE  0x4000000  // as in HashCheckCommon.c
+#define SCRATCH_FILE_SIZE   ((ULONGLONG)256 << 20)
+#define SCRATCH_FILE_NAME   "mapped_bench.tmp"
+#define BENCH_ROUNDS        3
+
+static const struct {
+	const char *name;
+	DWORD dwFlags;
+} sets[] = {
+	{ "CRC-32",                       WHEX_CHECKCRC32 },
+	{ "XXH3-128",                     WHEX_CHECKXXH3_128 },
+	{ "SHA-256",                      WHEX_CHECKSHA256 },
+	{ "CRC-32+SHA-1+SHA-256+SHA-512", WHEX_CHECKCRC32 | WHEX_CHECKSHA1 | WHEX_CHECKSHA256 | WHEX_CHECKSHA512 },
+};
+
+static WHCTXEX g_whctx;  // zero-initialized, as required before first use
+
+#if defined(_WIN32)
+
+typedef HANDLE BENCHFILE;
+#define BENCHFILE_INVALID INVALID_HANDLE_VALUE
+
+static double now_seconds( void )
+{
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter(&t);
+	QueryPerformanceFrequency(&f);
+	return((double)t.QuadPart / (double)f.QuadPart);
+}
+
+static BENCHFILE OpenBenchFile( const char *pszPath, ULONGLONG *pcbFileSize )
+{
+	HANDLE hFile = CreateFileA(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (hFile != INVALID_HANDLE_VALUE && ! GetFileSizeEx(hFile, (PLARGE_INTEGER)pcbFileSize))
+	{
+		CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+
+	return(hFile);
+}
+
+static VOID CloseBenchFile( BENCHFILE hFile )
+{
+	CloseHandle(hFile);
+}
+
+static ULONGLONG HashByReading( BENCHFILE hFile, PBYTE pbBuffer )
+{
+	LARGE_INTEGER liStart = { 0 };
+	ULONGLONG cbHashed = 0;
+	DWORD cbRead;
+
+	SetFilePointerEx(hFile, liStart, NULL, FILE_BEGIN);
+	while (ReadFile(hFile, pbBuffer, READ_BUFFER_SIZE, &cbRead, NULL) && cbRead)
+	{
+		WHUpdateEx(&g_whctx, pbBuffer, cbRead);
+		cbHashed += cbRead;
+	}
+
+	return(cbHashed);
+}
+
+static ULONGLONG HashByMapping( BENCHFILE hFile, ULONGLONG cbFileSize )
+{
+	HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	ULONGLONG ibView, cbHashed = 0;
+
+	if (hMapping == NULL)
+		return(0);
+
+	for (ibView = 0; ibView < cbFileSize; ibView += MAPPED_WINDOW_SIZE)
+	{
+		SIZE_T cbView = (SIZE_T)min(MAPPED_WINDOW_SIZE, cbFileSize - ibView);
+		PBYTE pbView = (PBYTE)MapViewOfFile(hMapping, FILE_MAP_READ, (DWORD)(ibView >> 32), (DWORD)ibView, cbView);
+		SIZE_T ib;
+
+		if (pbView == NULL)
+			break;
+
+		for (ib = 0; ib < cbView; ib += READ_BUFFER_SIZE)
+			WHUpdateEx(&g_whctx, pbView + ib, (UINT)min(READ_BUFFER_SIZE, cbView - ib));
+
+		UnmapViewOfFile(pbView);
+		cbHashed += cbView;
+	}
+
+	CloseHandle(hMapping);
+	return(cbHashed);
+}
+
+static BOOL WriteScratchFile( PCBYTE pbData, UINT cbData )
+{
+	HANDLE hFile = CreateFileA(SCRATCH_FILE_NAME, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	ULONGLONG cbWritten;
+	DWORD cb;
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		return(FALSE);
+
+	for (cbWritten = 0; cbWritten < SCRATCH_FILE_SIZE; cbWritten += cbData)
+	{
+		if (! WriteFile(hFile, pbData, cbData, &cb, NULL) || cb != cbData)
+			break;
+	}
+
+	CloseHandle(hFile);
+	return(cbWritten >= SCRATCH_FILE_SIZE);
+}
+
+#else
+
+typedef int BENCHFILE;
+#define BENCHFILE_INVALID (-1)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+static double now_seconds( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static BENCHFILE OpenBenchFile( const char *pszPath, ULONGLONG *pcbFileSize )
+{
+	int fd = open(pszPath, O_RDONLY);
+	struct stat st;
+
+	if (fd >= 0 && fstat(fd, &st) == 0)
+	{
+		*pcbFileSize = (ULONGLONG)st.st_size;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		return(fd);
+	}
+
+	if (fd >= 0)
+		close(fd);
+	return(-1);
+}
+
+static VOID CloseBenchFile( BENCHFILE fd )
+{
+	close(fd);
+}
+
+static ULONGLONG HashByReading( BENCHFILE fd, PBYTE pbBuffer )
+{
+	ULONGLONG cbHashed = 0;
+	ssize_t cbRead;
+
+	while ((cbRead = pread(fd, pbBuffer, READ_BUFFER_SIZE, (off_t)cbHashed)) > 0)
+	{
+		WHUpdateEx(&g_whctx, pbBuffer, (UINT)cbRead);
+		cbHashed += (ULONGLONG)cbRead;
+	}
+
+	return(cbHashed);
+}
+
+static ULONGLONG HashByMapping( BENCHFILE fd, ULONGLONG cbFileSize )
+{
+	ULONGLONG ibView, cbHashed = 0;
+
+	for (ibView = 0; ibView < cbFileSize; ibView += MAPPED_WINDOW_SIZE)
+	{
+		size_t cbView = (size_t)min(MAPPED_WINDOW_SIZE, cbFileSize - ibView);
+		PBYTE pbView = (PBYTE)mmap(NULL, cbView, PROT_READ, MAP_SHARED, fd, (off_t)ibView);
+		size_t ib;
+
+		if (pbView == MAP_FAILED)
+			break;
+
+		madvise(pbView, cbView, MADV_SEQUENTIAL);
+		for (ib = 0; ib < cbView; ib += READ_BUFFER_SIZE)
+			WHUpdateEx(&g_whctx, pbView + ib, (UINT)min(READ_BUFFER_SIZE, cbView - ib));
+
+		munmap(pbView, cbView);
+		cbHashed += cbView;
+	}
+
+	return(cbHashed);
+}
+
+static BOOL WriteScratchFile( PCBYTE pbData, UINT cbData )
+{
+	FILE *pFile = fopen(SCRATCH_FILE_NAME, "wb");
+	ULONGLONG cbWritten;
+
+	if (pFile == NULL)
+		return(FALSE);
+
+	for (cbWritten = 0; cbWritten < SCRATCH_FILE_SIZE; cbWritten += cbData)
+	{
+		if (fwrite(pbData, 1, cbData, pFile) != cbData)
+			break;
+	}
+
+	return(fclose(pFile) == 0 && cbWritten >= SCRATCH_FILE_SIZE);
+}
+
+#endif
+
+int main( int argc, char *argv[] )
+{
+	PBYTE pbBuffer = (PBYTE)malloc(READ_BUFFER_SIZE);
+	const char *pszPath = argc > 1 ? argv[1] : SCRATCH_FILE_NAME;
+	ULONGLONG cbFileSize;
+	BENCHFILE hFile;
+	UINT iSet, i;
+	int iResult = 0;
+
+	if (pbBuffer == NULL)
+		return(1);
+
+	if (argc <= 1)
+	{
+		for (i = 0; i < READ_BUFFER_SIZE; ++i)
+			pbBuffer[i] = (BYTE)(i * 2654435761u >> 24);
+
+		if (! WriteScratchFile(pbBuffer, READ_BUFFER_SIZE))
+		{
+			fprintf(stderr, "FAIL: could not write %s\n", SCRATCH_FILE_NAME);
+			return(1);
+		}
+	}
+
+	if ((hFile = OpenBenchFile(pszPath, &cbFileSize)) == BENCHFILE_INVALID)
+	{
+		fprintf(stderr, "FAIL: could not open %s\n", pszPath);
+		return(1);
+	}
+
+	printf("{\n");
+	printf("  \"file_size\": %llu,\n", (unsigned long long)cbFileSize);
+	printf("  \"scratch\": %s,\n", argc > 1 ? "false" : "true");
+	printf("  \"results\": [\n");
+
+	for (iSet = 0; iSet < sizeof(sets) / sizeof(sets[0]); ++iSet)
+	{
+		static WHRESULTEX whresRead, whresMapped;
+		double dRead = 0, dMapped = 0;
+		UINT iRound;
+
+		fprintf(stderr, "%s\n", sets[iSet].name);
+
+		// Keep the best of a few rounds of each
+		for (iRound = 0; iRound < BENCH_ROUNDS; ++iRound)
+		{
+			ULONGLONG cbHashed;
+			double dStart, t;
+
+			g_whctx.dwFlags = sets[iSet].dwFlags;
+			WHInitEx(&g_whctx);
+			dStart = now_seconds();
+			cbHashed = HashByReading(hFile, pbBuffer);
+			t = now_seconds() - dStart;
+			whresRead.dwFlags = 0;
+			WHFinishEx(&g_whctx, &whresRead);
+			if (cbHashed != cbFileSize)
+			{
+				fprintf(stderr, "FAIL: read %llu of %llu bytes\n", (unsigned long long)cbHashed, (unsigned long long)cbFileSize);
+				iResult = 1;
+				break;
+			}
+			if (dRead == 0 || t < dRead)
+				dRead = t;
+
+			g_whctx.dwFlags = sets[iSet].dwFlags;
+			WHInitEx(&g_whctx);
+			dStart = now_seconds();
+			cbHashed = HashByMapping(hFile, cbFileSize);
+			t = now_seconds() - dStart;
+			whresMapped.dwFlags = 0;
+			WHFinishEx(&g_whctx, &whresMapped);
+			if (cbHashed != cbFileSize)
+			{
+				fprintf(stderr, "FAIL: mapped %llu of %llu bytes\n", (unsigned long long)cbHashed, (unsigned long long)cbFileSize);
+				iResult = 1;
+				break;
+			}
+			if (dMapped == 0 || t < dMapped)
+				dMapped = t;
+
+			if (memcmp(&whresRead, &whresMapped, sizeof(whresRead)))
+			{
+				fprintf(stderr, "FAIL: the digests differ with %s\n", sets[iSet].name);
+				iResult = 1;
+				break;
+			}
+		}
+
+		if (iResult)
+			break;
+
+		printf("    { \"name\": \"%s\", \"read_bytes_per_second\": %.6g, \"mapped_bytes_per_second\": %.6g, "
+		       "\"speedup\": %.4g }%s\n", sets[iSet].name, cbFileSize / dRead, cbFileSize / dMapped,
+		       dRead / dMapped, iSet == sizeof(sets) / sizeof(sets[0]) - 1 ? "" : ",");
+	}
+
+	printf("  ]\n");
+	printf("}\n");
+
+	CloseBenchFile(hFile);
+	if (argc <= 1)
+		remove(SCRATCH_FILE_NAME);
+	WHFreeEx(&g_whctx);
+	free(pbBuffer);
+	return(iResult);
+}
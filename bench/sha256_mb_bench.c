@@ -0,0 +1,171 @@
+/**
+ * Multi-buffer SHA-256 benchmark
+ *
+ * Hashes a batch of equally sized small messages (as HashSave does with small
+ * files) with OpenSSL's single-buffer SHA-256 (EVP_Digest), one message at a
+ * time, and with each multi-buffer kernel, all messages at once, padding and
+ * finalizing each; reports messages per second after checking that every
+ * kernel's digests agree with OpenSSL's.
+ *
+ * Build (from the repository root) with MSVC, linking the OpenSSL libcrypto:
+ *   cl /O2 /DSHA256_MB_TESTING /Ilibs /Ilibs\openssl\include bench\sha256_mb_bench.c
+ *      libs\sha256_mb.c libs\sha256_mb_avx2.c libs\sha256_mb_avx512.c libcrypto.lib
+ * or with GCC/Clang, where the kernels need their ISA flags:
+ *   cc -O2 -c -mavx2 libs/sha256_mb_avx2.c
+ *   cc -O2 -c -mavx512f libs/sha256_mb_avx512.c
+ *   cc -O2 -DSHA256_MB_TESTING -Ilibs bench/sha256_mb_bench.c libs/sha256_mb.c
+ *      sha256_mb_avx2.o sha256_mb_avx512.o -lcrypto
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>  // SHA256_DIGEST_LENGTH
+#include "sha256_mb_impl.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+static double now_seconds( void )
+{
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter(&t);
+	QueryPerformanceFrequency(&f);
+	return((double)t.QuadPart / (double)f.QuadPart);
+}
+#else
+#include <time.h>
+static double now_seconds( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+#endif
+
+enum sha256_mb_cpu_feature sha256_mb_get_cpu_features( void );
+
+#define BENCH_MESSAGES     SHA256_MB_MAX_LANES
+#define BENCH_MAX_SIZE     0x10000
+#define BENCH_MIN_SECONDS  0.25
+
+typedef void (*sha256_mb_kernel)( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes );
+
+static const struct {
+	const char *name;
+	enum sha256_mb_cpu_feature features;
+	sha256_mb_kernel kernel;
+	unsigned lanes;
+} kernels[] = {
+	{ "openssl",      0,                NULL,             1 },
+#if defined(SHA256_MB_IS_X86)
+	{ "avx2 x8",      SHA256_MB_AVX2,   sha256_mb_avx2,   8 },
+#if !defined(SHA256_MB_NO_AVX512)
+	{ "avx512 x16",   SHA256_MB_AVX512, sha256_mb_avx512, 16 },
+#endif
+#endif
+};
+
+static const size_t sizes[] = { 4096, 16384, BENCH_MAX_SIZE };
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Hashes every message (a whole number of blocks long) with the given kernel, padding
+// and finalizing it the way OpenSSL does, or with OpenSSL's EVP_Digest if there's no kernel
+static void hash_messages( unsigned k, uint8_t *messages, size_t size, uint8_t digests[][SHA256_DIGEST_LENGTH] )
+{
+	uint32_t states[BENCH_MESSAGES][8];
+	uint32_t *state[BENCH_MESSAGES];
+	const uint8_t *data[BENCH_MESSAGES];
+	size_t nblocks[BENCH_MESSAGES];
+	uint8_t padding[SHA256_MB_BLOCK_LENGTH] = { 0x80 };
+	unsigned i, j;
+
+	if (!kernels[k].kernel)
+	{
+		for (i = 0; i < BENCH_MESSAGES; ++i)
+			EVP_Digest(messages + i * BENCH_MAX_SIZE, size, digests[i], NULL, EVP_sha256(), NULL);
+		return;
+	}
+
+	for (i = 0; i < BENCH_MESSAGES; ++i)
+	{
+		memcpy(states[i], sha256_iv, sizeof(sha256_iv));
+		state[i] = states[i];
+		data[i] = messages + i * BENCH_MAX_SIZE;
+		nblocks[i] = size / SHA256_MB_BLOCK_LENGTH;
+	}
+	for (i = 0; i < BENCH_MESSAGES; i += kernels[k].lanes)
+		kernels[k].kernel(state + i, data + i, nblocks + i, kernels[k].lanes);
+
+	// Every message is the same length, so they all end with the same padding block
+	for (j = 0; j < 8; ++j)
+		padding[SHA256_MB_BLOCK_LENGTH - 1 - j] = (uint8_t)((uint64_t)size * 8 >> 8 * j);
+	for (i = 0; i < BENCH_MESSAGES; ++i)
+	{
+		data[i] = padding;
+		nblocks[i] = 1;
+	}
+	for (i = 0; i < BENCH_MESSAGES; i += kernels[k].lanes)
+		kernels[k].kernel(state + i, data + i, nblocks + i, kernels[k].lanes);
+
+	for (i = 0; i < BENCH_MESSAGES; ++i)
+		for (j = 0; j < SHA256_DIGEST_LENGTH; ++j)
+			digests[i][j] = (uint8_t)(states[i][j / 4] >> (24 - 8 * (j % 4)));
+}
+
+int main( void )
+{
+	enum sha256_mb_cpu_feature detected = sha256_mb_get_cpu_features();
+	uint8_t *messages = malloc(BENCH_MESSAGES * BENCH_MAX_SIZE);
+	static uint8_t expected[BENCH_MESSAGES][SHA256_DIGEST_LENGTH], actual[BENCH_MESSAGES][SHA256_DIGEST_LENGTH];
+	size_t i, j;
+	unsigned k;
+
+	if (!messages)
+		return(1);
+
+	for (i = 0; i < BENCH_MESSAGES * BENCH_MAX_SIZE; ++i)
+		messages[i] = (uint8_t)(i * 2654435761u >> 24);
+
+	printf("%-12s", "kernel");
+	for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+		printf(" %10zuB", sizes[j]);
+	printf("   (messages/s)\n");
+
+	for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+	{
+		if ((kernels[k].features & detected) != kernels[k].features)
+			continue;
+
+		hash_messages(0, messages, BENCH_MAX_SIZE, expected);
+		hash_messages(k, messages, BENCH_MAX_SIZE, actual);
+		if (memcmp(expected, actual, sizeof(expected)))
+		{
+			printf("%-12s MISMATCH\n", kernels[k].name);
+			return(1);
+		}
+
+		printf("%-12s", kernels[k].name);
+		for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+		{
+			double start = now_seconds(), elapsed;
+			size_t cMessages = 0;
+
+			do
+			{
+				hash_messages(k, messages, sizes[j], actual);
+				cMessages += BENCH_MESSAGES;
+			} while ((elapsed = now_seconds() - start) < BENCH_MIN_SECONDS);
+
+			printf(" %11.0f", cMessages / elapsed);
+		}
+		printf("\n");
+	}
+
+	printf("lanes used by HashCheck: %u\n", sha256_mb_lanes());
+	free(messages);
+	return(0);
+}
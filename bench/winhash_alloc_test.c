@@ -0,0 +1,137 @@
+/**
+ * WinHash per-file allocation test
+ *
+ * Counts OpenSSL heap allocations (via CRYPTO_set_mem_functions) while one
+ * WHCTXEX is reused for many "files", the way each file-hashing thread reuses
+ * the contexts in its worker buffer, and fails if the per-file path allocates.
+ * With OpenSSL 1.1 (the version HashCheck ships with) it must not allocate at
+ * all; OpenSSL 3 providers always replace their digest state on reinit, so
+ * there the limit is one allocation per OpenSSL algorithm per file.
+ * It also checks that reused contexts produce the same digests as fresh ones.
+ *
+ * Build (from the repository root) with MSVC, linking the OpenSSL libcrypto:
+ *   cl /O2 /EHsc /Ilibs /Ilibs\openssl\include bench\winhash_alloc_test.c libs\WinHash.cpp
+ *      libs\crc32*.c libs\sha256_mb*.c libs\BLAKE3\blake3*.c libs\xxHash\xxhash.c
+ *      libcrypto.lib
+ * or with GCC/Clang on Linux, from the objects built as in hash_bench.c:
+ *   cc -O2 -Ibench/compat -Ilibs bench/winhash_alloc_test.c *.o -lcrypto -lstdc++ -o winhash_alloc_test
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include "WinHash.h"
+#include "openssl/crypto.h"
+
+#define TEST_WARMUP_FILES  2
+#define TEST_FILES         1000
+#define TEST_FILE_SIZE     0x3000
+
+#define WHEX_OPENSSL (WHEX_CHECKMD5 | WHEX_CHECKSHA1 | WHEX_CHECKSHA256 | WHEX_CHECKSHA512 | \
+                      WHEX_CHECKSHA3_256 | WHEX_CHECKSHA3_512 | WHEX_CHECKSHA512_256)
+
+static volatile LONG g_cAllocs;
+
+static void *counting_malloc( size_t cb, const char *file, int line )
+{
+	UNREFERENCED_PARAMETER(file);
+	UNREFERENCED_PARAMETER(line);
+	InterlockedIncrement(&g_cAllocs);
+	return(malloc(cb));
+}
+
+static void *counting_realloc( void *p, size_t cb, const char *file, int line )
+{
+	UNREFERENCED_PARAMETER(file);
+	UNREFERENCED_PARAMETER(line);
+	InterlockedIncrement(&g_cAllocs);
+	return(realloc(p, cb));
+}
+
+static void counting_free( void *p, const char *file, int line )
+{
+	UNREFERENCED_PARAMETER(file);
+	UNREFERENCED_PARAMETER(line);
+	free(p);
+}
+
+static UINT CountBits( DWORD dw )
+{
+	UINT c = 0;
+	for ( ; dw; dw &= dw - 1)
+		++c;
+	return(c);
+}
+
+static void HashOneFile( PWHCTXEX pwhctx, PWHRESULTEX pwhres, PCBYTE pbFile, UINT cbFile )
+{
+	pwhctx->dwFlags = WHEX_ALL;
+	pwhctx->uCaseMode = WHFMT_LOWERCASE;
+	pwhres->dwFlags = 0;
+
+	WHInitEx(pwhctx);
+	WHUpdateEx(pwhctx, pbFile, cbFile / 2);
+	WHUpdateEx(pwhctx, pbFile + cbFile / 2, cbFile - cbFile / 2);
+	WHFinishEx(pwhctx, pwhres);
+}
+
+int main( void )
+{
+	static BYTE abFile[TEST_FILE_SIZE];
+	static WHCTXEX whctx;  // zero-initialized, as required before first use
+	static WHCTXEX whctxFresh;
+	static WHRESULTEX whresFirst, whres, whresFresh;
+	LONG cAllocsBefore, cAllocsPerFile, cAllowedPerFile;
+	UINT i;
+
+	if (!CRYPTO_set_mem_functions(counting_malloc, counting_realloc, counting_free))
+	{
+		printf("FAIL: could not install the OpenSSL allocator hooks\n");
+		return(1);
+	}
+
+	for (i = 0; i < TEST_FILE_SIZE; ++i)
+		abFile[i] = (BYTE)(i * 2654435761u >> 24);
+
+	// The first files allocate the long-lived EVP contexts and their digest state
+	HashOneFile(&whctx, &whresFirst, abFile, TEST_FILE_SIZE);
+	for (i = 1; i < TEST_WARMUP_FILES; ++i)
+		HashOneFile(&whctx, &whres, abFile, i);
+
+	cAllocsBefore = g_cAllocs;
+	for (i = 0; i < TEST_FILES; ++i)
+		HashOneFile(&whctx, &whres, abFile, i % TEST_FILE_SIZE);
+	cAllocsPerFile = (g_cAllocs - cAllocsBefore + TEST_FILES - 1) / TEST_FILES;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	cAllowedPerFile = CountBits(WHEX_OPENSSL);
+#else
+	cAllowedPerFile = 0;
+#endif
+
+	printf("%s: %ld OpenSSL allocations over %u reused-context files (%ld per file, %ld allowed)\n",
+	       OpenSSL_version(OPENSSL_VERSION), (long)(g_cAllocs - cAllocsBefore), TEST_FILES,
+	       (long)cAllocsPerFile, (long)cAllowedPerFile);
+
+	// A reused context must give the same results as it did the first time...
+	HashOneFile(&whctx, &whres, abFile, TEST_FILE_SIZE);
+	// ...and as a freshly zeroed one
+	HashOneFile(&whctxFresh, &whresFresh, abFile, TEST_FILE_SIZE);
+
+	WHFreeEx(&whctx);
+	WHFreeEx(&whctxFresh);
+
+	if (memcmp(&whres, &whresFirst, sizeof(whres)) || memcmp(&whres, &whresFresh, sizeof(whres)))
+	{
+		printf("FAIL: a reused context produced different digests\n");
+		return(1);
+	}
+
+	if (cAllocsPerFile > cAllowedPerFile)
+	{
+		printf("FAIL: the per-file hashing path allocates\n");
+		return(1);
+	}
+
+	printf("OK\n");
+	return(0);
+}
@@ -8,6 +8,12 @@
 extern "C" {
 #endif
 
+// Like HashCheck's USE_PPL: multithreaded updates use the Parallel Patterns
+// Library that ships with Visual C++ 2010 and later
+#if defined(_MSC_VER) && _MSC_VER >= 1600 && !defined(NO_PPL) && !defined(BLAKE3_NO_PPL)
+#define BLAKE3_USE_PPL
+#endif
+
 #define BLAKE3_KEY_LEN 32
 #define BLAKE3_OUT_LEN 32
 #define BLAKE3_BLOCK_LEN 64
@@ -46,6 +52,11 @@ void blake3_hasher_init_derive_key_raw(blake3_hasher *self, const void *context,
                                        size_t context_len);
 void blake3_hasher_update(blake3_hasher *self, const void *input,
                           size_t input_len);
+#if defined(BLAKE3_USE_PPL)
+// Gives large inputs' subtrees to separate PPL tasks; the output is the same
+void blake3_hasher_update_ppl(blake3_hasher *self, const void *input,
+                              size_t input_len);
+#endif
 void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out,
                             size_t out_len);
 void blake3_hasher_finalize_seek(const blake3_hasher *self, uint64_t seek,
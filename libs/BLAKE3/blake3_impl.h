@@ -182,6 +182,36 @@ void blake3_hash_many(const uint8_t *const *inputs, size_t num_inputs,
 
 size_t blake3_simd_degree(void);
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t blake3_compress_subtree_wide(const uint8_t *input, size_t input_len,
+                                    const uint32_t key[8],
+                                    uint64_t chunk_counter, uint8_t flags,
+                                    uint8_t *out, bool use_ppl);
+
+#if defined(BLAKE3_USE_PPL)
+// Subtrees smaller than this are not worth a task of their own
+#define BLAKE3_PPL_MIN_SUBTREE_LEN (32 * BLAKE3_CHUNK_LEN)
+
+// Hashes both subtrees of blake3_compress_subtree_wide() in parallel; in
+// blake3_ppl.cpp, since PPL is a C++ library
+void blake3_compress_subtree_wide_join_ppl(
+    // shared params
+    const uint32_t key[8], uint8_t flags, bool use_ppl,
+    // left-hand side params
+    const uint8_t *l_input, size_t l_input_len, uint64_t l_chunk_counter,
+    uint8_t *l_cvs, size_t *l_n,
+    // right-hand side params
+    const uint8_t *r_input, size_t r_input_len, uint64_t r_chunk_counter,
+    uint8_t *r_cvs, size_t *r_n);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 
 // Declarations for implementation-specific functions.
 void blake3_compress_in_place_portable(uint32_t cv[8],
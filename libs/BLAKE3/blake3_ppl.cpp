@@ -0,0 +1,32 @@
+// Multithreaded subtree hashing for blake3_hasher_update_ppl(), with the
+// Parallel Patterns Library (the same scheme as upstream BLAKE3's oneTBB
+// support). Each task recurses into blake3_compress_subtree_wide(), which
+// forks again for as long as both of its subtrees are big enough.
+
+#include "blake3_impl.h"
+
+#if defined(BLAKE3_USE_PPL)
+
+#include <ppl.h>
+
+extern "C" void blake3_compress_subtree_wide_join_ppl(
+    // shared params
+    const uint32_t key[8], uint8_t flags, bool use_ppl,
+    // left-hand side params
+    const uint8_t *l_input, size_t l_input_len, uint64_t l_chunk_counter,
+    uint8_t *l_cvs, size_t *l_n,
+    // right-hand side params
+    const uint8_t *r_input, size_t r_input_len, uint64_t r_chunk_counter,
+    uint8_t *r_cvs, size_t *r_n) {
+  concurrency::parallel_invoke(
+      [=]() {
+        *l_n = blake3_compress_subtree_wide(
+            l_input, l_input_len, key, l_chunk_counter, flags, l_cvs, use_ppl);
+      },
+      [=]() {
+        *r_n = blake3_compress_subtree_wide(
+            r_input, r_input_len, key, r_chunk_counter, flags, r_cvs, use_ppl);
+      });
+}
+
+#endif
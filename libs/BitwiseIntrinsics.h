@@ -17,6 +17,13 @@ extern "C" {
 // -----------------------------------------------------------------------------
 // SwapV16/SwapV32/SwapV64
 // Endian swap functions for 16, 32, and 64 bit words.
+#if defined(__GNUC__) && !defined(_MSC_VER)
+// GCC and Clang (for the benchmarks in bench/, which also build on Linux)
+#include <stddef.h>
+#define SwapV16 __builtin_bswap16
+#define SwapV32 __builtin_bswap32
+#define SwapV64 __builtin_bswap64
+#else
 #if _MSC_VER < 1310
 #   error bitwise intrinsics require MSVC 7.1+
 #endif
@@ -28,6 +35,7 @@ extern "C" {
 #define SwapV16 _byteswap_ushort
 #define SwapV32 _byteswap_ulong
 #define SwapV64 _byteswap_uint64
+#endif
 // -----------------------------------------------------------------------------
 
 
@@ -49,6 +57,12 @@ __forceinline void SwapA16I( unsigned short *data, size_t words )
 // -----------------------------------------------------------------------------
 // RotLV32/RotRV32/RotLV64/RotRV64
 // Rotation functions for 32 and 64 bit words.
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define RotLV32(x, n) ((unsigned int)(x) << ((n) & 31) | (unsigned int)(x) >> (-(n) & 31))
+#define RotRV32(x, n) ((unsigned int)(x) >> ((n) & 31) | (unsigned int)(x) << (-(n) & 31))
+#define RotLV64(x, n) ((unsigned long long)(x) << ((n) & 63) | (unsigned long long)(x) >> (-(n) & 63))
+#define RotRV64(x, n) ((unsigned long long)(x) >> ((n) & 63) | (unsigned long long)(x) << (-(n) & 63))
+#else
 #pragma intrinsic(_rotl)
 #pragma intrinsic(_rotr)
 #pragma intrinsic(_rotl64)
@@ -58,6 +72,7 @@ __forceinline void SwapA16I( unsigned short *data, size_t words )
 #define RotRV32 _rotr
 #define RotLV64 _rotl64
 #define RotRV64 _rotr64
+#endif
 // -----------------------------------------------------------------------------
 
 
@@ -6,13 +6,16 @@
  * Modified work copyright (C) 2016 Tim Schlueter.  All rights reserved.
  * Modified work copyright (C) 2021 Mounir IDRASSI.  All rights reserved.
  *
- * This is a wrapper for the CRC32, MD5, SHA1, SHA2-256, SHA2-512 and Blake3
- * algorithms.
+ * This is a wrapper for the CRC32, CRC32C, MD5, SHA1, SHA2-256, SHA2-512,
+ * SHA2-512/256, SHA3-256, SHA3-512, Blake3 and XXH3-128 algorithms; results
+ * are kept as binary digests and formatted as hex on demand.
  *
  * WinHash.cpp is needed only if the WH*To* or WH*Ex functions are used.
  **/
 
 #include "WinHash.h"
+#include "sha256_mb_impl.h"
+#include "hexconv_impl.h"
 #ifdef USE_PPL
 #include <ppl.h>
 #endif
@@ -32,6 +35,18 @@ LPCTSTR g_szHashExtsTab[NUM_HASHES + 1] = {
 
 BOOL WHAPI WHHexToByte( PTSTR pszSrc, PBYTE pbDest, UINT cchHex )
 {
+#ifdef UNICODE
+	// Whole blocks of digit pairs are converted by the SIMD kernels (hexconv.c),
+	// which leave the rest, and any invalid block, to the loop below
+	if (!(cchHex & 1))
+	{
+		UINT cchDone = (UINT)hex_decode_utf16(pbDest, (const uint16_t *)pszSrc, cchHex);
+		pszSrc += cchDone;
+		pbDest += cchDone / 2;
+		cchHex -= cchDone;
+	}
+#endif
+
 	while (cchHex)
 	{
 		BYTE hex = LOBYTE(*pszSrc);
@@ -82,6 +97,17 @@ BOOL WHAPI WHHexToByte( PTSTR pszSrc, PBYTE pbDest, UINT cchHex )
 
 PTSTR WHAPI WHByteToHex( PBYTE pbSrc, PTSTR pszDest, UINT cchHex, UINT8 uCaseMode )
 {
+#ifdef UNICODE
+	// Whole blocks of bytes are converted by the SIMD kernels (hexconv.c)
+	if (!(cchHex & 1))
+	{
+		UINT cbDone = (UINT)hex_encode_utf16((uint16_t *)pszDest, pbSrc, cchHex / 2, uCaseMode);
+		pbSrc += cbDone;
+		pszDest += cbDone * 2;
+		cchHex -= cbDone * 2;
+	}
+#endif
+
 	while (cchHex)
 	{
 		BYTE hex = *pbSrc;
@@ -126,15 +152,19 @@ VOID WHAPI WHInitEx( PWHCTXEX pContext )
 VOID WHAPI WHUpdateEx( PWHCTXEX pContext, PCBYTE pbIn, UINT cbIn )
 {
 #ifdef USE_PPL
-    if (cbIn > 384u) {  // determined experimentally--smaller than this and multithreading doesn't help, but ymmv
+    UINT cTasks = 0;
+#define WIN_HASH_UPDATE_COUNT_op(alg)         \
+    if (pContext->dwFlags & WHEX_CHECK##alg)  \
+        cTasks++;
+    FOR_EACH_HASH(WIN_HASH_UPDATE_COUNT_op)
 
-        int cTasks = 0;
-#define WIN_HASH_UPDATE_COUNT_op(alg)             \
-        if (pContext->dwFlags & WHEX_CHECK##alg)  \
-            cTasks++;
-        FOR_EACH_HASH(WIN_HASH_UPDATE_COUNT_op)
+    // With fewer cores than algorithms, the tasks would just take turns at the
+    // cores, each streaming the whole buffer through the cache again; and below
+    // the calibrated size for this set of algorithms (WinHashTuning.cpp), the
+    // task group costs more than running them in turn saves
+    if (cTasks > 1 && cTasks <= WHTuningMaxTasks()) {
 
-        if (cTasks > 1)
+        if (cbIn > WHTuningParallelMin(pContext->dwFlags))
         {
 
 #define WIN_HASH_UPDATE_TASK_op(alg)  \
@@ -162,13 +192,394 @@ VOID WHAPI WHUpdateEx( PWHCTXEX pContext, PCBYTE pbIn, UINT cbIn )
 
 VOID WHAPI WHFinishEx( PWHCTXEX pContext, PWHRESULTEX pResults )
 {
-#define WIN_HASH_FINISH_op(alg)               \
-    if (pContext->dwFlags & WHEX_CHECK##alg)  \
-    {                                         \
-        WHFinish##alg(&pContext->ctx##alg);   \
-        WHByteToHex(pContext->ctx##alg.result, pResults->szHex##alg, alg##_DIGEST_LENGTH * 2, pContext->uCaseMode);  \
-    }
+    const DWORD dwSlots = pResults->dwSlots ? pResults->dwSlots : WHEX_ALL;
+    PBYTE pbDigest = pResults->abDigests;
+
+    // Only the raw digests are kept; WHResultToHex formats them if and when they're shown
+#define WIN_HASH_FINISH_op(alg)                                                   \
+    if (pContext->dwFlags & WHEX_CHECK##alg)                                      \
+    {                                                                             \
+        WHFinish##alg(&pContext->ctx##alg);                                       \
+        if (dwSlots & WHEX_CHECK##alg)                                            \
+            memcpy(pbDigest, pContext->ctx##alg.result, alg##_DIGEST_LENGTH);     \
+    }                                                                             \
+    if (dwSlots & WHEX_CHECK##alg)                                                \
+        pbDigest += alg##_DIGEST_LENGTH;
     FOR_EACH_HASH(WIN_HASH_FINISH_op)
 
-    pResults->dwFlags |= pContext->dwFlags;
+    pResults->dwFlags |= pContext->dwFlags & dwSlots;
+    pResults->uCaseMode = pContext->uCaseMode;
+}
+
+UINT WHAPI WHResultSize( DWORD dwSlots )
+{
+    UINT cbDigests = 0;
+
+    if (dwSlots == 0)
+        return(sizeof(WHRESULTEX));
+
+#define WIN_HASH_RESULT_SIZE_op(alg)      \
+    if (dwSlots & WHEX_CHECK##alg)        \
+        cbDigests += alg##_DIGEST_LENGTH;
+    FOR_EACH_HASH(WIN_HASH_RESULT_SIZE_op)
+
+    return((UINT)FIELD_OFFSET(WHRESULTEX, abDigests) + cbDigests);
+}
+
+// Returns the digest of uAlg, or NULL if it isn't present
+PCBYTE WHAPI WHResultDigest( PCWHRESULTEX pResults, UINT uAlg )
+{
+    const DWORD dwSlots = pResults->dwSlots ? pResults->dwSlots : WHEX_ALL;
+    PCBYTE pbDigest = pResults->abDigests;
+
+    if (uAlg == 0 || uAlg > NUM_HASHES || !(pResults->dwFlags & (1UL << (uAlg - 1))))
+        return(NULL);
+
+#define WIN_HASH_RESULT_DIGEST_op(alg)    \
+    if (uAlg == alg)                      \
+        return(pbDigest);                 \
+    if (dwSlots & WHEX_CHECK##alg)        \
+        pbDigest += alg##_DIGEST_LENGTH;
+    FOR_EACH_HASH(WIN_HASH_RESULT_DIGEST_op)
+
+    return(NULL);
+}
+
+// Formats the digest of uAlg into pszDest, which must hold alg##_DIGEST_STRING_LENGTH
+// characters; returns a pointer to the terminating NUL, or NULL if it isn't present
+PTSTR WHAPI WHResultToHex( PCWHRESULTEX pResults, UINT uAlg, PTSTR pszDest )
+{
+    PCBYTE pbDigest = WHResultDigest(pResults, uAlg);
+
+    if (pbDigest == NULL)
+        return(NULL);
+
+    switch (uAlg)
+    {
+#define WIN_HASH_RESULT_TO_HEX_op(alg)  \
+        case alg:  return(WHByteToHex((PBYTE)pbDigest, pszDest, alg##_DIGEST_LENGTH * 2, pResults->uCaseMode));
+        FOR_EACH_HASH(WIN_HASH_RESULT_TO_HEX_op)
+    }
+
+    return(NULL);
+}
+
+VOID WHAPI WHFreeEx( PWHCTXEX pContext )
+{
+    // Free every context, not just those in dwFlags, which may have changed since they were used
+#define WIN_HASH_FREE_op(alg)  \
+    WHFree##alg(&pContext->ctx##alg);
+    FOR_EACH_HASH(WIN_HASH_FREE_op)
+}
+
+/**
+ * Exporting and importing the hash state
+ *
+ * The blob is a WHSTATEHEADER followed by, for each algorithm in dwFlags in
+ * FOR_EACH_HASH order, its state's length (a UINT32) and the state itself:
+ * the CRCs' running value, BLAKE3's hasher (chunk state and CV stack),
+ * XXH3's state, and, with OpenSSL 1.1, the digest's native midstate (e.g. a
+ * SHA256_CTX), which lives in the EVP_MD_CTX's md_data.  These are all plain
+ * data, laid out as this build lays them out, so the header records the
+ * pointer size as well as the version, and a CRC-32 of the whole blob (taken
+ * with dwCheck zeroed) catches a truncated or damaged checkpoint.
+ **/
+
+#define WHEX_STATE_MAGIC 0x54534857  // "WHST"
+
+typedef struct {
+    UINT32 dwMagic;
+    UINT16 wVersion;
+    UINT16 cbPointer;
+    UINT32 dwFlags;
+    UINT32 cbBlob;
+    UINT64 cbOffset;
+    UINT32 dwCheck;
+    UINT32 dwReserved;
+} WHSTATEHEADER;
+
+// Returns the state of one algorithm and its length, or NULL if it can't be reached
+static PBYTE WHStateOf( PWHCTXEX pContext, UINT uAlg, PUINT pcbState )
+{
+    PWHCTXOPENSSL pOpenSSL;
+
+    switch (uAlg)
+    {
+        case CRC32:
+            *pcbState = sizeof(pContext->ctxCRC32.state);
+            return((PBYTE)&pContext->ctxCRC32.state);
+        case CRC32C:
+            *pcbState = sizeof(pContext->ctxCRC32C.state);
+            return((PBYTE)&pContext->ctxCRC32C.state);
+        case BLAKE3:
+            *pcbState = sizeof(pContext->ctxBLAKE3.m_ctx);
+            return((PBYTE)&pContext->ctxBLAKE3.m_ctx);
+        case XXH3_128:
+            *pcbState = sizeof(pContext->ctxXXH3_128.m_ctx);
+            return((PBYTE)&pContext->ctxXXH3_128.m_ctx);
+        case MD5:        pOpenSSL = &pContext->ctxMD5;        break;
+        case SHA1:       pOpenSSL = &pContext->ctxSHA1;       break;
+        case SHA256:     pOpenSSL = &pContext->ctxSHA256;     break;
+        case SHA512:     pOpenSSL = &pContext->ctxSHA512;     break;
+        case SHA3_256:   pOpenSSL = &pContext->ctxSHA3_256;   break;
+        case SHA3_512:   pOpenSSL = &pContext->ctxSHA3_512;   break;
+        case SHA512_256: pOpenSSL = &pContext->ctxSHA512_256; break;
+        default:
+            return(NULL);
+    }
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    if (pOpenSSL->ctx && EVP_MD_CTX_md_data(pOpenSSL->ctx))
+    {
+        *pcbState = EVP_MD_meth_get_app_datasize(EVP_MD_CTX_md(pOpenSSL->ctx));
+        return(*pcbState ? (PBYTE)EVP_MD_CTX_md_data(pOpenSSL->ctx) : NULL);
+    }
+#else
+    (void)pOpenSSL;
+#endif
+    return(NULL);
 }
+
+UINT WHAPI WHExportEx( PWHCTXEX pContext, ULONGLONG cbOffset, PBYTE pbBlob, UINT cbBlob )
+{
+    WHSTATEHEADER header = { WHEX_STATE_MAGIC, WHEX_STATE_VERSION, sizeof(PVOID), pContext->dwFlags, 0, cbOffset, 0, 0 };
+    UINT cbNeeded = sizeof(header), cbState;
+    PBYTE pbState;
+
+    // First, the size
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        if (! (pContext->dwFlags & (1UL << (uAlg - 1))))
+            continue;
+        if (! WHStateOf(pContext, uAlg, &cbState))
+            return(0);
+        cbNeeded += sizeof(UINT32) + cbState;
+    }
+
+    if (cbNeeded > cbBlob)
+        return(cbNeeded);
+
+    // Then the contents
+    header.cbBlob = cbNeeded;
+    memcpy(pbBlob, &header, sizeof(header));
+    PBYTE pbOut = pbBlob + sizeof(header);
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        if (! (pContext->dwFlags & (1UL << (uAlg - 1))))
+            continue;
+        pbState = WHStateOf(pContext, uAlg, &cbState);
+        UINT32 cbRecord = cbState;
+        memcpy(pbOut, &cbRecord, sizeof(cbRecord));
+        memcpy(pbOut + sizeof(cbRecord), pbState, cbState);
+        pbOut += sizeof(cbRecord) + cbState;
+    }
+
+    header.dwCheck = crc32(0, pbBlob, cbNeeded);
+    memcpy(pbBlob, &header, sizeof(header));
+    return(cbNeeded);
+}
+
+BOOL WHAPI WHImportEx( PWHCTXEX pContext, PCBYTE pbBlob, UINT cbBlob, PULONGLONG pcbOffset )
+{
+    WHSTATEHEADER header;
+    UINT cbState;
+    PBYTE pbState;
+
+    if (cbBlob < sizeof(header))
+        return(FALSE);
+    memcpy(&header, pbBlob, sizeof(header));
+
+    if ( header.dwMagic != WHEX_STATE_MAGIC || header.wVersion != WHEX_STATE_VERSION ||
+         header.cbPointer != sizeof(PVOID) || header.dwFlags != pContext->dwFlags ||
+         header.cbBlob != cbBlob )
+        return(FALSE);
+
+    // The check was taken with itself zeroed
+    UINT32 dwCheck = crc32(0, pbBlob, FIELD_OFFSET(WHSTATEHEADER, dwCheck));
+    UINT32 dwZero = 0;
+    dwCheck = crc32(dwCheck, (PCBYTE)&dwZero, sizeof(dwZero));
+    dwCheck = crc32(dwCheck, pbBlob + FIELD_OFFSET(WHSTATEHEADER, dwReserved), cbBlob - FIELD_OFFSET(WHSTATEHEADER, dwReserved));
+    if (dwCheck != header.dwCheck)
+        return(FALSE);
+
+    // Initializing first sets up the EVP_MD_CTXs (and their md_data) for the
+    // states to be copied into, and any pointers that the states hold
+    WHInitEx(pContext);
+
+    PCBYTE pbIn = pbBlob + sizeof(header);
+    PCBYTE pbEnd = pbBlob + cbBlob;
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        UINT32 cbRecord;
+
+        if (! (pContext->dwFlags & (1UL << (uAlg - 1))))
+            continue;
+        if ((pbState = WHStateOf(pContext, uAlg, &cbState)) == NULL || pbEnd - pbIn < (ptrdiff_t)sizeof(cbRecord))
+            return(FALSE);
+        memcpy(&cbRecord, pbIn, sizeof(cbRecord));
+        if (cbRecord != cbState || (size_t)(pbEnd - pbIn) - sizeof(cbRecord) < cbState)
+            return(FALSE);
+
+        if (uAlg == XXH3_128)
+        {
+            // XXH3 points to its default secret, which is wherever this process has it
+            const unsigned char* pSecret = pContext->ctxXXH3_128.m_ctx.extSecret;
+            memcpy(pbState, pbIn + sizeof(cbRecord), cbState);
+            pContext->ctxXXH3_128.m_ctx.extSecret = pSecret;
+        }
+        else
+        {
+            memcpy(pbState, pbIn + sizeof(cbRecord), cbState);
+        }
+        pbIn += sizeof(cbRecord) + cbState;
+    }
+
+    *pcbOffset = header.cbOffset;
+    return(pbIn == pbEnd);
+}
+
+/**
+ * Multi-buffer hashing
+ *
+ * With OpenSSL 1.1, the digest state inside an EVP_sha256() context is a plain
+ * SHA256_CTX, so the lanes' whole blocks can be compressed together by the
+ * sha256_mb kernels while OpenSSL still buffers partial blocks and pads and
+ * finalizes them as usual.  OpenSSL 3 hides the state inside its providers,
+ * so there every lane is simply updated in turn.
+ **/
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+
+// openssl/sha.h can't be included along with WinHash.h, whose hash_algorithm names clash
+// with its one-shot SHA1()/SHA256()/SHA512() functions, so this mirrors its SHA256_CTX
+#define SHA256_CBLOCK 64
+typedef unsigned int SHA_LONG;
+typedef struct {
+    SHA_LONG h[8];
+    SHA_LONG Nl, Nh;  // message length in bits
+    SHA_LONG data[SHA256_CBLOCK / 4];
+    unsigned int num, md_len;
+} SHA256_CTX;
+extern "C" int SHA256_Update( SHA256_CTX* c, const void* data, size_t len );
+
+__inline SHA256_CTX* GetSHA256State( PWHCTXEX pContext )
+{
+    EVP_MD_CTX* ctx = pContext->ctxSHA256.ctx;
+    // Paranoia: an ENGINE could have substituted its own implementation
+    return(EVP_MD_CTX_md(ctx) == EVP_sha256() ? (SHA256_CTX*)EVP_MD_CTX_md_data(ctx) : NULL);
+}
+
+#endif
+
+UINT WHAPI WHMultiLanes( DWORD dwFlags )
+{
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    if (dwFlags & WHEX_CHECKSHA256)
+    {
+        UINT cLanes = sha256_mb_lanes();
+        return(cLanes < WHEX_MAX_LANES ? cLanes : WHEX_MAX_LANES);
+    }
+#else
+    UNREFERENCED_PARAMETER(dwFlags);  // no multi-buffer kernel can reach OpenSSL 3's state
+#endif
+    return(0);
+}
+
+VOID WHAPI WHUpdateMultiEx( PWHCTXEX ppContexts[], PCBYTE ppbIn[], const UINT pcbIn[], UINT cLanes )
+{
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    uint32_t* ppState[WHEX_MAX_LANES];
+    const uint8_t* ppbBlocks[WHEX_MAX_LANES];
+    size_t pcBlocks[WHEX_MAX_LANES];
+    SHA256_CTX* ppSHA256[WHEX_MAX_LANES];
+    PCBYTE ppbTail[WHEX_MAX_LANES];
+    UINT pcbTail[WHEX_MAX_LANES];
+    UINT cMulti = 0;
+#endif
+    UINT i;
+
+    for (i = 0; i < cLanes; ++i)
+    {
+        PWHCTXEX pContext = ppContexts[i];
+        PCBYTE pbIn = ppbIn[i];
+        UINT cbIn = pcbIn[i];
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+        SHA256_CTX* pSHA256;
+        if ((pContext->dwFlags & WHEX_CHECKSHA256) && cLanes > 1 && sha256_mb_lanes() &&
+            (pSHA256 = GetSHA256State(pContext)) != NULL)
+        {
+            // Everything but SHA-256 is updated as usual
+            pContext->dwFlags &= ~WHEX_CHECKSHA256;
+            WHUpdateEx(pContext, pbIn, cbIn);
+            pContext->dwFlags |= WHEX_CHECKSHA256;
+
+            // First complete any partial block left over from the last update
+            if (pSHA256->num)
+            {
+                UINT cbHead = SHA256_CBLOCK - pSHA256->num;
+                if (cbHead > cbIn)
+                    cbHead = cbIn;
+                SHA256_Update(pSHA256, pbIn, cbHead);
+                pbIn += cbHead;
+                cbIn -= cbHead;
+            }
+
+            // Then queue up the whole blocks, whose length SHA256_CTX counts in bits
+            size_t cbBlocks = cbIn & ~(SHA256_CBLOCK - 1);
+            SHA_LONG Nl = pSHA256->Nl + (SHA_LONG)(cbBlocks << 3);
+            if (Nl < pSHA256->Nl)
+                pSHA256->Nh++;
+            pSHA256->Nh += (SHA_LONG)((ULONGLONG)cbBlocks >> 29);
+            pSHA256->Nl = Nl;
+
+            ppState[cMulti] = pSHA256->h;
+            ppbBlocks[cMulti] = pbIn;
+            pcBlocks[cMulti] = cbBlocks / SHA256_CBLOCK;
+            ppSHA256[cMulti] = pSHA256;
+            ppbTail[cMulti] = pbIn + cbBlocks;
+            pcbTail[cMulti] = (UINT)(cbIn - cbBlocks);
+            cMulti++;
+            continue;
+        }
+#endif
+        WHUpdateEx(pContext, pbIn, cbIn);
+    }
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    if (cMulti)
+    {
+        sha256_mb_compress(ppState, ppbBlocks, pcBlocks, cMulti);
+
+        // And finally buffer what's left of each lane (less than a block)
+        for (i = 0; i < cMulti; ++i)
+            SHA256_Update(ppSHA256[i], ppbTail[i], pcbTail[i]);
+    }
+#endif
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+
+const EVP_MD* WHAPI WHFetchMD( UINT uAlg, const char* pszName )
+{
+    // Fetched once per process and shared by all threads (EVP_MD objects are immutable)
+    static EVP_MD* volatile s_pmdFetched[NUM_HASHES + 1];
+
+    EVP_MD* pmd = s_pmdFetched[uAlg];
+    if (pmd == NULL)
+    {
+        pmd = EVP_MD_fetch(NULL, pszName, NULL);
+        EVP_MD* pmdPrev = (EVP_MD*)InterlockedCompareExchangePointer((PVOID volatile*)&s_pmdFetched[uAlg], pmd, NULL);
+        if (pmdPrev != NULL)
+        {
+            // Another thread got there first
+            EVP_MD_free(pmd);
+            pmd = pmdPrev;
+        }
+    }
+    return(pmd);
+}
+
+#endif
@@ -6,8 +6,8 @@
  * Modified work copyright (C) 2016 Tim Schlueter.  All rights reserved.
  * Modified work copyright (C) 2021 Mounir IDRASSI.  All rights reserved.
  * 
- * This is a wrapper for the CRC32, MD5, SHA1, SHA2-256, SHA2-512 and Blake3
- * algorithms.
+ * This is a wrapper for the CRC32, CRC32C, MD5, SHA1, SHA2-256, SHA2-512,
+ * SHA2-512/256, SHA3-256, SHA3-512, Blake3 and XXH3-128 algorithms.
  **/
 
 #ifndef __WINHASH_H__
@@ -19,8 +19,10 @@ extern "C" {
 
 #include <windows.h>
 #include <tchar.h>
-#include "openssl\evp.h"
-#include "BLAKE3/\blake3.h"
+#include "openssl/evp.h"
+#include "BLAKE3/blake3.h"
+#define XXH_STATIC_LINKING_ONLY  // for XXH3_state_t
+#include "xxHash/xxhash.h"
 #include "BitwiseIntrinsics.h"
 
 #if _MSC_VER >= 1600 && !defined(NO_PPL)
@@ -49,16 +51,22 @@ typedef CONST BYTE *PCBYTE;
                             op(SHA512)  \
                             op(SHA3_256)\
                             op(SHA3_512)\
-                            op(BLAKE3)
+                            op(BLAKE3)  \
+                            op(XXH3_128)\
+                            op(CRC32C)  \
+                            op(SHA512_256)
 // In approximate order from longest to shortest compute time
 #define FOR_EACH_HASH_R(op) op(SHA512)  \
+                            op(SHA512_256)\
                             op(SHA256)  \
                             op(SHA3_512)\
                             op(SHA3_256)\
                             op(SHA1)    \
                             op(CRC32)   \
                             op(MD5)     \
-                            op(BLAKE3)
+                            op(BLAKE3)  \
+                            op(XXH3_128)\
+                            op(CRC32C)
 
 /**
  * Some constants related to the hash algorithms
@@ -73,9 +81,12 @@ enum hash_algorithm {
     SHA512,
     SHA3_256,
     SHA3_512,
-    BLAKE3
+    BLAKE3,
+    XXH3_128,
+    CRC32C,
+    SHA512_256
 };
-#define NUM_HASHES BLAKE3
+#define NUM_HASHES SHA512_256
 
 // The default hash algorithm to use when creating a checksum file
 #define DEFAULT_HASH_ALGORITHM SHA256
@@ -92,14 +103,17 @@ enum hash_algorithm {
 #define WHEX_CHECKSHA3_256  (1UL << (SHA3_256 - 1))
 #define WHEX_CHECKSHA3_512  (1UL << (SHA3_512 - 1))
 #define WHEX_CHECKBLAKE3    (1UL << (BLAKE3 - 1))
-#define WHEX_CHECKLAST      WHEX_CHECKBLAKE3
+#define WHEX_CHECKXXH3_128  (1UL << (XXH3_128 - 1))
+#define WHEX_CHECKCRC32C    (1UL << (CRC32C - 1))
+#define WHEX_CHECKSHA512_256 (1UL << (SHA512_256 - 1))
+#define WHEX_CHECKLAST      WHEX_CHECKSHA512_256
 
 // Bitwise representation of the hash algorithms, by digest length (in bits)
 #define WHEX_ALL            ((1UL << NUM_HASHES) - 1)
-#define WHEX_ALL32          WHEX_CHECKCRC32
-#define WHEX_ALL128         WHEX_CHECKMD5
+#define WHEX_ALL32          (WHEX_CHECKCRC32 | WHEX_CHECKCRC32C)
+#define WHEX_ALL128         (WHEX_CHECKMD5 | WHEX_CHECKXXH3_128)
 #define WHEX_ALL160         WHEX_CHECKSHA1
-#define WHEX_ALL256         (WHEX_CHECKSHA256 | WHEX_CHECKSHA3_256 | WHEX_CHECKBLAKE3)
+#define WHEX_ALL256         (WHEX_CHECKSHA256 | WHEX_CHECKSHA3_256 | WHEX_CHECKBLAKE3 | WHEX_CHECKSHA512_256)
 #define WHEX_ALL512         (WHEX_CHECKSHA512 | WHEX_CHECKSHA3_512)
 
 // The block lengths of the hash algorithms, if required below
@@ -121,6 +135,9 @@ enum hash_algorithm {
 #define SHA3_256_DIGEST_LENGTH      32
 #define SHA3_512_DIGEST_LENGTH      64
 #define BLAKE3_DIGEST_LENGTH        32
+#define XXH3_128_DIGEST_LENGTH      16
+#define CRC32C_DIGEST_LENGTH        4
+#define SHA512_256_DIGEST_LENGTH    32
 #define MAX_DIGEST_LENGTH           SHA512_DIGEST_LENGTH
 
 // The minimum string length required to hold the hex digest strings
@@ -134,6 +151,9 @@ enum hash_algorithm {
 #define SHA3_256_DIGEST_STRING_LENGTH (SHA3_256_DIGEST_LENGTH * 2 + 1)
 #define SHA3_512_DIGEST_STRING_LENGTH (SHA3_512_DIGEST_LENGTH * 2 + 1)
 #define BLAKE3_DIGEST_STRING_LENGTH (BLAKE3_DIGEST_LENGTH * 2 + 1)
+#define XXH3_128_DIGEST_STRING_LENGTH (XXH3_128_DIGEST_LENGTH * 2 + 1)
+#define CRC32C_DIGEST_STRING_LENGTH (CRC32C_DIGEST_LENGTH * 2 + 1)
+#define SHA512_256_DIGEST_STRING_LENGTH (SHA512_256_DIGEST_LENGTH * 2 + 1)
 #define MAX_DIGEST_STRING_LENGTH    SHA512_DIGEST_STRING_LENGTH
 
 // Hash file extensions
@@ -145,6 +165,9 @@ enum hash_algorithm {
 #define HASH_EXT_SHA3_256       _T(".sha3-256")
 #define HASH_EXT_SHA3_512       _T(".sha3-512")
 #define HASH_EXT_BLAKE3         _T(".blake3")
+#define HASH_EXT_XXH3_128       _T(".xxh128")
+#define HASH_EXT_CRC32C         _T(".crc32c")
+#define HASH_EXT_SHA512_256     _T(".sha512-256")
 
 // Table of supported Hash file extensions, plus .asc
 extern LPCTSTR g_szHashExtsTab[NUM_HASHES + 1];
@@ -158,16 +181,23 @@ extern LPCTSTR g_szHashExtsTab[NUM_HASHES + 1];
 #define HASH_NAME_SHA3_256      _T("SHA3-256")
 #define HASH_NAME_SHA3_512      _T("SHA3-512")
 #define HASH_NAME_BLAKE3        _T("BLAKE3")
-
-// Right-justified Hash names
-#define HASH_RNAME_CRC32        _T("  CRC-32")
-#define HASH_RNAME_MD5          _T("     MD5")
-#define HASH_RNAME_SHA1         _T("   SHA-1")
-#define HASH_RNAME_SHA256       _T(" SHA-256")
-#define HASH_RNAME_SHA512       _T(" SHA-512")
-#define HASH_RNAME_SHA3_256     _T("SHA3-256")
-#define HASH_RNAME_SHA3_512     _T("SHA3-512")
-#define HASH_RNAME_BLAKE3       _T("  BLAKE3")
+#define HASH_NAME_XXH3_128      _T("XXH3-128")
+#define HASH_NAME_CRC32C        _T("CRC-32C")
+#define HASH_NAME_SHA512_256    _T("SHA-512/256")
+
+// Right-justified Hash names, all HASH_RNAME_WIDTH characters wide
+#define HASH_RNAME_CRC32        _T("     CRC-32")
+#define HASH_RNAME_MD5          _T("        MD5")
+#define HASH_RNAME_SHA1         _T("      SHA-1")
+#define HASH_RNAME_SHA256       _T("    SHA-256")
+#define HASH_RNAME_SHA512       _T("    SHA-512")
+#define HASH_RNAME_SHA3_256     _T("   SHA3-256")
+#define HASH_RNAME_SHA3_512     _T("   SHA3-512")
+#define HASH_RNAME_BLAKE3       _T("     BLAKE3")
+#define HASH_RNAME_XXH3_128     _T("   XXH3-128")
+#define HASH_RNAME_CRC32C       _T("    CRC-32C")
+#define HASH_RNAME_SHA512_256   _T("SHA-512/256")
+#define HASH_RNAME_WIDTH        11
 
 // Hash OPENFILENAME filters, E.G. "MD5 (*.md5)\0*.md5\0"
 #define HASH_FILTER_op(alg)     HASH_NAME_##alg _T(" (*")   \
@@ -186,6 +216,8 @@ extern LPCTSTR g_szHashExtsTab[NUM_HASHES + 1];
  **/
 
 UINT32 crc32( UINT32 uInitial, PCBYTE pbIn, UINT cbIn );
+UINT32 crc32_combine( UINT32 crc1, UINT32 crc2, ULONGLONG cb2 );
+UINT32 crc32c( UINT32 uInitial, PCBYTE pbIn, UINT cbIn );
 
 /**
  * Structures used by our consistency wrapper layer
@@ -196,6 +228,8 @@ typedef union {
 	BYTE result[CRC32_DIGEST_LENGTH];
 } WHCTXCRC32, *PWHCTXCRC32;
 
+typedef WHCTXCRC32 WHCTXCRC32C, *PWHCTXCRC32C;
+
 typedef struct {
     EVP_MD_CTX* ctx;
     BYTE result[MAX_DIGEST_LENGTH];
@@ -206,6 +240,11 @@ typedef union {
     BYTE result[BLAKE3_DIGEST_LENGTH];
 } WHCTXBLAKE3, * PWHCTXBLAKE3;
 
+typedef union {
+    XXH3_state_t m_ctx;
+    BYTE result[XXH3_128_DIGEST_LENGTH];
+} WHCTXXXH3_128, * PWHCTXXXH3_128;
+
 /**
  * Wrapper layer functions to ensure a more consistent interface
  **/
@@ -227,11 +266,28 @@ __inline void WHAPI WHFinishCRC32( PWHCTXCRC32 pContext )
 	pContext->state = SwapV32(pContext->state);
 }
 
+__inline void WHAPI WHInitCRC32C( PWHCTXCRC32C pContext )
+{
+	pContext->state = 0;
+}
+
+__inline void WHAPI WHUpdateCRC32C( PWHCTXCRC32C pContext, PCBYTE pbIn, UINT cbIn )
+{
+	pContext->state = crc32c(pContext->state, pbIn, cbIn);
+}
+
+__inline void WHAPI WHFinishCRC32C( PWHCTXCRC32C pContext )
+{
+	pContext->state = SwapV32(pContext->state);
+}
+
+// The EVP_MD_CTX is allocated on first use and then kept (along with its digest state)
+// for every later file hashed with the same context; it's released only by WHFreeEx
 __inline void WHAPI OPENSSL_HASH_INIT(PWHCTXOPENSSL pContext, const EVP_MD* md)
 {
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    EVP_DigestInit(ctx, md);
-    pContext->ctx = ctx;
+    if (pContext->ctx == NULL)
+        pContext->ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(pContext->ctx, md, NULL);
 }
 
 __inline void WHAPI OPENSSL_HASH_UPDATE(PWHCTXOPENSSL pContext, PCBYTE pbIn, UINT cbIn)
@@ -242,8 +298,11 @@ __inline void WHAPI OPENSSL_HASH_UPDATE(PWHCTXOPENSSL pContext, PCBYTE pbIn, UIN
 __inline void WHAPI OPENSSL_HASH_FINISH(PWHCTXOPENSSL pContext)
 {
     unsigned int dummy;
-    EVP_DigestFinal(pContext->ctx, pContext->result, &dummy);
-    EVP_MD_CTX_reset(pContext->ctx);
+    EVP_DigestFinal_ex(pContext->ctx, pContext->result, &dummy);
+}
+
+__inline void WHAPI OPENSSL_HASH_FREE(PWHCTXOPENSSL pContext)
+{
     EVP_MD_CTX_free(pContext->ctx);
     pContext->ctx = NULL;
 }
@@ -255,7 +314,12 @@ __inline void WHAPI WHInitBLAKE3(PWHCTXBLAKE3 pContext)
 
 __inline void WHAPI WHUpdateBLAKE3(PWHCTXBLAKE3 pContext, PCBYTE pbIn, UINT cbIn)
 {
+#ifdef BLAKE3_USE_PPL
+    // Large buffers are split into subtrees that are hashed on several cores
+    blake3_hasher_update_ppl(&pContext->m_ctx, pbIn, cbIn);
+#else
     blake3_hasher_update(&pContext->m_ctx, pbIn, cbIn);
+#endif
 }
 
 __inline void WHAPI WHFinishBLAKE3(PWHCTXBLAKE3 pContext)
@@ -264,29 +328,72 @@ __inline void WHAPI WHFinishBLAKE3(PWHCTXBLAKE3 pContext)
     memset(pContext, 0, (size_t) FINDOFFSET(WHCTXBLAKE3,result));
 }
 
-#define WHInitMD5(a) OPENSSL_HASH_INIT(a,EVP_md5())
+__inline void WHAPI WHInitXXH3_128(PWHCTXXXH3_128 pContext)
+{
+    XXH3_128bits_reset(&pContext->m_ctx);
+}
+
+__inline void WHAPI WHUpdateXXH3_128(PWHCTXXXH3_128 pContext, PCBYTE pbIn, UINT cbIn)
+{
+    XXH3_128bits_update(&pContext->m_ctx, pbIn, cbIn);
+}
+
+__inline void WHAPI WHFinishXXH3_128(PWHCTXXXH3_128 pContext)
+{
+    // Like xxhsum, the result is the big-endian ("canonical") form of the hash
+    XXH128_hash_t hash = XXH3_128bits_digest(&pContext->m_ctx);
+    XXH128_canonicalFromHash((XXH128_canonical_t*)pContext->result, hash);
+}
+
+// Contexts without heap-allocated state have nothing to free
+#define WHFreeCRC32(a)
+#define WHFreeBLAKE3(a)
+#define WHFreeXXH3_128(a)
+#define WHFreeCRC32C(a)
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+// OpenSSL 3 implicitly fetches the provider's implementation each time a legacy
+// EVP_md5()-style digest is passed to EVP_DigestInit_ex; fetch each one only once
+const EVP_MD* WHAPI WHFetchMD( UINT uAlg, const char* pszName );
+#define WH_EVP_MD(alg,name,legacy) WHFetchMD(alg, name)
+#else
+#define WH_EVP_MD(alg,name,legacy) legacy()
+#endif
+
+#define WHInitMD5(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(MD5,"MD5",EVP_md5))
 #define WHUpdateMD5 OPENSSL_HASH_UPDATE
 #define WHFinishMD5 OPENSSL_HASH_FINISH
+#define WHFreeMD5 OPENSSL_HASH_FREE
 
-#define WHInitSHA1(a) OPENSSL_HASH_INIT(a,EVP_sha1())
+#define WHInitSHA1(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(SHA1,"SHA1",EVP_sha1))
 #define WHUpdateSHA1 OPENSSL_HASH_UPDATE
 #define WHFinishSHA1 OPENSSL_HASH_FINISH
+#define WHFreeSHA1 OPENSSL_HASH_FREE
 
-#define WHInitSHA256(a) OPENSSL_HASH_INIT(a,EVP_sha256())
+#define WHInitSHA256(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(SHA256,"SHA256",EVP_sha256))
 #define WHUpdateSHA256 OPENSSL_HASH_UPDATE
 #define WHFinishSHA256 OPENSSL_HASH_FINISH
+#define WHFreeSHA256 OPENSSL_HASH_FREE
 
-#define WHInitSHA512(a) OPENSSL_HASH_INIT(a,EVP_sha512())
+#define WHInitSHA512(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(SHA512,"SHA512",EVP_sha512))
 #define WHUpdateSHA512 OPENSSL_HASH_UPDATE
 #define WHFinishSHA512 OPENSSL_HASH_FINISH
+#define WHFreeSHA512 OPENSSL_HASH_FREE
 
-#define WHInitSHA3_256(a) OPENSSL_HASH_INIT(a,EVP_sha3_256())
+#define WHInitSHA3_256(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(SHA3_256,"SHA3-256",EVP_sha3_256))
 #define WHUpdateSHA3_256 OPENSSL_HASH_UPDATE
 #define WHFinishSHA3_256 OPENSSL_HASH_FINISH
+#define WHFreeSHA3_256 OPENSSL_HASH_FREE
 
-#define WHInitSHA3_512(a) OPENSSL_HASH_INIT(a,EVP_sha3_512())
+#define WHInitSHA3_512(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(SHA3_512,"SHA3-512",EVP_sha3_512))
 #define WHUpdateSHA3_512 OPENSSL_HASH_UPDATE
 #define WHFinishSHA3_512 OPENSSL_HASH_FINISH
+#define WHFreeSHA3_512 OPENSSL_HASH_FREE
+
+#define WHInitSHA512_256(a) OPENSSL_HASH_INIT(a,WH_EVP_MD(SHA512_256,"SHA512-256",EVP_sha512_256))
+#define WHUpdateSHA512_256 OPENSSL_HASH_UPDATE
+#define WHFinishSHA512_256 OPENSSL_HASH_FINISH
+#define WHFreeSHA512_256 OPENSSL_HASH_FREE
 
 /**
  * WH*To* hex string conversion functions: These require WinHash.cpp
@@ -304,19 +411,30 @@ PTSTR WHAPI WHByteToHex( PBYTE pbSrc, PTSTR pszDest, UINT cchHex, UINT8 uCaseMod
  * WH*Ex functions: These require WinHash.cpp
  **/
 
+// WHRESULTEX keeps the raw digests, packed in FOR_EACH_HASH order, of just
+// the algorithms in dwSlots (0 stands for all of them, so a zeroed full-size
+// WHRESULTEX has room for everything); a result that only needs a few slots
+// can be allocated with WHResultSize(dwSlots) bytes rather than sizeof, which
+// is what keeps a HashSave list of millions of files small.  The hex strings
+// are only made when they are needed, by WHResultToHex.
+#define WHEX_DIGEST_LENGTH_op(alg)  + alg##_DIGEST_LENGTH
+#define WHEX_ALL_DIGESTS_LENGTH     (0 FOR_EACH_HASH(WHEX_DIGEST_LENGTH_op))
+
 typedef struct {
-    TCHAR szHexCRC32[CRC32_DIGEST_STRING_LENGTH];
-    TCHAR szHexMD5[MD5_DIGEST_STRING_LENGTH];
-    TCHAR szHexSHA1[SHA1_DIGEST_STRING_LENGTH];
-    TCHAR szHexSHA256[SHA256_DIGEST_STRING_LENGTH];
-    TCHAR szHexSHA512[SHA512_DIGEST_STRING_LENGTH];
-    TCHAR szHexSHA3_256[SHA3_256_DIGEST_STRING_LENGTH];
-    TCHAR szHexSHA3_512[SHA3_512_DIGEST_STRING_LENGTH];
-    TCHAR szHexBLAKE3[BLAKE3_DIGEST_STRING_LENGTH];
-    DWORD dwFlags;
+    DWORD dwFlags;                              // algorithms whose digests are present
+    DWORD dwSlots;                              // algorithms with room in abDigests, or 0 for all
+    UINT8 uCaseMode;                            // WHFMT_* for WHResultToHex, set by WHFinishEx
+    BYTE abDigests[WHEX_ALL_DIGESTS_LENGTH];    // the first WHResultSize(dwSlots) bytes are used
 } WHRESULTEX, *PWHRESULTEX;
+typedef CONST WHRESULTEX *PCWHRESULTEX;
+
+UINT WHAPI WHResultSize( DWORD dwSlots );
+PCBYTE WHAPI WHResultDigest( PCWHRESULTEX pResults, UINT uAlg );
+PTSTR WHAPI WHResultToHex( PCWHRESULTEX pResults, UINT uAlg, PTSTR pszDest );
 
-// Align all the hash contexts to avoid false sharing (of L1/2 cache lines in multi-core systems)
+// Align all the hash contexts to avoid false sharing (of L1/2 cache lines in multi-core systems);
+// a WHCTXEX must be zero-initialized before its first use, and can then be reused for any
+// number of files (by the same thread) without further heap allocations until WHFreeEx
 typedef struct {
 	__declspec(align(64)) WHCTXCRC32  ctxCRC32;
 	__declspec(align(64)) WHCTXOPENSSL ctxMD5;
@@ -326,6 +444,9 @@ typedef struct {
 	__declspec(align(64)) WHCTXOPENSSL ctxSHA3_256;
 	__declspec(align(64)) WHCTXOPENSSL ctxSHA3_512;
     __declspec(align(64)) WHCTXBLAKE3 ctxBLAKE3;
+    __declspec(align(64)) WHCTXXXH3_128 ctxXXH3_128;
+    __declspec(align(64)) WHCTXCRC32C ctxCRC32C;
+    __declspec(align(64)) WHCTXOPENSSL ctxSHA512_256;
 	DWORD dwFlags;
 	UINT8 uCaseMode;
 } WHCTXEX, *PWHCTXEX;
@@ -334,6 +455,94 @@ typedef struct {
 VOID WHAPI WHInitEx( PWHCTXEX pContext );
 VOID WHAPI WHUpdateEx( PWHCTXEX pContext, PCBYTE pbIn, UINT cbIn );
 VOID WHAPI WHFinishEx( PWHCTXEX pContext, PWHRESULTEX pResults );
+VOID WHAPI WHFreeEx( PWHCTXEX pContext );
+
+/**
+ * WHExportEx and WHImportEx save and restore a context's state part-way
+ * through a file, so that hashing can resume there, even in another process.
+ * The state of every selected algorithm goes into a versioned blob along with
+ * the offset that it reflects; WHExportEx returns the blob's size (which may
+ * be more than cbBlob, in which case nothing was written), or 0 if some
+ * algorithm's state can't be exported (OpenSSL 3 keeps its digests' state
+ * inside its providers, out of reach).  WHImportEx takes the place of
+ * WHInitEx, and fails on a blob from another version or build, or for other
+ * algorithms than those in pContext->dwFlags.
+ **/
+
+#define WHEX_STATE_VERSION    1
+#define WHEX_MAX_STATE_LENGTH 0x2000
+
+UINT WHAPI WHExportEx( PWHCTXEX pContext, ULONGLONG cbOffset, PBYTE pbBlob, UINT cbBlob );
+BOOL WHAPI WHImportEx( PWHCTXEX pContext, PCBYTE pbBlob, UINT cbBlob, PULONGLONG pcbOffset );
+
+/**
+ * WHTuning* functions: These require WinHashTuning.cpp
+ *
+ * WHUpdateEx gives each algorithm its own task only when that beats running
+ * them one after another, and callers that hash many files at once need to
+ * know how many to hash at a time.  Rather than guess, WHGetTuning measures
+ * (the first time it's called) each algorithm's speed on this machine and
+ * the cost of running a task group, and the WHTuning* functions derive those
+ * limits from the results.  WHSetTuning replaces the overrides of the limits
+ * (its zero fields leave them calibrated, undoing any earlier override), and
+ * the WHTuning* functions return what is in effect; WHGetTuning's results are
+ * only ever the calibrated ones.
+ * WHTuningPipeline predicts whether a WHPipeline would hash buffers of cbBuffer
+ * bytes enough faster than WHUpdateEx to be worth its threads.
+ **/
+
+typedef struct {
+	// Measured
+	UINT auPsPerByte[NUM_HASHES];  // picoseconds per byte, for each algorithm in FOR_EACH_HASH order
+	UINT uDispatchNs;              // nanoseconds to run and wait for a group of tasks (0 without PPL)
+	// Derived (as calibrated), or to be overridden
+	UINT cbParallelMin;            // if nonzero, fan out above this many bytes, whatever the algorithms
+	UINT cMaxTasks;                // never fan out to more tasks than this (the number of cores)
+	UINT cFileWorkers;             // if nonzero, the files to hash at once on a solid-state device
+	UINT cFileWorkersHDD;          // the files to hash at once on any other device (1)
+} WHTUNING, *PWHTUNING;
+
+typedef const WHTUNING *PCWHTUNING;
+
+PCWHTUNING WHAPI WHGetTuning( );
+VOID WHAPI WHSetTuning( PCWHTUNING pOverrides );
+UINT WHAPI WHTuningMaxTasks( );
+UINT WHAPI WHTuningParallelMin( DWORD dwFlags );
+UINT WHAPI WHTuningFileWorkers( DWORD dwFlags, BOOL bSSD );
+BOOL WHAPI WHTuningPipeline( DWORD dwFlags, UINT cbBuffer );
+
+/**
+ * Multi-buffer hashing: WHUpdateMultiEx updates several (initialized) contexts,
+ * each with its own data, at once; algorithms with a multi-buffer SIMD kernel
+ * hash all the lanes together, and the rest are updated one lane at a time.
+ * WHMultiLanes returns how many lanes are worth filling for dwFlags, or 0 if
+ * none of its algorithms would benefit.
+ **/
+
+#define WHEX_MAX_LANES 16
+
+UINT WHAPI WHMultiLanes( DWORD dwFlags );
+VOID WHAPI WHUpdateMultiEx( PWHCTXEX ppContexts[], PCBYTE ppbIn[], const UINT pcbIn[], UINT cLanes );
+
+/**
+ * WHPipeline* functions: These require WinHashPipeline.cpp
+ *
+ * A pipeline hashes one file at a time, with a persistent thread per algorithm:
+ * WHPipelineBegin takes the place of WHInitEx, each buffer is read into the slot
+ * returned by WHPipelineAcquire and handed over with WHPipelineSubmit, and
+ * WHPipelineFinish takes the place of WHFinishEx (with NULL results, it just
+ * abandons the file).  The context must not be touched in between.  The slots
+ * are page-aligned, so they can take unbuffered reads.
+ **/
+
+typedef struct WHPIPELINE *PWHPIPELINE;
+
+PWHPIPELINE WHAPI WHPipelineCreate( UINT cbSlot );
+VOID WHAPI WHPipelineDestroy( PWHPIPELINE pPipeline );
+BOOL WHAPI WHPipelineBegin( PWHPIPELINE pPipeline, PWHCTXEX pContext );
+PBYTE WHAPI WHPipelineAcquire( PWHPIPELINE pPipeline );
+VOID WHAPI WHPipelineSubmit( PWHPIPELINE pPipeline, UINT cbIn );
+VOID WHAPI WHPipelineFinish( PWHPIPELINE pPipeline, PWHRESULTEX pResults );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,193 @@
+/**
+ * Windows Hashing/Checksumming Library: multi-hash pipeline
+ *
+ * The reader fills a ring of buffers, and every selected algorithm runs on
+ * its own persistent thread, consuming the ring at its own pace.  Unlike
+ * WHUpdateEx's per-buffer task fan-out, there is no barrier after each
+ * buffer, so the next read overlaps the hashing of the previous ones and only
+ * the slowest algorithm (typically SHA-512 or SHA3) limits the throughput.
+ * It uses only the standard C++ threading library.
+ *
+ * WinHashPipeline.cpp is needed only if the WHPipeline* functions are used.
+ **/
+
+#include "WinHash.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <new>
+
+#define WH_PIPELINE_SLOTS 8
+#define WH_PIPELINE_ALIGN 0x1000  // slots are page-aligned, as unbuffered reads need
+
+struct WHPIPELINE
+{
+    std::mutex lock;
+    std::condition_variable cvData[NUM_HASHES + 1];  // per worker: a buffer was published, or stop
+    std::condition_variable cvSpace;                 // for the reader: a buffer was released
+    std::thread workers[NUM_HASHES + 1];             // persistent, started the first time they're needed
+
+    std::unique_ptr<BYTE[]> pbRingAlloc;
+    PBYTE pbRing;                         // pbRingAlloc, aligned to WH_PIPELINE_ALIGN
+    UINT cbSlot;
+    UINT cbData[WH_PIPELINE_SLOTS];       // bytes of data in each slot
+    UINT cPending[WH_PIPELINE_SLOTS];     // workers yet to consume each slot
+
+    PWHCTXEX pContext;                    // the file being hashed
+    DWORD dwActive;                       // its WHEX_CHECK* flags
+    ULONGLONG nPublished;                 // number of buffers submitted so far
+    ULONGLONG nConsumed[NUM_HASHES + 1];  // number of buffers each worker has consumed
+    bool bStop;
+
+    void Worker( UINT uAlg );
+};
+
+static void UpdateOne( PWHCTXEX pContext, UINT uAlg, PCBYTE pbIn, UINT cbIn )
+{
+    switch (uAlg)
+    {
+#define WH_PIPELINE_UPDATE_op(alg)                           \
+        case alg:                                            \
+            WHUpdate##alg(&pContext->ctx##alg, pbIn, cbIn);  \
+            break;
+        FOR_EACH_HASH(WH_PIPELINE_UPDATE_op)
+    }
+}
+
+void WHPIPELINE::Worker( UINT uAlg )
+{
+    const DWORD dwFlag = 1UL << (uAlg - 1);
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;)
+    {
+        cvData[uAlg].wait(guard, [&] { return bStop || ((dwActive & dwFlag) && nConsumed[uAlg] < nPublished); });
+        if (bStop)
+            return;
+
+        UINT iSlot = (UINT)(nConsumed[uAlg] % WH_PIPELINE_SLOTS);
+        PCBYTE pbIn = pbRing + (size_t)iSlot * cbSlot;
+        UINT cbIn = cbData[iSlot];
+
+        // The slot can't be reused until this (and every other) worker releases it
+        guard.unlock();
+        UpdateOne(pContext, uAlg, pbIn, cbIn);
+        guard.lock();
+
+        nConsumed[uAlg]++;
+        if (--cPending[iSlot] == 0)
+            cvSpace.notify_one();
+    }
+}
+
+PWHPIPELINE WHAPI WHPipelineCreate( UINT cbSlot )
+{
+    PWHPIPELINE pPipeline = new (std::nothrow) WHPIPELINE();
+    if (pPipeline == NULL)
+        return(NULL);
+
+    pPipeline->pbRingAlloc.reset(new (std::nothrow) BYTE[(size_t)cbSlot * WH_PIPELINE_SLOTS + WH_PIPELINE_ALIGN - 1]);
+    if (! pPipeline->pbRingAlloc)
+    {
+        delete pPipeline;
+        return(NULL);
+    }
+    pPipeline->pbRing = (PBYTE)(((size_t)pPipeline->pbRingAlloc.get() + WH_PIPELINE_ALIGN - 1) & ~(size_t)(WH_PIPELINE_ALIGN - 1));
+    pPipeline->cbSlot = cbSlot;
+    return(pPipeline);
+}
+
+VOID WHAPI WHPipelineDestroy( PWHPIPELINE pPipeline )
+{
+    if (pPipeline == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(pPipeline->lock);
+        pPipeline->bStop = true;
+    }
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        pPipeline->cvData[uAlg].notify_one();
+        if (pPipeline->workers[uAlg].joinable())
+            pPipeline->workers[uAlg].join();
+    }
+    delete pPipeline;
+}
+
+BOOL WHAPI WHPipelineBegin( PWHPIPELINE pPipeline, PWHCTXEX pContext )
+{
+    // Start the workers for any algorithms which haven't been needed yet
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        if ((pContext->dwFlags & (1UL << (uAlg - 1))) && ! pPipeline->workers[uAlg].joinable())
+        {
+            try
+            {
+                pPipeline->workers[uAlg] = std::thread(&WHPIPELINE::Worker, pPipeline, uAlg);
+            }
+            catch (const std::system_error&)
+            {
+                return(FALSE);
+            }
+        }
+    }
+
+    WHInitEx(pContext);
+
+    // Every worker is idle (see WHPipelineFinish), so they can all be brought up to date
+    std::lock_guard<std::mutex> guard(pPipeline->lock);
+    pPipeline->pContext = pContext;
+    pPipeline->dwActive = pContext->dwFlags;
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+        pPipeline->nConsumed[uAlg] = pPipeline->nPublished;
+    return(TRUE);
+}
+
+PBYTE WHAPI WHPipelineAcquire( PWHPIPELINE pPipeline )
+{
+    std::unique_lock<std::mutex> guard(pPipeline->lock);
+    UINT iSlot = (UINT)(pPipeline->nPublished % WH_PIPELINE_SLOTS);
+
+    // Wait for the slowest worker to release the oldest buffer
+    pPipeline->cvSpace.wait(guard, [&] { return pPipeline->cPending[iSlot] == 0; });
+    return(pPipeline->pbRing + (size_t)iSlot * pPipeline->cbSlot);
+}
+
+VOID WHAPI WHPipelineSubmit( PWHPIPELINE pPipeline, UINT cbIn )
+{
+    std::lock_guard<std::mutex> guard(pPipeline->lock);
+    UINT iSlot = (UINT)(pPipeline->nPublished % WH_PIPELINE_SLOTS);
+    UINT cWorkers = 0;
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+        if (pPipeline->dwActive & (1UL << (uAlg - 1)))
+            cWorkers++;
+
+    pPipeline->cbData[iSlot] = cbIn;
+    pPipeline->cPending[iSlot] = cWorkers;
+    pPipeline->nPublished++;
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+        if (pPipeline->dwActive & (1UL << (uAlg - 1)))
+            pPipeline->cvData[uAlg].notify_one();
+}
+
+VOID WHAPI WHPipelineFinish( PWHPIPELINE pPipeline, PWHRESULTEX pResults )
+{
+    {
+        // Wait for every worker to catch up, i.e. for every slot to be released
+        std::unique_lock<std::mutex> guard(pPipeline->lock);
+        pPipeline->cvSpace.wait(guard, [&] {
+            for (UINT iSlot = 0; iSlot < WH_PIPELINE_SLOTS; ++iSlot)
+                if (pPipeline->cPending[iSlot])
+                    return false;
+            return true;
+        });
+        pPipeline->dwActive = 0;
+    }
+
+    if (pResults)
+        WHFinishEx(pPipeline->pContext, pResults);
+}
@@ -0,0 +1,267 @@
+/**
+ * Windows Hashing/Checksumming Library: self-tuning parallelism limits
+ *
+ * Fanning a buffer out to a task per algorithm costs a task group's dispatch
+ * and wait, and saves the time of all but the slowest algorithm, so it pays
+ * off above dispatch / (sum - max) bytes, where sum and max are the selected
+ * algorithms' total and largest time per byte.  That is anything from a few
+ * KiB (SHA-256 with SHA-512) to a few MiB (CRC-32 with SHA-1) on the same
+ * machine, and it moves with the core count and clock, which a constant
+ * can't.  Likewise, hashing many files at once needs only enough of them to
+ * keep a fast device busy at the selected algorithms' speed per core; more
+ * just compete for the cores and the device's queue.
+ *
+ * The measurements take a few tens of milliseconds, once per process, and
+ * are never changed afterwards; the overrides are kept apart from them and
+ * resolved whenever a limit is read, so that clearing one brings back the
+ * calibrated value, and any thread can set them while others hash.
+ *
+ * WinHashTuning.cpp is needed if WHUpdateEx or the WHTuning* functions are used.
+ **/
+
+#include "WinHash.h"
+#include <chrono>
+#include <climits>
+#ifdef USE_PPL
+#include <ppl.h>
+#else
+#include <thread>
+#endif
+
+// Each algorithm is timed over this much (cached) data, for at least
+// WH_TUNE_MIN_NS, and the best of WH_TUNE_ROUNDS rounds is kept
+#define WH_TUNE_BUFFER_SIZE 0x4000
+#define WH_TUNE_MIN_NS      2000000
+#define WH_TUNE_ROUNDS      3
+
+// The rate that the file workers should be able to keep up with: a fast
+// NVMe device's sequential reads; and the fewest workers worth having, since
+// with small files they mostly wait for opens rather than hash
+#define WH_TUNE_DEVICE_BYTES_PER_SEC 8000000000ULL
+#define WH_TUNE_MIN_FILE_WORKERS     4
+
+// A pipeline (WinHashPipeline.cpp) is only worth its threads if it's predicted
+// to hash at least this much faster (in percent) than WHUpdateEx
+#define WH_TUNE_PIPELINE_MIN_GAIN    125
+
+typedef std::chrono::steady_clock WHClock;
+
+static ULONGLONG ElapsedNs( WHClock::time_point tStart )
+{
+    return (ULONGLONG)std::chrono::duration_cast<std::chrono::nanoseconds>(WHClock::now() - tStart).count();
+}
+
+static UINT MeasurePsPerByte( PWHCTXEX pContext, DWORD dwFlag, PCBYTE pbData )
+{
+    ULONGLONG psBest = ULLONG_MAX;
+
+    pContext->dwFlags = dwFlag;
+    WHInitEx(pContext);
+    WHUpdateEx(pContext, pbData, WH_TUNE_BUFFER_SIZE);  // warm up
+
+    for (UINT iRound = 0; iRound < WH_TUNE_ROUNDS; ++iRound)
+    {
+        ULONGLONG cbDone = 0, ns;
+        WHClock::time_point tStart = WHClock::now();
+
+        // WHUpdateEx with a single algorithm is just its WHUpdate* (and doesn't
+        // look at the tuning being measured here)
+        do
+        {
+            WHUpdateEx(pContext, pbData, WH_TUNE_BUFFER_SIZE);
+            cbDone += WH_TUNE_BUFFER_SIZE;
+        } while ((ns = ElapsedNs(tStart)) < WH_TUNE_MIN_NS);
+
+        if (ns * 1000 / cbDone < psBest)
+            psBest = ns * 1000 / cbDone;
+    }
+
+    WHFreeEx(pContext);
+    return((UINT)(psBest ? psBest : 1));
+}
+
+static UINT MeasureDispatchNs( )
+{
+#ifdef USE_PPL
+    ULONGLONG nsBest = ULLONG_MAX;
+    volatile LONG lSink = 0;
+
+    for (UINT iRound = 0; iRound < WH_TUNE_ROUNDS; ++iRound)
+    {
+        const UINT cGroups = 256;
+        WHClock::time_point tStart = WHClock::now();
+
+        // The same pair of tasks WHUpdateEx would run, with nothing to do
+        for (UINT i = 0; i < cGroups; ++i)
+        {
+            auto task_first = concurrency::make_task([&] { InterlockedIncrement(&lSink); });
+            auto task_second = concurrency::make_task([&] { InterlockedIncrement(&lSink); });
+            concurrency::structured_task_group task_group;
+            task_group.run(task_first);
+            task_group.run(task_second);
+            task_group.wait();
+        }
+
+        ULONGLONG ns = ElapsedNs(tStart) / cGroups;
+        if (ns < nsBest)
+            nsBest = ns;
+    }
+
+    return((UINT)(nsBest ? nsBest : 1));
+#else
+    return(0);
+#endif
+}
+
+static WHTUNING Calibrate( )
+{
+    // Static, for the alignment of its members, and since this runs just once
+    static WHCTXEX whctx;
+    static BYTE abData[WH_TUNE_BUFFER_SIZE];
+    WHTUNING tuning = { };
+
+    for (UINT i = 0; i < WH_TUNE_BUFFER_SIZE; ++i)
+        abData[i] = (BYTE)(i * 2654435761u >> 24);
+
+    whctx.uCaseMode = WHFMT_LOWERCASE;
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+        tuning.auPsPerByte[uAlg - 1] = MeasurePsPerByte(&whctx, 1UL << (uAlg - 1), abData);
+
+    tuning.uDispatchNs = MeasureDispatchNs();
+#ifdef USE_PPL
+    tuning.cMaxTasks = concurrency::GetProcessorCount();
+#else
+    tuning.cMaxTasks = std::thread::hardware_concurrency();
+#endif
+    if (tuning.cMaxTasks == 0)
+        tuning.cMaxTasks = 1;
+    tuning.cFileWorkersHDD = 1;
+
+    return(tuning);
+}
+
+static PCWHTUNING Tuning( )
+{
+    // Initialized on first use, and only once even if several threads get here at once
+    static const WHTUNING s_tuning = Calibrate();
+    return(&s_tuning);
+}
+
+// The limits set with WHSetTuning, each 0 unless overridden; a single LONG
+// apiece, so each is read and written whole without a lock
+static volatile LONG s_lParallelMin, s_lMaxTasks, s_lFileWorkers, s_lFileWorkersHDD;
+
+static UINT Resolve( volatile LONG *plOverride, UINT uCalibrated )
+{
+    UINT uOverride = (UINT)*plOverride;
+    return(uOverride ? uOverride : uCalibrated);
+}
+
+PCWHTUNING WHAPI WHGetTuning( )
+{
+    return(Tuning());
+}
+
+VOID WHAPI WHSetTuning( PCWHTUNING pOverrides )
+{
+    InterlockedExchange(&s_lParallelMin, (LONG)pOverrides->cbParallelMin);
+    InterlockedExchange(&s_lMaxTasks, (LONG)pOverrides->cMaxTasks);
+    InterlockedExchange(&s_lFileWorkers, (LONG)pOverrides->cFileWorkers);
+    InterlockedExchange(&s_lFileWorkersHDD, (LONG)pOverrides->cFileWorkersHDD);
+}
+
+UINT WHAPI WHTuningMaxTasks( )
+{
+    return(Resolve(&s_lMaxTasks, Tuning()->cMaxTasks));
+}
+
+UINT WHAPI WHTuningParallelMin( DWORD dwFlags )
+{
+    PCWHTUNING pTuning = Tuning();
+    ULONGLONG psSum = 0, psMax = 0, cbMin;
+    UINT cbOverride = Resolve(&s_lParallelMin, 0);
+
+    if (cbOverride)
+        return(cbOverride);
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        if (dwFlags & (1UL << (uAlg - 1)))
+        {
+            psSum += pTuning->auPsPerByte[uAlg - 1];
+            if (psMax < pTuning->auPsPerByte[uAlg - 1])
+                psMax = pTuning->auPsPerByte[uAlg - 1];
+        }
+    }
+
+    // A single algorithm (or none) has nothing to run alongside, and without
+    // PPL (no dispatch cost measured), WHUpdateEx has no task groups at all
+    if (psSum == psMax || pTuning->uDispatchNs == 0)
+        return(UINT_MAX);
+
+    cbMin = (ULONGLONG)pTuning->uDispatchNs * 1000 / (psSum - psMax);
+    return((UINT)(cbMin < UINT_MAX ? cbMin : UINT_MAX));
+}
+
+BOOL WHAPI WHTuningPipeline( DWORD dwFlags, UINT cbBuffer )
+{
+    PCWHTUNING pTuning = Tuning();
+    ULONGLONG psSum = 0, psMax = 0, psPipelined, psUpdateEx;
+    UINT cAlgorithms = 0, cMaxTasks = WHTuningMaxTasks();
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        if (dwFlags & (1UL << (uAlg - 1)))
+        {
+            cAlgorithms++;
+            psSum += pTuning->auPsPerByte[uAlg - 1];
+            if (psMax < pTuning->auPsPerByte[uAlg - 1])
+                psMax = pTuning->auPsPerByte[uAlg - 1];
+        }
+    }
+
+    if (cAlgorithms < 2 || cMaxTasks < 2)
+        return(FALSE);
+
+    // The pipeline's threads share the cores, and can't outpace the slowest algorithm
+    psPipelined = psSum / cMaxTasks;
+    if (psPipelined < psMax)
+        psPipelined = psMax;
+
+    // WHUpdateEx either fans each buffer out the same way, for the cost of a
+    // task group per buffer, or runs the algorithms one after another
+    if (cAlgorithms <= cMaxTasks && cbBuffer > WHTuningParallelMin(dwFlags))
+        psUpdateEx = psMax + (ULONGLONG)pTuning->uDispatchNs * 1000 / cbBuffer;
+    else
+        psUpdateEx = psSum;
+
+    return(psUpdateEx * 100 >= psPipelined * WH_TUNE_PIPELINE_MIN_GAIN);
+}
+
+UINT WHAPI WHTuningFileWorkers( DWORD dwFlags, BOOL bSSD )
+{
+    PCWHTUNING pTuning = Tuning();
+    ULONGLONG psSum = 0, cWorkers;
+    UINT cMaxTasks, cOverride = Resolve(&s_lFileWorkers, 0);
+
+    if (! bSSD)
+        return(Resolve(&s_lFileWorkersHDD, pTuning->cFileWorkersHDD));
+    if (cOverride)
+        return(cOverride);
+
+    for (UINT uAlg = 1; uAlg <= NUM_HASHES; ++uAlg)
+    {
+        if (dwFlags & (1UL << (uAlg - 1)))
+            psSum += pTuning->auPsPerByte[uAlg - 1];
+    }
+
+    // Each worker hashes a file with every selected algorithm, at 1 / psSum bytes per picosecond
+    cWorkers = (WH_TUNE_DEVICE_BYTES_PER_SEC * psSum + 999999999999ULL) / 1000000000000ULL;
+    if (cWorkers < WH_TUNE_MIN_FILE_WORKERS)
+        cWorkers = WH_TUNE_MIN_FILE_WORKERS;
+    cMaxTasks = WHTuningMaxTasks();
+    if (cWorkers > cMaxTasks)
+        cWorkers = cMaxTasks;
+
+    return((UINT)cWorkers);
+}
@@ -0,0 +1,140 @@
+/**
+ * CRC-32 folding with VPCLMULQDQ on 512-bit registers
+ *
+ * The same folding scheme as crc32_pclmul.c, but each ZMM register carries
+ * four 128-bit lanes, and four of them fold 256 bytes per iteration; the
+ * fold constants for that distance are x^(256*8+32) mod P and
+ * x^(256*8-32) mod P.  Once the input is exhausted, the lanes are merged down
+ * to a single 128-bit remainder, which is reduced exactly as crc32_pclmul.c
+ * does.  size must be a multiple of 16 and at least 256.
+ **/
+
+#include "crc32_impl.h"
+
+#if defined(CRC32_IS_X86) && !defined(CRC32_NO_AVX512)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define CRC32_ALIGN16 __declspec(align(16))
+#else
+#define CRC32_ALIGN16 __attribute__((aligned(16)))
+#endif
+
+static const uint64_t CRC32_ALIGN16 k256[] = { 0x011542778a, 0x01322d1430 };
+static const uint64_t CRC32_ALIGN16 k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+static const uint64_t CRC32_ALIGN16 k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+static const uint64_t CRC32_ALIGN16 k5k0[] = { 0x0163cd6124, 0x0000000000 };
+static const uint64_t CRC32_ALIGN16 poly[] = { 0x01db710641, 0x01f7011641 };
+
+// Folds x into the next block, i.e. returns (x * k) ^ next
+#define FOLD(x, k, next) \
+	_mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next)
+
+// The same, for all four lanes of a ZMM register (0x96 is a three-way XOR)
+#define FOLD512(x, k, next) \
+	_mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00), _mm512_clmulepi64_epi128(x, k, 0x11), next, 0x96)
+
+// Reduces the 128-bit remainder to the final 32-bit CRC register
+static __inline uint32_t reduce128(__m128i x1)
+{
+	__m128i x0, x2, x3;
+
+	// Fold 128 bits to 64 bits
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduce to 32 bits
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return((uint32_t)_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc32_vpclmul_avx512(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	__m512i z0, z1, z2, z3, zk;
+	__m128i x0, x1, x2, x3, x4;
+
+	// There is at least one block of 256
+	z0 = _mm512_loadu_si512((const void *)(buf + 0x00));
+	z1 = _mm512_loadu_si512((const void *)(buf + 0x40));
+	z2 = _mm512_loadu_si512((const void *)(buf + 0x80));
+	z3 = _mm512_loadu_si512((const void *)(buf + 0xC0));
+
+	z0 = _mm512_xor_si512(z0, _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128((int)crc), 0));
+
+	zk = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *)k256));
+
+	buf += 256;
+	size -= 256;
+
+	// Parallel fold blocks of 256, if any
+	while (size >= 256)
+	{
+		z0 = FOLD512(z0, zk, _mm512_loadu_si512((const void *)(buf + 0x00)));
+		z1 = FOLD512(z1, zk, _mm512_loadu_si512((const void *)(buf + 0x40)));
+		z2 = FOLD512(z2, zk, _mm512_loadu_si512((const void *)(buf + 0x80)));
+		z3 = FOLD512(z3, zk, _mm512_loadu_si512((const void *)(buf + 0xC0)));
+
+		buf += 256;
+		size -= 256;
+	}
+
+	// Fold into 512 bits
+	zk = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *)k1k2));
+
+	z0 = FOLD512(z0, zk, z1);
+	z0 = FOLD512(z0, zk, z2);
+	z0 = FOLD512(z0, zk, z3);
+
+	// Single fold blocks of 64, if any
+	while (size >= 64)
+	{
+		z0 = FOLD512(z0, zk, _mm512_loadu_si512((const void *)buf));
+
+		buf += 64;
+		size -= 64;
+	}
+
+	// Fold the four lanes into 128 bits
+	x1 = _mm512_extracti32x4_epi32(z0, 0);
+	x2 = _mm512_extracti32x4_epi32(z0, 1);
+	x3 = _mm512_extracti32x4_epi32(z0, 2);
+	x4 = _mm512_extracti32x4_epi32(z0, 3);
+
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+
+	x1 = FOLD(x1, x0, x2);
+	x1 = FOLD(x1, x0, x3);
+	x1 = FOLD(x1, x0, x4);
+
+	// Single fold blocks of 16, if any
+	while (size >= 16)
+	{
+		x1 = FOLD(x1, x0, _mm_loadu_si128((const __m128i *)buf));
+
+		buf += 16;
+		size -= 16;
+	}
+
+	return(reduce128(x1));
+}
+
+#endif
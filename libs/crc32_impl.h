@@ -0,0 +1,66 @@
+/**
+ * CRC-32 implementation internals
+ *
+ * Shared between the portable slicing-by-16 code in crc32.c and the
+ * carry-less multiplication kernels in crc32_pclmul.c and crc32_avx512.c,
+ * and, for CRC-32C, between crc32c.c and the SSE4.2 kernel in crc32c_sse42.c.
+ * Everything here is plain C so that it builds with MSVC, GCC or Clang; as
+ * with BLAKE3, GCC and Clang need ISA flags for the kernel files:
+ *   crc32_pclmul.c:  -msse4.1 -mpclmul
+ *   crc32_avx512.c:  -msse4.1 -mpclmul -mavx512f -mvpclmulqdq
+ *   crc32c_sse42.c:  -msse4.2
+ **/
+
+#ifndef __CRC32_IMPL_H__
+#define __CRC32_IMPL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CRC32_IS_X86
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1920
+#define CRC32_NO_AVX512  // VPCLMULQDQ intrinsics first shipped with VS 2019
+#endif
+
+// Runtime-detected kernel support
+enum crc32_cpu_feature {
+	CRC32_PCLMUL          = 1 << 0,  // PCLMULQDQ + SSE4.1
+	CRC32_VPCLMUL_AVX512  = 1 << 1,  // VPCLMULQDQ + AVX512F
+	CRC32_SSE42           = 1 << 2,  // SSE4.2's CRC32 instruction (CRC-32C only)
+	CRC32_UNDEFINED       = 1 << 30
+};
+
+// The folding kernels need at least this many bytes, in multiples of 16
+#define CRC32_PCLMUL_MIN_LENGTH  64
+#define CRC32_AVX512_MIN_LENGTH  256
+
+/**
+ * The kernels operate on the raw (not inverted) CRC register
+ **/
+
+uint32_t crc32_portable( uint32_t crc, const uint8_t *buf, size_t size );
+uint32_t crc32c_portable( uint32_t crc, const uint8_t *buf, size_t size );
+
+#if defined(CRC32_IS_X86)
+uint32_t crc32_pclmul( uint32_t crc, const uint8_t *buf, size_t size );
+uint32_t crc32_vpclmul_avx512( uint32_t crc, const uint8_t *buf, size_t size );
+uint32_t crc32c_sse42( uint32_t crc, const uint8_t *buf, size_t size );
+#endif
+
+// Public entry points (also declared by WinHash.h); these use the usual ~0 pre/post conditioning
+uint32_t crc32( uint32_t crc, const uint8_t *buf, unsigned int size );
+uint32_t crc32_combine( uint32_t crc1, uint32_t crc2, uint64_t len2 );
+uint32_t crc32c( uint32_t crc, const uint8_t *buf, unsigned int size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
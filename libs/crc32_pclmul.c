@@ -0,0 +1,119 @@
+/**
+ * CRC-32 folding with PCLMULQDQ
+ *
+ * Based on "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" (Gopal, Ozturk, Guilford, et al., Intel, 2009).  The constants
+ * below are the bit-reflected k1..k5 and Barrett reduction values given for
+ * the CRC-32 polynomial at the end of that paper:
+ *
+ *      k1 = x^(4*128+32) mod P    k2 = x^(4*128-32) mod P
+ *      k3 = x^(128+32) mod P      k4 = x^(128-32) mod P
+ *      k5 = x^64 mod P            mu = x^64 / P
+ *
+ * Four 128-bit accumulators fold 64 bytes per iteration, they are merged into
+ * one, any remaining 16-byte blocks are folded into that, and the result is
+ * reduced to 32 bits.  size must be a multiple of 16 and at least 64.
+ **/
+
+#include "crc32_impl.h"
+
+#if defined(CRC32_IS_X86)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define CRC32_ALIGN16 __declspec(align(16))
+#else
+#define CRC32_ALIGN16 __attribute__((aligned(16)))
+#endif
+
+static const uint64_t CRC32_ALIGN16 k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+static const uint64_t CRC32_ALIGN16 k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+static const uint64_t CRC32_ALIGN16 k5k0[] = { 0x0163cd6124, 0x0000000000 };
+static const uint64_t CRC32_ALIGN16 poly[] = { 0x01db710641, 0x01f7011641 };
+
+// Folds x into the next block, i.e. returns (x * k) ^ next
+#define FOLD(x, k, next) \
+	_mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next)
+
+// Reduces the 128-bit remainder to the final 32-bit CRC register
+static __inline uint32_t reduce128(__m128i x1)
+{
+	__m128i x0, x2, x3;
+
+	// Fold 128 bits to 64 bits
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduce to 32 bits
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return((uint32_t)_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	__m128i x0, x1, x2, x3, x4;
+
+	// There is at least one block of 64
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+
+	buf += 64;
+	size -= 64;
+
+	// Parallel fold blocks of 64, if any
+	while (size >= 64)
+	{
+		x1 = FOLD(x1, x0, _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+		x2 = FOLD(x2, x0, _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+		x3 = FOLD(x3, x0, _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+		x4 = FOLD(x4, x0, _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+
+		buf += 64;
+		size -= 64;
+	}
+
+	// Fold into 128 bits
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+
+	x1 = FOLD(x1, x0, x2);
+	x1 = FOLD(x1, x0, x3);
+	x1 = FOLD(x1, x0, x4);
+
+	// Single fold blocks of 16, if any
+	while (size >= 16)
+	{
+		x1 = FOLD(x1, x0, _mm_loadu_si128((const __m128i *)buf));
+
+		buf += 16;
+		size -= 16;
+	}
+
+	return(reduce128(x1));
+}
+
+#endif
@@ -0,0 +1,235 @@
+/**
+ * Hex encoding, decoding and validation: kernel dispatch and SSE2 kernels
+ *
+ * The scalar conversions convert a nibble per iteration, with a branch or two
+ * for each; these kernels convert eight or sixteen characters at a time with
+ * compares and masks instead:
+ *
+ *  - encoding splits each byte into its two nibbles, interleaves them, adds
+ *    '0' to each and, to those above 9, the distance from '9' + 1 to 'A' (plus
+ *    0x20 for lower-case), then zero-extends the characters to UTF-16;
+ *  - decoding packs the UTF-16 characters into bytes (with unsigned
+ *    saturation, so that anything beyond Latin-1 stays invalid), classifies
+ *    each as a digit or a letter, turns it into its nibble with (c & 0x0F),
+ *    plus 9 for letters, and joins the pairs of nibbles into bytes;
+ *  - validation makes the same digit/letter check on each UTF-16 character
+ *    and, if the whole block passes, stores it back ORed with 0x20.
+ *
+ * A kernel stops at the first block that fails the check, leaving that block
+ * (and the rest) to the caller's scalar loop, which reports the failure just
+ * as it always has.  The AVX2 kernels (hexconv_avx2.c) handle twice the block
+ * size, and their remainder falls through to the SSE2 ones.
+ **/
+
+#include "hexconv_impl.h"
+
+#if defined(HEXCONV_IS_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <immintrin.h>
+#else
+#error "Unimplemented!"
+#endif
+#endif
+
+#if defined(HEXCONV_IS_X86)
+static uint64_t xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax = 0, edx = 0;
+	__asm__ __volatile__("xgetbv\n" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static void cpuidex(uint32_t out[4], uint32_t id, uint32_t sid)
+{
+#if defined(_MSC_VER)
+	__cpuidex((int *)out, id, sid);
+#elif defined(__i386__) || defined(_M_IX86)
+	__asm__ __volatile__("movl %%ebx, %1\n"
+	                     "cpuid\n"
+	                     "xchgl %1, %%ebx\n"
+	                     : "=a"(out[0]), "=r"(out[1]), "=c"(out[2]), "=d"(out[3])
+	                     : "a"(id), "c"(sid));
+#else
+	__asm__ __volatile__("cpuid\n"
+	                     : "=a"(out[0]), "=b"(out[1]), "=c"(out[2]), "=d"(out[3])
+	                     : "a"(id), "c"(sid));
+#endif
+}
+#endif
+
+#if !defined(HEXCONV_TESTING)
+static /* Allow the variable to be controlled manually for testing */
+#endif
+enum hexconv_cpu_feature g_hexconv_cpu_features = HEXCONV_UNDEFINED;
+
+#if !defined(HEXCONV_TESTING)
+static
+#endif
+enum hexconv_cpu_feature hexconv_get_cpu_features()
+{
+	if (g_hexconv_cpu_features == HEXCONV_UNDEFINED)
+	{
+		enum hexconv_cpu_feature features = 0;
+#if defined(HEXCONV_IS_X86)
+		uint32_t regs[4] = {0};
+		uint32_t max_id;
+
+		cpuidex(regs, 0, 0);
+		max_id = regs[0];
+		cpuidex(regs, 1, 0);
+
+		// OSXSAVE and AVX, and the OS saves the SSE and AVX states
+		if ((regs[2] & (1UL << 27)) && (regs[2] & (1UL << 28)) && (xgetbv() & 6) == 6 && max_id >= 7)
+		{
+			cpuidex(regs, 7, 0);
+
+			// AVX2
+			if (regs[1] & (1UL << 5))
+				features |= HEXCONV_AVX2;
+		}
+#endif
+		g_hexconv_cpu_features = features;
+	}
+
+	return(g_hexconv_cpu_features);
+}
+
+#if defined(HEXCONV_IS_X86)
+
+size_t hex_encode_utf16_sse2( uint16_t *dst, const uint8_t *src, size_t cb, uint8_t case_mode )
+{
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i digit0 = _mm_set1_epi8('0');
+	const __m128i letter = _mm_set1_epi8((char)('A' - '9' - 1 + case_mode));
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i + 8 <= cb; i += 8)
+	{
+		__m128i b = _mm_loadl_epi64((const __m128i *)(src + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+		__m128i lo = _mm_and_si128(b, nibble);
+		__m128i n = _mm_unpacklo_epi8(hi, lo);
+		__m128i ch = _mm_add_epi8(_mm_add_epi8(n, digit0), _mm_and_si128(_mm_cmpgt_epi8(n, nine), letter));
+
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(ch, zero));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 8), _mm_unpackhi_epi8(ch, zero));
+	}
+
+	return(i);
+}
+
+size_t hex_decode_utf16_sse2( uint8_t *dst, const uint16_t *src, size_t cch )
+{
+	const __m128i below0 = _mm_set1_epi8('0' - 1), above9 = _mm_set1_epi8('9' + 1);
+	const __m128i belowa = _mm_set1_epi8('a' - 1), abovef = _mm_set1_epi8('f' + 1);
+	const __m128i lower = _mm_set1_epi8(0x20), nibble = _mm_set1_epi8(0x0F), nine = _mm_set1_epi8(9);
+	const __m128i hinibble = _mm_set1_epi16(0x00F0);
+	size_t i;
+
+	for (i = 0; i + 16 <= cch; i += 16)
+	{
+		__m128i c, lc, digit, alpha, n, w;
+
+		if (!HEXCONV_SAME_PAGE(src + i, 32))
+			break;
+
+		// Characters above 0xFF saturate to 0xFF, and those that are negative as
+		// 16-bit integers to 0, neither of which is a hex digit
+		c = _mm_packus_epi16(_mm_loadu_si128((const __m128i *)(src + i)),
+		                     _mm_loadu_si128((const __m128i *)(src + i + 8)));
+		lc = _mm_or_si128(c, lower);
+
+		// Signed compares are fine, since every hex digit is below 0x80
+		digit = _mm_and_si128(_mm_cmpgt_epi8(c, below0), _mm_cmplt_epi8(c, above9));
+		alpha = _mm_and_si128(_mm_cmpgt_epi8(lc, belowa), _mm_cmplt_epi8(lc, abovef));
+		if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+			break;
+
+		// Each 16-bit lane now holds a high nibble in its low byte and a low nibble in its high byte
+		n = _mm_add_epi8(_mm_and_si128(c, nibble), _mm_and_si128(alpha, nine));
+		w = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(n, 4), hinibble), _mm_srli_epi16(n, 8));
+		_mm_storel_epi64((__m128i *)(dst + i / 2), _mm_packus_epi16(w, w));
+	}
+
+	return(i);
+}
+
+size_t hex_validate_utf16_sse2( uint16_t *s, size_t cch )
+{
+	const __m128i below0 = _mm_set1_epi16('0' - 1), above9 = _mm_set1_epi16('9' + 1);
+	const __m128i belowa = _mm_set1_epi16('a' - 1), abovef = _mm_set1_epi16('f' + 1);
+	const __m128i lower = _mm_set1_epi16(0x20);
+	size_t i;
+
+	for (i = 0; i + 8 <= cch; i += 8)
+	{
+		__m128i c, lc, digit, alpha;
+
+		if (!HEXCONV_SAME_PAGE(s + i, 16))
+			break;
+
+		c = _mm_loadu_si128((const __m128i *)(s + i));
+		lc = _mm_or_si128(c, lower);
+		digit = _mm_and_si128(_mm_cmpgt_epi16(c, below0), _mm_cmplt_epi16(c, above9));
+		alpha = _mm_and_si128(_mm_cmpgt_epi16(lc, belowa), _mm_cmplt_epi16(lc, abovef));
+		if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+			break;
+
+		// ORing in 0x20 leaves the digits as they are
+		_mm_storeu_si128((__m128i *)(s + i), lc);
+	}
+
+	return(i);
+}
+
+#endif
+
+size_t hex_encode_utf16( uint16_t *dst, const uint8_t *src, size_t cb, uint8_t case_mode )
+{
+#if defined(HEXCONV_IS_X86)
+	size_t n = 0;
+
+	if (hexconv_get_cpu_features() & HEXCONV_AVX2)
+		n = hex_encode_utf16_avx2(dst, src, cb, case_mode);
+
+	return(n + hex_encode_utf16_sse2(dst + 2 * n, src + n, cb - n, case_mode));
+#else
+	return(0);
+#endif
+}
+
+size_t hex_decode_utf16( uint8_t *dst, const uint16_t *src, size_t cch )
+{
+#if defined(HEXCONV_IS_X86)
+	size_t n = 0;
+
+	if (hexconv_get_cpu_features() & HEXCONV_AVX2)
+		n = hex_decode_utf16_avx2(dst, src, cch);
+
+	return(n + hex_decode_utf16_sse2(dst + n / 2, src + n, cch - n));
+#else
+	return(0);
+#endif
+}
+
+size_t hex_validate_utf16( uint16_t *s, size_t cch )
+{
+#if defined(HEXCONV_IS_X86)
+	size_t n = 0;
+
+	if (hexconv_get_cpu_features() & HEXCONV_AVX2)
+		n = hex_validate_utf16_avx2(s, cch);
+
+	return(n + hex_validate_utf16_sse2(s + n, cch - n));
+#else
+	return(0);
+#endif
+}
@@ -0,0 +1,107 @@
+/**
+ * Hex encoding, decoding and validation over 256-bit registers
+ *
+ * The same scheme as the SSE2 kernels in hexconv.c, with twice the block
+ * size.  AVX2's packs and unpacks work within each 128-bit half, so the
+ * decoder restores the byte order with a qword permute, and the encoder
+ * leaves the zero-extension to UTF-16 to VPMOVZXBW, which spans both halves.
+ **/
+
+#include "hexconv_impl.h"
+
+#if defined(HEXCONV_IS_X86)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+size_t hex_encode_utf16_avx2( uint16_t *dst, const uint8_t *src, size_t cb, uint8_t case_mode )
+{
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	const __m256i nine = _mm256_set1_epi8(9);
+	const __m256i digit0 = _mm256_set1_epi8('0');
+	const __m256i letter = _mm256_set1_epi8((char)('A' - '9' - 1 + case_mode));
+	size_t i;
+
+	for (i = 0; i + 16 <= cb; i += 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+		__m128i lo = _mm_and_si128(b, nibble);
+		__m256i n = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(hi, lo)),
+		                                    _mm_unpackhi_epi8(hi, lo), 1);
+		__m256i ch = _mm256_add_epi8(_mm256_add_epi8(n, digit0), _mm256_and_si256(_mm256_cmpgt_epi8(n, nine), letter));
+
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(ch)));
+		_mm256_storeu_si256((__m256i *)(dst + 2 * i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(ch, 1)));
+	}
+
+	return(i);
+}
+
+size_t hex_decode_utf16_avx2( uint8_t *dst, const uint16_t *src, size_t cch )
+{
+	const __m256i below0 = _mm256_set1_epi8('0' - 1), above9 = _mm256_set1_epi8('9' + 1);
+	const __m256i belowa = _mm256_set1_epi8('a' - 1), abovef = _mm256_set1_epi8('f' + 1);
+	const __m256i lower = _mm256_set1_epi8(0x20), nibble = _mm256_set1_epi8(0x0F), nine = _mm256_set1_epi8(9);
+	const __m256i hinibble = _mm256_set1_epi16(0x00F0);
+	size_t i;
+
+	for (i = 0; i + 32 <= cch; i += 32)
+	{
+		__m256i c, lc, digit, alpha, n, w;
+
+		if (!HEXCONV_SAME_PAGE(src + i, 64))
+			break;
+
+		// Saturate to bytes as in the SSE2 kernel, then put the 64-bit quarters back in order
+		c = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_loadu_si256((const __m256i *)(src + i)),
+		                                                 _mm256_loadu_si256((const __m256i *)(src + i + 16))), 0xD8);
+		lc = _mm256_or_si256(c, lower);
+
+		// AVX2 only has a greater-than compare, so "x < y" is written as "y > x"
+		digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, below0), _mm256_cmpgt_epi8(above9, c));
+		alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lc, belowa), _mm256_cmpgt_epi8(abovef, lc));
+		if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1)
+			break;
+
+		n = _mm256_add_epi8(_mm256_and_si256(c, nibble), _mm256_and_si256(alpha, nine));
+		w = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(n, 4), hinibble), _mm256_srli_epi16(n, 8));
+
+		// Each half packs to 8 bytes in its low quarter; gather quarters 0 and 2
+		w = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), 0x08);
+		_mm_storeu_si128((__m128i *)(dst + i / 2), _mm256_castsi256_si128(w));
+	}
+
+	return(i);
+}
+
+size_t hex_validate_utf16_avx2( uint16_t *s, size_t cch )
+{
+	const __m256i below0 = _mm256_set1_epi16('0' - 1), above9 = _mm256_set1_epi16('9' + 1);
+	const __m256i belowa = _mm256_set1_epi16('a' - 1), abovef = _mm256_set1_epi16('f' + 1);
+	const __m256i lower = _mm256_set1_epi16(0x20);
+	size_t i;
+
+	for (i = 0; i + 16 <= cch; i += 16)
+	{
+		__m256i c, lc, digit, alpha;
+
+		if (!HEXCONV_SAME_PAGE(s + i, 32))
+			break;
+
+		c = _mm256_loadu_si256((const __m256i *)(s + i));
+		lc = _mm256_or_si256(c, lower);
+		digit = _mm256_and_si256(_mm256_cmpgt_epi16(c, below0), _mm256_cmpgt_epi16(above9, c));
+		alpha = _mm256_and_si256(_mm256_cmpgt_epi16(lc, belowa), _mm256_cmpgt_epi16(abovef, lc));
+		if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1)
+			break;
+
+		_mm256_storeu_si256((__m256i *)(s + i), lc);
+	}
+
+	return(i);
+}
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Hex encoding, decoding and validation kernels
+ *
+ * WHByteToHex, WHHexToByte and HashVerify's ValidateHexSequence hand the
+ * whole blocks of their (UTF-16) strings to these kernels, and finish the
+ * remainder, including any terminator handling, with their own scalar
+ * loops; each kernel returns how much it did, so a return of 0 (no SIMD
+ * support, or too short an input) just leaves everything to the caller.
+ * SSE2 is part of x64 (and of every x86 CPU that Windows 8 runs on), so it
+ * needs no detection; AVX2 is chosen at runtime via CPUID, in the same way
+ * as crc32's and BLAKE3's kernels.  As with those, GCC and Clang need ISA
+ * flags for the kernel file:
+ *   hexconv_avx2.c:  -mavx2
+ **/
+
+#ifndef __HEXCONV_IMPL_H__
+#define __HEXCONV_IMPL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HEXCONV_IS_X86
+#endif
+
+// Runtime-detected kernel support
+enum hexconv_cpu_feature {
+	HEXCONV_AVX2       = 1 << 0,
+	HEXCONV_UNDEFINED  = 1 << 30
+};
+
+// The decoder and validator may be given strings shorter than they're told
+// (the scalar loops stop at the first non-hex character, such as the NUL),
+// so a block is only loaded if it doesn't cross into the next page
+#define HEXCONV_PAGE_SIZE  4096
+#define HEXCONV_SAME_PAGE(p, cb)  \
+	(((uintptr_t)(p) & (HEXCONV_PAGE_SIZE - 1)) <= HEXCONV_PAGE_SIZE - (cb))
+
+/**
+ * hex_encode_utf16 writes 2 * n hex digits for the first n bytes of src
+ * (WHFMT_* case_mode: 0x00 for upper-case, 0x20 for lower-case), with no
+ * terminator; hex_decode_utf16 converts the first n valid, paired digits of
+ * src, stopping before any block that holds a non-hex character; and
+ * hex_validate_utf16 lower-cases the first n characters of s, stopping, the
+ * same way, before any block that isn't all hex.  Each returns its n.
+ **/
+
+size_t hex_encode_utf16( uint16_t *dst, const uint8_t *src, size_t cb, uint8_t case_mode );
+size_t hex_decode_utf16( uint8_t *dst, const uint16_t *src, size_t cch );
+size_t hex_validate_utf16( uint16_t *s, size_t cch );
+
+#if defined(HEXCONV_IS_X86)
+size_t hex_encode_utf16_sse2( uint16_t *dst, const uint8_t *src, size_t cb, uint8_t case_mode );
+size_t hex_decode_utf16_sse2( uint8_t *dst, const uint16_t *src, size_t cch );
+size_t hex_validate_utf16_sse2( uint16_t *s, size_t cch );
+size_t hex_encode_utf16_avx2( uint16_t *dst, const uint8_t *src, size_t cb, uint8_t case_mode );
+size_t hex_decode_utf16_avx2( uint8_t *dst, const uint16_t *src, size_t cch );
+size_t hex_validate_utf16_avx2( uint16_t *s, size_t cch );
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
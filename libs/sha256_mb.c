@@ -0,0 +1,151 @@
+/**
+ * Multi-buffer SHA-256 kernel dispatch
+ *
+ * Picks the widest multi-buffer kernel supported by the CPU (and the OS, for
+ * the extended register state), via CPUID, in the same way as BLAKE3's and
+ * crc32's dispatchers.  A multi-buffer kernel only pays off when it beats the
+ * single-buffer code it replaces: OpenSSL's SHA-NI path hashes one message
+ * about as fast as eight AVX2 lanes hash eight, so AVX2 lanes are offered only
+ * on CPUs without the SHA extensions, whereas sixteen AVX-512 lanes still win.
+ **/
+
+#include "sha256_mb_impl.h"
+
+#if defined(SHA256_MB_IS_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <immintrin.h>
+#else
+#error "Unimplemented!"
+#endif
+#endif
+
+const uint32_t sha256_mb_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#if defined(SHA256_MB_IS_X86)
+static uint64_t xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax = 0, edx = 0;
+	__asm__ __volatile__("xgetbv\n" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static void cpuidex(uint32_t out[4], uint32_t id, uint32_t sid)
+{
+#if defined(_MSC_VER)
+	__cpuidex((int *)out, id, sid);
+#elif defined(__i386__) || defined(_M_IX86)
+	__asm__ __volatile__("movl %%ebx, %1\n"
+	                     "cpuid\n"
+	                     "xchgl %1, %%ebx\n"
+	                     : "=a"(out[0]), "=r"(out[1]), "=c"(out[2]), "=d"(out[3])
+	                     : "a"(id), "c"(sid));
+#else
+	__asm__ __volatile__("cpuid\n"
+	                     : "=a"(out[0]), "=b"(out[1]), "=c"(out[2]), "=d"(out[3])
+	                     : "a"(id), "c"(sid));
+#endif
+}
+#endif
+
+#if !defined(SHA256_MB_TESTING)
+static /* Allow the variable to be controlled manually for testing */
+#endif
+enum sha256_mb_cpu_feature g_sha256_mb_cpu_features = SHA256_MB_UNDEFINED;
+
+#if !defined(SHA256_MB_TESTING)
+static
+#endif
+enum sha256_mb_cpu_feature sha256_mb_get_cpu_features()
+{
+	if (g_sha256_mb_cpu_features == SHA256_MB_UNDEFINED)
+	{
+		enum sha256_mb_cpu_feature features = 0;
+#if defined(SHA256_MB_IS_X86)
+		uint32_t regs[4] = {0};
+		uint32_t max_id;
+
+		cpuidex(regs, 0, 0);
+		max_id = regs[0];
+		cpuidex(regs, 1, 0);
+
+		// OSXSAVE, and the OS saves the SSE and AVX states
+		if ((regs[2] & (1UL << 27)) && max_id >= 7)
+		{
+			uint64_t xcr0 = xgetbv();
+
+			cpuidex(regs, 7, 0);
+
+			if ((regs[1] & (1UL << 29)))
+				features |= SHA256_MB_SHANI;
+			if ((regs[1] & (1UL << 5)) && (xcr0 & 0x06) == 0x06)
+				features |= SHA256_MB_AVX2;
+			// AVX512F, plus the opmask, ZMM_Hi256 and Hi16_ZMM states
+			if ((regs[1] & (1UL << 16)) && (xcr0 & 0xE6) == 0xE6)
+				features |= SHA256_MB_AVX512;
+		}
+#endif
+		g_sha256_mb_cpu_features = features;
+	}
+
+	return(g_sha256_mb_cpu_features);
+}
+
+unsigned sha256_mb_lanes( void )
+{
+#if defined(SHA256_MB_IS_X86)
+	enum sha256_mb_cpu_feature features = sha256_mb_get_cpu_features();
+
+#if !defined(SHA256_MB_NO_AVX512)
+	if (features & SHA256_MB_AVX512)
+		return(16);
+#endif
+	if ((features & SHA256_MB_AVX2) && !(features & SHA256_MB_SHANI))
+		return(8);
+#endif
+	return(0);
+}
+
+void sha256_mb_compress( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes )
+{
+#if defined(SHA256_MB_IS_X86)
+	enum sha256_mb_cpu_feature features = sha256_mb_get_cpu_features();
+
+	while (cLanes)
+	{
+		unsigned cGroup;
+
+#if !defined(SHA256_MB_NO_AVX512)
+		if (features & SHA256_MB_AVX512)
+		{
+			cGroup = cLanes < 16 ? cLanes : 16;
+			sha256_mb_avx512(state, data, nblocks, cGroup);
+		}
+		else
+#endif
+		{
+			cGroup = cLanes < 8 ? cLanes : 8;
+			sha256_mb_avx2(state, data, nblocks, cGroup);
+		}
+
+		state += cGroup;
+		data += cGroup;
+		nblocks += cGroup;
+		cLanes -= cGroup;
+	}
+#endif
+}
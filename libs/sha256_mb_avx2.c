@@ -0,0 +1,144 @@
+/**
+ * Multi-buffer SHA-256 compression over eight lanes of 256-bit registers
+ *
+ * The eight message blocks are loaded row-wise and transposed so that each
+ * register holds the same schedule word of every lane.  Lanes that have run
+ * out of blocks are fed a dummy block and masked out of the state update, so
+ * that lanes of unequal length can share a single pass.
+ **/
+
+#include "sha256_mb_impl.h"
+
+#if defined(SHA256_MB_IS_X86)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHA256_MB_ALIGN32 __declspec(align(32))
+#else
+#define SHA256_MB_ALIGN32 __attribute__((aligned(32)))
+#endif
+#include <immintrin.h>
+
+#define LANES 8
+
+#define ROTR(x, n)  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define XOR3(a, b, c)  _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+#define BSIG0(x)  XOR3(ROTR(x, 2), ROTR(x, 13), ROTR(x, 22))
+#define BSIG1(x)  XOR3(ROTR(x, 6), ROTR(x, 11), ROTR(x, 25))
+#define SSIG0(x)  XOR3(ROTR(x, 7), ROTR(x, 18), _mm256_srli_epi32(x, 3))
+#define SSIG1(x)  XOR3(ROTR(x, 17), ROTR(x, 19), _mm256_srli_epi32(x, 10))
+
+// Ch(e,f,g) = g ^ (e & (f ^ g)) and Maj(a,b,c) = (a & b) | (c & (a | b))
+#define CH(e, f, g)   _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)))
+#define MAJ(a, b, c)  _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)))
+
+// Turns eight rows of eight words into eight columns
+static void transpose8( __m256i r[8] )
+{
+	__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+void sha256_mb_avx2( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes )
+{
+	static const uint8_t SHA256_MB_ALIGN32 dummy[SHA256_MB_BLOCK_LENGTH];
+	uint32_t SHA256_MB_ALIGN32 st[8][LANES];
+	int32_t SHA256_MB_ALIGN32 remaining[LANES];
+	const uint8_t *p[LANES];
+	const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	                                       3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i h[8], w[16], left;
+	size_t max = 0, blk;
+	unsigned i, j;
+
+	for (i = 0; i < LANES; ++i)
+	{
+		size_t n = i < cLanes ? nblocks[i] : 0;
+		for (j = 0; j < 8; ++j)
+			st[j][i] = n ? state[i][j] : 0;
+		p[i] = n ? data[i] : dummy;
+		remaining[i] = (int32_t)n;
+		if (n > max)
+			max = n;
+	}
+
+	for (j = 0; j < 8; ++j)
+		h[j] = _mm256_load_si256((const __m256i *)st[j]);
+	left = _mm256_load_si256((const __m256i *)remaining);
+
+	for (blk = 0; blk < max; ++blk)
+	{
+		__m256i a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+		__m256i active = _mm256_cmpgt_epi32(left, _mm256_setzero_si256());
+
+		for (i = 0; i < LANES; ++i)
+		{
+			w[i] = _mm256_loadu_si256((const __m256i *)p[i]);
+			w[i + 8] = _mm256_loadu_si256((const __m256i *)(p[i] + 32));
+		}
+		transpose8(w);
+		transpose8(w + 8);
+
+		for (j = 0; j < 64; ++j)
+		{
+			__m256i t1, t2;
+
+			if (j < 16)
+				w[j] = _mm256_shuffle_epi8(w[j], bswap);
+			else
+				w[j & 15] = _mm256_add_epi32(_mm256_add_epi32(w[j & 15], SSIG0(w[(j + 1) & 15])),
+				                             _mm256_add_epi32(w[(j + 9) & 15], SSIG1(w[(j + 14) & 15])));
+
+			t1 = _mm256_add_epi32(_mm256_add_epi32(hh, BSIG1(e)),
+			                      _mm256_add_epi32(CH(e, f, g), _mm256_add_epi32(_mm256_set1_epi32((int)sha256_mb_k[j]), w[j & 15])));
+			t2 = _mm256_add_epi32(BSIG0(a), MAJ(a, b, c));
+			hh = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+			d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+		}
+
+		h[0] = _mm256_blendv_epi8(h[0], _mm256_add_epi32(h[0], a), active);
+		h[1] = _mm256_blendv_epi8(h[1], _mm256_add_epi32(h[1], b), active);
+		h[2] = _mm256_blendv_epi8(h[2], _mm256_add_epi32(h[2], c), active);
+		h[3] = _mm256_blendv_epi8(h[3], _mm256_add_epi32(h[3], d), active);
+		h[4] = _mm256_blendv_epi8(h[4], _mm256_add_epi32(h[4], e), active);
+		h[5] = _mm256_blendv_epi8(h[5], _mm256_add_epi32(h[5], f), active);
+		h[6] = _mm256_blendv_epi8(h[6], _mm256_add_epi32(h[6], g), active);
+		h[7] = _mm256_blendv_epi8(h[7], _mm256_add_epi32(h[7], hh), active);
+		left = _mm256_sub_epi32(left, _mm256_set1_epi32(1));
+
+		for (i = 0; i < LANES; ++i)
+		{
+			if ((size_t)remaining[i] > blk + 1)
+				p[i] += SHA256_MB_BLOCK_LENGTH;
+			else
+				p[i] = dummy;
+		}
+	}
+
+	for (j = 0; j < 8; ++j)
+		_mm256_store_si256((__m256i *)st[j], h[j]);
+
+	for (i = 0; i < cLanes; ++i)
+		if (nblocks[i])
+			for (j = 0; j < 8; ++j)
+				state[i][j] = st[j][i];
+}
+
+#endif
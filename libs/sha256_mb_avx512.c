@@ -0,0 +1,151 @@
+/**
+ * Multi-buffer SHA-256 compression over sixteen lanes of 512-bit registers
+ *
+ * The same scheme as sha256_mb_avx2.c, with twice the lanes: a 64-byte block
+ * fills one ZMM register, so sixteen of them transpose into the sixteen
+ * schedule words.  AVX-512 also provides native rotates, three-input logic for
+ * Ch/Maj/Sigma, and write masks in place of the blends.
+ **/
+
+#include "sha256_mb_impl.h"
+
+#if defined(SHA256_MB_IS_X86) && !defined(SHA256_MB_NO_AVX512)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHA256_MB_ALIGN64 __declspec(align(64))
+#else
+#define SHA256_MB_ALIGN64 __attribute__((aligned(64)))
+#endif
+#include <immintrin.h>
+
+#define LANES 16
+
+// 0x96 is a three-way XOR, 0xCA is Ch (a ? b : c) and 0xE8 is Maj (a majority vote)
+#define XOR3(a, b, c)  _mm512_ternarylogic_epi32(a, b, c, 0x96)
+#define CH(e, f, g)    _mm512_ternarylogic_epi32(e, f, g, 0xCA)
+#define MAJ(a, b, c)   _mm512_ternarylogic_epi32(a, b, c, 0xE8)
+
+#define BSIG0(x)  XOR3(_mm512_ror_epi32(x, 2), _mm512_ror_epi32(x, 13), _mm512_ror_epi32(x, 22))
+#define BSIG1(x)  XOR3(_mm512_ror_epi32(x, 6), _mm512_ror_epi32(x, 11), _mm512_ror_epi32(x, 25))
+#define SSIG0(x)  XOR3(_mm512_ror_epi32(x, 7), _mm512_ror_epi32(x, 18), _mm512_srli_epi32(x, 3))
+#define SSIG1(x)  XOR3(_mm512_ror_epi32(x, 17), _mm512_ror_epi32(x, 19), _mm512_srli_epi32(x, 10))
+
+// Turns sixteen rows of sixteen words into sixteen columns
+static void transpose16( __m512i r[16] )
+{
+	__m512i t[16], u[16];
+	unsigned i;
+
+	for (i = 0; i < 16; i += 2)
+	{
+		t[i]     = _mm512_unpacklo_epi32(r[i], r[i + 1]);
+		t[i + 1] = _mm512_unpackhi_epi32(r[i], r[i + 1]);
+	}
+
+	// Each 128-bit lane k of u[4q+j] now holds word 4k+j of rows 4q..4q+3
+	for (i = 0; i < 16; i += 4)
+	{
+		u[i]     = _mm512_unpacklo_epi64(t[i],     t[i + 2]);
+		u[i + 1] = _mm512_unpackhi_epi64(t[i],     t[i + 2]);
+		u[i + 2] = _mm512_unpacklo_epi64(t[i + 1], t[i + 3]);
+		u[i + 3] = _mm512_unpackhi_epi64(t[i + 1], t[i + 3]);
+	}
+
+	for (i = 0; i < 4; ++i)
+	{
+		__m512i x0 = _mm512_shuffle_i32x4(u[i],     u[i + 4],  0x44);
+		__m512i x1 = _mm512_shuffle_i32x4(u[i],     u[i + 4],  0xEE);
+		__m512i y0 = _mm512_shuffle_i32x4(u[i + 8], u[i + 12], 0x44);
+		__m512i y1 = _mm512_shuffle_i32x4(u[i + 8], u[i + 12], 0xEE);
+
+		r[i]      = _mm512_shuffle_i32x4(x0, y0, 0x88);
+		r[i + 4]  = _mm512_shuffle_i32x4(x0, y0, 0xDD);
+		r[i + 8]  = _mm512_shuffle_i32x4(x1, y1, 0x88);
+		r[i + 12] = _mm512_shuffle_i32x4(x1, y1, 0xDD);
+	}
+}
+
+void sha256_mb_avx512( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes )
+{
+	static const uint8_t SHA256_MB_ALIGN64 dummy[SHA256_MB_BLOCK_LENGTH];
+	uint32_t SHA256_MB_ALIGN64 st[8][LANES];
+	int32_t SHA256_MB_ALIGN64 remaining[LANES];
+	const uint8_t *p[LANES];
+	// AVX512F has no byte shuffle, so the big-endian words are swapped with rotates
+	const __m512i lo = _mm512_set1_epi32(0x00FF00FF);
+	__m512i h[8], w[16], left;
+	size_t max = 0, blk;
+	unsigned i, j;
+
+	for (i = 0; i < LANES; ++i)
+	{
+		size_t n = i < cLanes ? nblocks[i] : 0;
+		for (j = 0; j < 8; ++j)
+			st[j][i] = n ? state[i][j] : 0;
+		p[i] = n ? data[i] : dummy;
+		remaining[i] = (int32_t)n;
+		if (n > max)
+			max = n;
+	}
+
+	for (j = 0; j < 8; ++j)
+		h[j] = _mm512_load_si512(st[j]);
+	left = _mm512_load_si512(remaining);
+
+	for (blk = 0; blk < max; ++blk)
+	{
+		__m512i a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+		__mmask16 active = _mm512_cmpgt_epi32_mask(left, _mm512_setzero_si512());
+
+		for (i = 0; i < LANES; ++i)
+			w[i] = _mm512_loadu_si512(p[i]);
+		transpose16(w);
+
+		for (j = 0; j < 64; ++j)
+		{
+			__m512i t1, t2;
+
+			if (j < 16)
+				// Rotating by 24 puts bytes 0 and 2 in place; rotating by 8 does the same for 1 and 3
+				w[j] = _mm512_ternarylogic_epi32(lo, _mm512_ror_epi32(w[j], 24), _mm512_ror_epi32(w[j], 8), 0xCA);
+			else
+				w[j & 15] = _mm512_add_epi32(_mm512_add_epi32(w[j & 15], SSIG0(w[(j + 1) & 15])),
+				                             _mm512_add_epi32(w[(j + 9) & 15], SSIG1(w[(j + 14) & 15])));
+
+			t1 = _mm512_add_epi32(_mm512_add_epi32(hh, BSIG1(e)),
+			                      _mm512_add_epi32(CH(e, f, g), _mm512_add_epi32(_mm512_set1_epi32((int)sha256_mb_k[j]), w[j & 15])));
+			t2 = _mm512_add_epi32(BSIG0(a), MAJ(a, b, c));
+			hh = g; g = f; f = e; e = _mm512_add_epi32(d, t1);
+			d = c; c = b; b = a; a = _mm512_add_epi32(t1, t2);
+		}
+
+		h[0] = _mm512_mask_add_epi32(h[0], active, h[0], a);
+		h[1] = _mm512_mask_add_epi32(h[1], active, h[1], b);
+		h[2] = _mm512_mask_add_epi32(h[2], active, h[2], c);
+		h[3] = _mm512_mask_add_epi32(h[3], active, h[3], d);
+		h[4] = _mm512_mask_add_epi32(h[4], active, h[4], e);
+		h[5] = _mm512_mask_add_epi32(h[5], active, h[5], f);
+		h[6] = _mm512_mask_add_epi32(h[6], active, h[6], g);
+		h[7] = _mm512_mask_add_epi32(h[7], active, h[7], hh);
+		left = _mm512_sub_epi32(left, _mm512_set1_epi32(1));
+
+		for (i = 0; i < LANES; ++i)
+		{
+			if ((size_t)remaining[i] > blk + 1)
+				p[i] += SHA256_MB_BLOCK_LENGTH;
+			else
+				p[i] = dummy;
+		}
+	}
+
+	for (j = 0; j < 8; ++j)
+		_mm512_store_si512(st[j], h[j]);
+
+	for (i = 0; i < cLanes; ++i)
+		if (nblocks[i])
+			for (j = 0; j < 8; ++j)
+				state[i][j] = st[j][i];
+}
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Multi-buffer SHA-256 internals
+ *
+ * Hashes several independent messages at once, one per 32-bit lane of a SIMD
+ * register, in the manner of Intel's multi-buffer crypto libraries: every
+ * lane runs the same rounds on its own message, so 8 (AVX2) or 16 (AVX-512)
+ * small files cost about as much as one.  Only the block compression is done
+ * here; buffering, padding and finalization are left to the caller (WinHash
+ * layers this on top of OpenSSL's own SHA256_CTX).  As with BLAKE3, GCC and
+ * Clang need ISA flags for the kernel files:
+ *   sha256_mb_avx2.c:    -mavx2
+ *   sha256_mb_avx512.c:  -mavx512f
+ **/
+
+#ifndef __SHA256_MB_IMPL_H__
+#define __SHA256_MB_IMPL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHA256_MB_IS_X86
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1910
+#define SHA256_MB_NO_AVX512  // AVX-512 intrinsics first shipped with VS 2017
+#endif
+
+// Runtime-detected kernel support
+enum sha256_mb_cpu_feature {
+	SHA256_MB_AVX2       = 1 << 0,
+	SHA256_MB_AVX512     = 1 << 1,  // AVX512F
+	SHA256_MB_SHANI      = 1 << 2,  // single-buffer SHA extensions (used by OpenSSL)
+	SHA256_MB_UNDEFINED  = 1 << 30
+};
+
+#define SHA256_MB_BLOCK_LENGTH  64
+#define SHA256_MB_MAX_LANES     16
+
+extern const uint32_t sha256_mb_k[64];
+
+/**
+ * Each kernel compresses nblocks[i] consecutive 64-byte blocks at data[i]
+ * into the eight-word chaining value state[i], for each of cLanes lanes
+ * (at most the kernel's width); lanes may have differing block counts
+ **/
+
+#if defined(SHA256_MB_IS_X86)
+void sha256_mb_avx2( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes );
+void sha256_mb_avx512( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes );
+#endif
+
+// Returns the number of lanes worth filling: 0 if there is no multi-buffer
+// kernel or if it would not beat a single-buffer SHA-NI implementation
+unsigned sha256_mb_lanes( void );
+
+// Compresses any number of lanes with the best available kernel (only valid if
+// sha256_mb_lanes() is nonzero)
+void sha256_mb_compress( uint32_t *state[], const uint8_t *data[], const size_t nblocks[], unsigned cLanes );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif